@@ -0,0 +1,108 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Measures how creating (and then unlinking) files in a single directory
+ * scales with the number of threads.
+ *
+ * Usage: bench/dir_create [files_per_thread]
+ *
+ * Every thread works on its own names, so only the directory itself is
+ * shared. Metadata accesses sleep for 5 us, as if served by a fast device.
+ */
+
+#define MAX_THREADS (64)
+
+typedef struct {
+    int id;
+    int files;
+} worker_t;
+
+static pthread_barrier_t barrier;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *create_fn(void *arg) {
+    worker_t const *w = arg;
+    char name[16];
+
+    pthread_barrier_wait(&barrier);
+    for (int i = 0; i < w->files; i++) {
+        snprintf(name, sizeof(name), "/t%d_%d", w->id, i);
+        int f = tfs_open(name, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+    }
+    return NULL;
+}
+
+static void *unlink_fn(void *arg) {
+    worker_t const *w = arg;
+    char name[16];
+
+    pthread_barrier_wait(&barrier);
+    for (int i = 0; i < w->files; i++) {
+        snprintf(name, sizeof(name), "/t%d_%d", w->id, i);
+        assert(tfs_unlink(name) != -1);
+    }
+    return NULL;
+}
+
+// Runs fn on n_threads threads; returns the elapsed time
+static double run(void *(*fn)(void *), worker_t *workers, int n_threads) {
+    pthread_t tid[MAX_THREADS];
+
+    assert(pthread_barrier_init(&barrier, NULL, (unsigned)n_threads + 1) ==
+           0);
+    for (int i = 0; i < n_threads; i++) {
+        assert(pthread_create(&tid[i], NULL, fn, &workers[i]) == 0);
+    }
+    pthread_barrier_wait(&barrier);
+    double start = now();
+    for (int i = 0; i < n_threads; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+    double elapsed = now() - start;
+    assert(pthread_barrier_destroy(&barrier) == 0);
+    return elapsed;
+}
+
+int main(int argc, char **argv) {
+    int files = argc > 1 ? atoi(argv[1]) : 20;
+    worker_t workers[MAX_THREADS];
+
+    printf("%8s %14s %14s\n", "threads", "creates/s", "unlinks/s");
+    for (int n_threads = 1; n_threads <= MAX_THREADS; n_threads *= 2) {
+        int total = n_threads * files;
+
+        tfs_params params = tfs_default_params();
+        params.block_size = 64 * 1024; // room for ~1500 entries
+        params.max_block_count = 4;
+        params.max_inode_count = (size_t)total + 1;
+        params.max_open_files_count = MAX_THREADS;
+        params.inode_cache_size = (size_t)total + 1;
+        params.latency.mode = TFS_LATENCY_SLEEP;
+        params.latency.metadata_ns = 5000;
+        assert(tfs_init(&params) != -1);
+
+        for (int i = 0; i < n_threads; i++) {
+            workers[i].id = i;
+            workers[i].files = files;
+        }
+        double created = run(create_fn, workers, n_threads);
+        double unlinked = run(unlink_fn, workers, n_threads);
+        printf("%8d %14.0f %14.0f\n", n_threads, total / created,
+               total / unlinked);
+
+        assert(tfs_destroy() != -1);
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Measures how directory lookups scale with the number of threads.
+ *
+ * Usage: bench/dir_lookup [lookups_per_thread]
+ *
+ * The directory is filled with files, and every thread looks up names that
+ * are not in it, by opening them without TFS_O_CREAT: that touches nothing
+ * but the directory (opening existing files would also go through the open
+ * file table). Each lookup scans the name's home bucket, as a hit would.
+ */
+
+#define MAX_THREADS (64)
+#define FILES (1000)
+
+static pthread_barrier_t barrier;
+static int lookups;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *lookup_fn(void *arg) {
+    unsigned seed = (unsigned)(size_t)arg;
+    char name[16];
+
+    pthread_barrier_wait(&barrier);
+    for (int i = 0; i < lookups; i++) {
+        snprintf(name, sizeof(name), "/g%d", rand_r(&seed) % FILES);
+        assert(tfs_open(name, 0) == -1);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    lookups = argc > 1 ? atoi(argv[1]) : 20000;
+    pthread_t tid[MAX_THREADS];
+    char name[16];
+
+    tfs_params params = tfs_default_params();
+    params.block_size = 64 * 1024; // room for ~1500 entries
+    params.max_block_count = 4;
+    params.max_inode_count = FILES + 1;
+    params.inode_cache_size = FILES + 1;
+    params.latency.mode = TFS_LATENCY_NONE;
+    assert(tfs_init(&params) != -1);
+
+    for (int i = 0; i < FILES; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        int f = tfs_open(name, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+    }
+
+    printf("%8s %14s\n", "threads", "lookups/s");
+    for (int n_threads = 1; n_threads <= MAX_THREADS; n_threads *= 2) {
+        assert(pthread_barrier_init(&barrier, NULL,
+                                    (unsigned)n_threads + 1) == 0);
+        for (int i = 0; i < n_threads; i++) {
+            assert(pthread_create(&tid[i], NULL, lookup_fn,
+                                  (void *)(size_t)(i + 1)) == 0);
+        }
+        pthread_barrier_wait(&barrier);
+        double start = now();
+        for (int i = 0; i < n_threads; i++) {
+            assert(pthread_join(tid[i], NULL) == 0);
+        }
+        double elapsed = now() - start;
+        assert(pthread_barrier_destroy(&barrier) == 0);
+
+        printf("%8d %14.0f\n", n_threads,
+               (double)n_threads * lookups / elapsed);
+    }
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Measures tfs_copy_from_external_fs throughput on large files.
+ *
+ * Usage: bench/import_throughput [size_mb] [iterations]
+ *
+ * The file system is configured with a block size equal to the source file
+ * size, so the whole file fits in the single block a TécnicoFS file holds.
+ */
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    size_t size_mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+    int iterations = argc > 2 ? atoi(argv[2]) : 4;
+    size_t size = size_mb << 20;
+    assert(size > 0 && iterations > 0);
+
+    // source file, filled with pseudo-random binary data
+    char path_src[] = "/tmp/tfs_bench_import_XXXXXX";
+    int fd = mkstemp(path_src);
+    assert(fd != -1);
+    char chunk[1 << 16];
+    for (size_t written = 0; written < size; written += sizeof(chunk)) {
+        for (size_t i = 0; i < sizeof(chunk); i++) {
+            chunk[i] = (char)rand();
+        }
+        size_t len = size - written < sizeof(chunk) ? size - written
+                                                      : sizeof(chunk);
+        assert(write(fd, chunk, len) == (ssize_t)len);
+    }
+    assert(close(fd) == 0);
+
+    tfs_params params = tfs_default_params();
+    params.block_size = size;
+    params.max_block_count = 2; // root directory + file
+    params.max_inode_count = 2;
+    assert(tfs_init(&params) != -1);
+
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        assert(tfs_copy_from_external_fs(path_src, "/imported") != -1);
+    }
+    double elapsed = now() - start;
+
+    double total_mb = (double)(size_mb * (size_t)iterations);
+    printf("import: %zu MiB x %d in %.3f s, %.1f MiB/s\n", size_mb,
+           iterations, elapsed, total_mb / elapsed);
+
+    assert(tfs_destroy() != -1);
+    assert(unlink(path_src) == 0);
+    return 0;
+}
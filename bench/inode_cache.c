@@ -0,0 +1,96 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Reports the simulated storage accesses to inodes saved by the inode cache,
+ * per operation type.
+ *
+ * Usage: bench/inode_cache [iterations]
+ *
+ * Each operation type is run on its own, and the inode cache hits counted
+ * meanwhile are divided by the number of operations.
+ */
+
+#define FILES (16)
+
+static tfs_cache_stats_t last;
+
+static void report(char const *op, int count) {
+    tfs_cache_stats_t stats;
+    assert(tfs_inode_cache_stats(&stats) == 0);
+    size_t hits = stats.hits - last.hits;
+    size_t misses = stats.misses - last.misses;
+    printf("%-8s %8.2f saved/op %8.2f loaded/op\n", op,
+           (double)hits / count, (double)misses / count);
+    last = stats;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 64;
+    assert(iterations > 0);
+
+    char name[16];
+    char buffer[8];
+    int fhandles[FILES];
+
+    assert(tfs_init(NULL) != -1);
+    assert(tfs_inode_cache_stats(&last) == 0);
+
+    for (int i = 0; i < FILES; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        fhandles[i] = tfs_open(name, TFS_O_CREAT);
+        assert(fhandles[i] != -1);
+    }
+    report("create", FILES);
+
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < FILES; i++) {
+            assert(tfs_write(fhandles[i], "x", 1) == 1);
+        }
+    }
+    report("write", iterations * FILES);
+
+    for (int i = 0; i < FILES; i++) {
+        assert(tfs_close(fhandles[i]) != -1);
+    }
+    report("close", FILES);
+
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < FILES; i++) {
+            snprintf(name, sizeof(name), "/f%d", i);
+            fhandles[i] = tfs_open(name, 0);
+            assert(fhandles[i] != -1);
+            assert(tfs_close(fhandles[i]) != -1);
+        }
+    }
+    report("open", iterations * FILES);
+
+    for (int i = 0; i < FILES; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        fhandles[i] = tfs_open(name, 0);
+        assert(fhandles[i] != -1);
+    }
+    assert(tfs_inode_cache_stats(&last) == 0);
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < FILES; i++) {
+            assert(tfs_read(fhandles[i], buffer, 1) == 1);
+        }
+    }
+    report("read", iterations * FILES);
+
+    for (int i = 0; i < FILES; i++) {
+        assert(tfs_close(fhandles[i]) != -1);
+    }
+    assert(tfs_inode_cache_stats(&last) == 0);
+    for (int i = 0; i < FILES; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        assert(tfs_unlink(name) != -1);
+    }
+    report("unlink", FILES);
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
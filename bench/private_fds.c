@@ -0,0 +1,115 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Measures the aggregate throughput of opening, reading and closing files as
+ * threads are added, with handles taken from the instance's open file table,
+ * and from per-thread private tables (tfs_private_files).
+ *
+ * Usage: bench/private_fds [ops_per_thread]
+ *
+ * Every thread works on its own file, which the inode cache keeps resident,
+ * and there is no storage latency: the open file table is the main shared
+ * structure left.
+ */
+
+#define MAX_THREADS (16)
+
+typedef struct {
+    int id;
+    int ops;
+    bool private_files;
+} worker_t;
+
+static pthread_barrier_t barrier;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static tfs_params bench_params(void) {
+    tfs_params params = tfs_default_params();
+    params.max_open_files_count = MAX_THREADS;
+    params.latency.mode = TFS_LATENCY_NONE;
+    return params;
+}
+
+static void *worker_fn(void *arg) {
+    worker_t const *w = arg;
+    char name[16];
+    char buffer[64] = {0};
+
+    if (w->private_files) {
+        assert(tfs_private_files(1) != -1);
+    }
+    snprintf(name, sizeof(name), "/t%d", w->id);
+    int f = tfs_open(name, TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, buffer, sizeof(buffer)) == sizeof(buffer));
+    assert(tfs_close(f) != -1);
+
+    pthread_barrier_wait(&barrier);
+    for (int i = 0; i < w->ops; i++) {
+        f = tfs_open(name, 0);
+        assert(f != -1);
+        assert(tfs_read(f, buffer, sizeof(buffer)) == sizeof(buffer));
+        assert(tfs_close(f) != -1);
+    }
+    if (w->private_files) {
+        assert(tfs_private_files(0) != -1);
+    }
+    return NULL;
+}
+
+// Runs the workers; returns the elapsed time
+static double run(worker_t *workers, int n_threads) {
+    pthread_t tid[MAX_THREADS];
+
+    assert(pthread_barrier_init(&barrier, NULL, (unsigned)n_threads + 1) ==
+           0);
+    for (int i = 0; i < n_threads; i++) {
+        assert(pthread_create(&tid[i], NULL, worker_fn, &workers[i]) == 0);
+    }
+    pthread_barrier_wait(&barrier);
+    double start = now();
+    for (int i = 0; i < n_threads; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+    double elapsed = now() - start;
+    assert(pthread_barrier_destroy(&barrier) == 0);
+    return elapsed;
+}
+
+int main(int argc, char **argv) {
+    int ops = argc > 1 ? atoi(argv[1]) : 20000;
+    worker_t workers[MAX_THREADS];
+    tfs_params params = bench_params();
+
+    printf("%8s %16s %16s\n", "threads", "shared ops/s", "private ops/s");
+    for (int n_threads = 1; n_threads <= MAX_THREADS; n_threads *= 2) {
+        double total = (double)n_threads * ops;
+
+        assert(tfs_init(&params) != -1);
+        for (int i = 0; i < n_threads; i++) {
+            workers[i] =
+                (worker_t){.id = i, .ops = ops, .private_files = false};
+        }
+        double shared = run(workers, n_threads);
+        for (int i = 0; i < n_threads; i++) {
+            workers[i].private_files = true;
+        }
+        double private = run(workers, n_threads);
+        assert(tfs_destroy() != -1);
+
+        printf("%8d %16.0f %16.0f\n", n_threads, total / shared,
+               total / private);
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Measures sequential scan throughput, with and without readahead.
+ *
+ * Usage: bench/readahead [file_mb] [chunk_kb]
+ *
+ * A set of files twice as large as the block cache is scanned a few times in
+ * small chunks, so every file is read from (simulated) storage. The storage
+ * is modelled as a device with 100 us of latency and 1 GiB/s of bandwidth.
+ */
+
+#define FILES (16)
+#define CACHE_SIZE (8)
+#define PASSES (4)
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double scan(size_t file_size, size_t chunk_size, size_t readahead) {
+    char name[16];
+    char *buffer = malloc(chunk_size);
+    assert(buffer != NULL);
+
+    tfs_params params = tfs_default_params();
+    params.block_size = file_size;
+    params.max_block_count = FILES + 1;
+    params.max_inode_count = FILES + 1;
+    params.block_cache_size = CACHE_SIZE; // a single bucket
+    params.readahead_max = readahead;
+    params.latency.mode = TFS_LATENCY_SLEEP;
+    params.latency.data_ns = 100000;
+    params.latency.bandwidth = 1UL << 30;
+    assert(tfs_init(&params) != -1);
+
+    for (int i = 0; i < FILES; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        int f = tfs_open(name, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_fallocate(f, 0, file_size) == 0);
+        assert(tfs_ftruncate(f, file_size) == 0);
+        assert(tfs_close(f) != -1);
+    }
+    assert(tfs_sync() == 0);
+
+    unsigned long checksum = 0;
+    double start = now();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (int i = 0; i < FILES; i++) {
+            snprintf(name, sizeof(name), "/f%d", i);
+            int f = tfs_open(name, 0);
+            assert(f != -1);
+            ssize_t r;
+            while ((r = tfs_read(f, buffer, chunk_size)) > 0) {
+                // consume the data
+                for (ssize_t j = 0; j < r; j++) {
+                    checksum += (unsigned char)buffer[j];
+                }
+            }
+            assert(r == 0);
+            assert(tfs_close(f) != -1);
+        }
+    }
+    double elapsed = now() - start;
+    assert(checksum == 0); // the files are zero-filled
+
+    assert(tfs_destroy() != -1);
+    free(buffer);
+    return (double)(file_size * FILES * PASSES) / (1 << 20) / elapsed;
+}
+
+int main(int argc, char **argv) {
+    size_t file_mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 4;
+    size_t chunk_kb = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+    assert(file_mb > 0 && chunk_kb > 0);
+
+    size_t file_size = file_mb << 20;
+    size_t chunk_size = chunk_kb << 10;
+    printf("scan: %d files of %zu MiB in %zu KiB reads\n", FILES, file_mb,
+           chunk_kb);
+    printf("  no readahead:   %8.1f MiB/s\n", scan(file_size, chunk_size, 0));
+    printf("  readahead 1MiB: %8.1f MiB/s\n",
+           scan(file_size, chunk_size, 1 << 20));
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include "fs/operations.h"
+#include "fs/ring.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Measures small-op throughput of ring batches against synchronous calls.
+ *
+ * Usage: bench/ring [ops] [op_size]
+ *
+ * Small writes, small reads and open/close pairs are spread round robin over
+ * a set of files, first with the synchronous tfs_* calls and then through a
+ * ring, submitting batches of increasing size and reaping each batch before
+ * the next. The block cache is off and every storage access sleeps, so each
+ * request pays the simulated latency.
+ */
+
+#define FILES (64)
+#define MAX_BATCH (256)
+#define RING_WORKERS (16)
+#define FILE_SIZE (64 * 1024)
+
+static size_t ops;
+static size_t op_size;
+static char names[FILES][16];
+static int fhandles[FILES];
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void open_all(void) {
+    for (int i = 0; i < FILES; i++) {
+        fhandles[i] = tfs_open(names[i], 0);
+        assert(fhandles[i] != -1);
+    }
+}
+
+static void close_all(void) {
+    for (int i = 0; i < FILES; i++) {
+        assert(tfs_close(fhandles[i]) != -1);
+    }
+}
+
+static double run_sync(tfs_op_t op, char *buffer) {
+    if (op != TFS_OP_OPEN) {
+        open_all();
+    }
+    double start = now();
+    for (size_t i = 0; i < ops; i++) {
+        int f = fhandles[i % FILES];
+        if (op == TFS_OP_WRITE) {
+            assert(tfs_write(f, buffer, op_size) == (ssize_t)op_size);
+        } else if (op == TFS_OP_READ) {
+            assert(tfs_read(f, buffer, op_size) == (ssize_t)op_size);
+        } else {
+            f = tfs_open(names[i % FILES], 0);
+            assert(f != -1);
+            assert(tfs_close(f) != -1);
+        }
+    }
+    double elapsed = now() - start;
+    if (op != TFS_OP_OPEN) {
+        close_all();
+    }
+    return (double)ops / elapsed;
+}
+
+static void submit_and_reap(tfs_ring_t *ring, tfs_cqe_t *cqes, size_t count,
+                            ssize_t expected) {
+    assert(tfs_ring_submit(ring) == (int)count);
+    size_t reaped = 0;
+    while (reaped < count) {
+        reaped += tfs_ring_reap(ring, cqes + reaped, count - reaped, 1);
+    }
+    for (size_t i = 0; i < count; i++) {
+        assert(expected == -1 ? cqes[i].result != -1
+                              : cqes[i].result == expected);
+    }
+}
+
+static double run_ring(tfs_op_t op, char *buffer, size_t batch) {
+    tfs_cqe_t cqes[MAX_BATCH];
+    tfs_ring_t *ring = tfs_ring_create(batch, RING_WORKERS);
+    assert(ring != NULL);
+    if (op != TFS_OP_OPEN) {
+        open_all();
+    }
+
+    double start = now();
+    for (size_t done = 0; done < ops; done += batch) {
+        size_t count = ops - done < batch ? ops - done : batch;
+        for (size_t i = 0; i < count; i++) {
+            tfs_sqe_t *sqe = tfs_ring_get_sqe(ring);
+            assert(sqe != NULL);
+            sqe->opcode = op;
+            sqe->fhandle = fhandles[(done + i) % FILES];
+            sqe->name = names[(done + i) % FILES];
+            sqe->buffer = buffer;
+            sqe->len = op_size;
+            sqe->user_data = done + i;
+        }
+        if (op != TFS_OP_OPEN) {
+            submit_and_reap(ring, cqes, count, (ssize_t)op_size);
+            continue;
+        }
+        // an open/close pair is two round trips: the close needs the handle
+        submit_and_reap(ring, cqes, count, -1);
+        for (size_t i = 0; i < count; i++) {
+            tfs_sqe_t *sqe = tfs_ring_get_sqe(ring);
+            assert(sqe != NULL);
+            sqe->opcode = TFS_OP_CLOSE;
+            sqe->fhandle = (int)cqes[i].result;
+        }
+        submit_and_reap(ring, cqes, count, 0);
+    }
+    double elapsed = now() - start;
+
+    if (op != TFS_OP_OPEN) {
+        close_all();
+    }
+    tfs_ring_destroy(ring);
+    return (double)ops / elapsed;
+}
+
+int main(int argc, char **argv) {
+    ops = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+    op_size = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+    assert(op_size > 0 && op_size <= FILE_SIZE);
+    // reads and writes on a handle stay within its file
+    assert((ops / FILES + 1) * op_size <= FILE_SIZE);
+
+    char *buffer = malloc(op_size);
+    assert(buffer != NULL);
+    memset(buffer, 'x', op_size);
+
+    tfs_params params = tfs_default_params();
+    params.block_size = FILE_SIZE;
+    params.max_block_count = FILES + 1;
+    params.max_inode_count = FILES + 1;
+    params.max_open_files_count = MAX_BATCH + FILES;
+    params.block_cache_size = 0;
+    params.readahead_max = 0;
+    params.latency.mode = TFS_LATENCY_SLEEP;
+    params.latency.metadata_ns = 10000;
+    params.latency.data_ns = 10000;
+    assert(tfs_init(&params) != -1);
+
+    for (int i = 0; i < FILES; i++) {
+        snprintf(names[i], sizeof(names[i]), "/f%d", i);
+        int f = tfs_open(names[i], TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_ftruncate(f, FILE_SIZE) == 0);
+        assert(tfs_close(f) != -1);
+    }
+
+    tfs_op_t const op_codes[] = {TFS_OP_WRITE, TFS_OP_READ, TFS_OP_OPEN};
+    printf("%8s %14s %14s %14s\n", "batch", "writes/s", "reads/s",
+           "opens/s");
+    printf("%8s", "sync");
+    for (size_t j = 0; j < 3; j++) {
+        printf(" %14.0f", run_sync(op_codes[j], buffer));
+    }
+    printf("\n");
+    for (size_t batch = 1; batch <= MAX_BATCH; batch *= 4) {
+        printf("%8zu", batch);
+        for (size_t j = 0; j < 3; j++) {
+            printf(" %14.0f", run_ring(op_codes[j], buffer, batch));
+        }
+        printf("\n");
+    }
+
+    assert(tfs_destroy() != -1);
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Measures how reads of a hot file scale with the number of threads.
+ *
+ * Usage: bench/small_reads [reads_per_thread] [read_size]
+ *
+ * Every thread opens the same file and reads it sequentially in small
+ * chunks, as in tests/concurrent_reads; the file stays in the block cache.
+ */
+
+#define MAX_THREADS (64)
+#define FILE_SIZE (1 << 20)
+
+static pthread_barrier_t barrier;
+static size_t reads;
+static size_t read_size;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *read_fn(void *arg) {
+    (void)arg;
+    char buffer[4096];
+    int f = tfs_open("/hot", 0);
+    assert(f != -1);
+
+    pthread_barrier_wait(&barrier);
+    for (size_t i = 0; i < reads; i++) {
+        ssize_t r = tfs_read(f, buffer, read_size);
+        if (r == 0) {
+            // at the end of the file: start over
+            assert(tfs_close(f) != -1);
+            f = tfs_open("/hot", 0);
+            assert(f != -1);
+        } else {
+            assert(r == (ssize_t)read_size);
+        }
+    }
+    assert(tfs_close(f) != -1);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    reads = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+    read_size = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+    assert(read_size > 0 && read_size <= 4096 && FILE_SIZE % read_size == 0);
+    pthread_t tid[MAX_THREADS];
+
+    tfs_params params = tfs_default_params();
+    params.block_size = FILE_SIZE;
+    params.max_block_count = 2;
+    params.max_open_files_count = MAX_THREADS + 1;
+    params.readahead_max = 0;
+    params.latency.mode = TFS_LATENCY_NONE;
+    assert(tfs_init(&params) != -1);
+
+    int f = tfs_open("/hot", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_ftruncate(f, FILE_SIZE) == 0);
+    assert(tfs_close(f) != -1);
+
+    printf("%8s %14s\n", "threads", "reads/s");
+    for (int n_threads = 1; n_threads <= MAX_THREADS; n_threads *= 2) {
+        assert(pthread_barrier_init(&barrier, NULL,
+                                    (unsigned)n_threads + 1) == 0);
+        for (int i = 0; i < n_threads; i++) {
+            assert(pthread_create(&tid[i], NULL, read_fn, NULL) == 0);
+        }
+        pthread_barrier_wait(&barrier);
+        double start = now();
+        for (int i = 0; i < n_threads; i++) {
+            assert(pthread_join(tid[i], NULL) == 0);
+        }
+        double elapsed = now() - start;
+        assert(pthread_barrier_destroy(&barrier) == 0);
+
+        printf("%8d %14.0f\n", n_threads,
+               (double)n_threads * (double)reads / elapsed);
+    }
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
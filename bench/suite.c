@@ -0,0 +1,449 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Benchmark suite: measures the throughput and latency of each operation, as
+ * threads are added, and reports them as JSON (for tracking regressions).
+ *
+ * Usage: bench/suite [options]
+ *   -t threads     largest number of threads (runs at 1, 2, 4, ... of them)
+ *   -n ops         operations per thread, in each run
+ *   -o op,op,...   operations to run (all by default): open, close, create,
+ *                  unlink, read_small, read_large, write_small, write_large,
+ *                  link, symlink, import
+ *   -B bytes       block size (the size of large reads, writes and imports)
+ *   -C blocks      block cache size
+ *   -I inodes      inode cache size
+ *   -L mode        latency mode: none, loop, spin or sleep
+ *   -M ns          metadata access latency
+ *   -D ns          data access latency
+ *   -V version     label of the version measured, copied to the output
+ *
+ * Every thread works on its own files, so what threads share is the file
+ * system itself. Only the operation measured is timed: e.g., the files read
+ * are opened before the clock starts. Small reads and writes move SMALL_IO
+ * bytes; large ones a whole block.
+ *
+ * Latency percentiles are of the timed operations, while ops/s is over the
+ * whole run, untimed steps included.
+ */
+
+#define SMALL_IO (64)
+
+typedef struct {
+    int id;
+    int ops;
+    uint64_t *latencies; // of each operation, in ns
+    char file[16];       // the thread's file, a block long
+    char scratch[16];    // name created and removed by the operations
+    char *buffer;        // a block
+    int fhandle;         // kept open across operations, by some of them
+    size_t offset;
+    uint64_t start; // when the thread started, and finished, the operations
+    uint64_t end;
+} worker_t;
+
+typedef struct {
+    char const *name;
+    void (*setup)(worker_t *);    // optional, not timed
+    uint64_t (*run)(worker_t *);  // returns the time of the operation
+    void (*teardown)(worker_t *); // optional, not timed
+} op_t;
+
+static size_t block_size;
+static char import_path[] = "/tmp/tfs_suite_XXXXXX";
+static pthread_barrier_t barrier;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int open_file(char const *name, tfs_file_mode_t mode) {
+    int f = tfs_open(name, mode);
+    assert(f != -1);
+    return f;
+}
+
+static uint64_t run_open(worker_t *w) {
+    uint64_t start = now_ns();
+    int f = tfs_open(w->file, 0);
+    uint64_t end = now_ns();
+    assert(f != -1 && tfs_close(f) != -1);
+    return end - start;
+}
+
+static uint64_t run_close(worker_t *w) {
+    int f = open_file(w->file, 0);
+    uint64_t start = now_ns();
+    int closed = tfs_close(f);
+    uint64_t end = now_ns();
+    assert(closed != -1);
+    return end - start;
+}
+
+static uint64_t run_create(worker_t *w) {
+    uint64_t start = now_ns();
+    int f = tfs_open(w->scratch, TFS_O_CREAT);
+    uint64_t end = now_ns();
+    assert(f != -1 && tfs_close(f) != -1);
+    assert(tfs_unlink(w->scratch) != -1);
+    return end - start;
+}
+
+static uint64_t run_unlink(worker_t *w) {
+    assert(tfs_close(open_file(w->scratch, TFS_O_CREAT)) != -1);
+    uint64_t start = now_ns();
+    int unlinked = tfs_unlink(w->scratch);
+    uint64_t end = now_ns();
+    assert(unlinked != -1);
+    return end - start;
+}
+
+static void open_handle(worker_t *w) {
+    w->fhandle = open_file(w->file, 0);
+    w->offset = 0;
+}
+
+static void truncate_handle(worker_t *w) {
+    w->fhandle = open_file(w->file, TFS_O_TRUNC);
+    w->offset = 0;
+}
+
+static void close_handle(worker_t *w) { assert(tfs_close(w->fhandle) != -1); }
+
+static uint64_t run_read_small(worker_t *w) {
+    if (w->offset + SMALL_IO > block_size) {
+        // at the end of the file: start over
+        close_handle(w);
+        open_handle(w);
+    }
+    uint64_t start = now_ns();
+    ssize_t r = tfs_read(w->fhandle, w->buffer, SMALL_IO);
+    uint64_t end = now_ns();
+    assert(r == SMALL_IO);
+    w->offset += SMALL_IO;
+    return end - start;
+}
+
+static uint64_t run_read_large(worker_t *w) {
+    int f = open_file(w->file, 0);
+    uint64_t start = now_ns();
+    ssize_t r = tfs_read(f, w->buffer, block_size);
+    uint64_t end = now_ns();
+    assert(r == (ssize_t)block_size && tfs_close(f) != -1);
+    return end - start;
+}
+
+static uint64_t run_write_small(worker_t *w) {
+    if (w->offset + SMALL_IO > block_size) {
+        // the file is full: start over
+        close_handle(w);
+        truncate_handle(w);
+    }
+    uint64_t start = now_ns();
+    ssize_t r = tfs_write(w->fhandle, w->buffer, SMALL_IO);
+    uint64_t end = now_ns();
+    assert(r == SMALL_IO);
+    w->offset += SMALL_IO;
+    return end - start;
+}
+
+static uint64_t run_write_large(worker_t *w) {
+    int f = open_file(w->file, TFS_O_TRUNC);
+    uint64_t start = now_ns();
+    ssize_t r = tfs_write(f, w->buffer, block_size);
+    uint64_t end = now_ns();
+    assert(r == (ssize_t)block_size && tfs_close(f) != -1);
+    return end - start;
+}
+
+static uint64_t run_link(worker_t *w) {
+    uint64_t start = now_ns();
+    int linked = tfs_link(w->file, w->scratch);
+    uint64_t end = now_ns();
+    assert(linked != -1 && tfs_unlink(w->scratch) != -1);
+    return end - start;
+}
+
+static uint64_t run_symlink(worker_t *w) {
+    uint64_t start = now_ns();
+    int linked = tfs_sym_link(w->file, w->scratch);
+    uint64_t end = now_ns();
+    assert(linked != -1 && tfs_unlink(w->scratch) != -1);
+    return end - start;
+}
+
+static uint64_t run_import(worker_t *w) {
+    uint64_t start = now_ns();
+    int copied = tfs_copy_from_external_fs(import_path, w->scratch);
+    uint64_t end = now_ns();
+    assert(copied != -1);
+    return end - start;
+}
+
+static op_t const ops[] = {
+    {"open", NULL, run_open, NULL},
+    {"close", NULL, run_close, NULL},
+    {"create", NULL, run_create, NULL},
+    {"unlink", NULL, run_unlink, NULL},
+    {"read_small", open_handle, run_read_small, close_handle},
+    {"read_large", NULL, run_read_large, NULL},
+    {"write_small", truncate_handle, run_write_small, close_handle},
+    {"write_large", NULL, run_write_large, NULL},
+    {"link", NULL, run_link, NULL},
+    {"symlink", NULL, run_symlink, NULL},
+    {"import", NULL, run_import, NULL},
+};
+#define N_OPS (sizeof(ops) / sizeof(ops[0]))
+
+typedef struct {
+    op_t const *op;
+    worker_t *worker;
+} task_t;
+
+static void *worker_fn(void *arg) {
+    task_t const *task = arg;
+    worker_t *w = task->worker;
+
+    // every thread's file starts a block long
+    int f = open_file(w->file, TFS_O_CREAT | TFS_O_TRUNC);
+    assert(tfs_write(f, w->buffer, block_size) == (ssize_t)block_size);
+    assert(tfs_close(f) != -1);
+    if (task->op->setup != NULL) {
+        task->op->setup(w);
+    }
+
+    pthread_barrier_wait(&barrier);
+    w->start = now_ns();
+    for (int i = 0; i < w->ops; i++) {
+        w->latencies[i] = task->op->run(w);
+    }
+    w->end = now_ns();
+
+    if (task->op->teardown != NULL) {
+        task->op->teardown(w);
+    }
+    return NULL;
+}
+
+static int cmp_u64(void const *a, void const *b) {
+    uint64_t x = *(uint64_t const *)a;
+    uint64_t y = *(uint64_t const *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values
+static uint64_t percentile(uint64_t const *sorted, size_t n, double p) {
+    size_t rank = (size_t)(p * (double)n + 0.999999);
+    return sorted[rank == 0 ? 0 : (rank > n ? n : rank) - 1];
+}
+
+/**
+ * Run an operation with a number of threads, and print its results.
+ */
+static void run_op(op_t const *op, int n_threads, int n_ops,
+                   tfs_params const *params, bool first) {
+    pthread_t *tid = malloc((size_t)n_threads * sizeof(pthread_t));
+    worker_t *workers = malloc((size_t)n_threads * sizeof(worker_t));
+    task_t *tasks = malloc((size_t)n_threads * sizeof(task_t));
+    size_t total = (size_t)n_threads * (size_t)n_ops;
+    uint64_t *latencies = malloc(total * sizeof(uint64_t));
+    assert(tid && workers && tasks && latencies);
+
+    assert(tfs_init(params) != -1);
+    for (int i = 0; i < n_threads; i++) {
+        worker_t *w = &workers[i];
+        *w = (worker_t){.id = i, .ops = n_ops};
+        w->latencies = &latencies[(size_t)i * (size_t)n_ops];
+        snprintf(w->file, sizeof(w->file), "/f%d", i);
+        snprintf(w->scratch, sizeof(w->scratch), "/s%d", i);
+        w->buffer = calloc(1, block_size);
+        assert(w->buffer != NULL);
+        tasks[i] = (task_t){.op = op, .worker = w};
+    }
+
+    assert(pthread_barrier_init(&barrier, NULL, (unsigned)n_threads + 1) ==
+           0);
+    for (int i = 0; i < n_threads; i++) {
+        assert(pthread_create(&tid[i], NULL, worker_fn, &tasks[i]) == 0);
+    }
+    pthread_barrier_wait(&barrier);
+    uint64_t start = UINT64_MAX;
+    uint64_t end = 0;
+    for (int i = 0; i < n_threads; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+        free(workers[i].buffer);
+        start = workers[i].start < start ? workers[i].start : start;
+        end = workers[i].end > end ? workers[i].end : end;
+    }
+    uint64_t elapsed = end - start;
+    assert(pthread_barrier_destroy(&barrier) == 0);
+    assert(tfs_destroy() != -1);
+
+    qsort(latencies, total, sizeof(uint64_t), cmp_u64);
+    printf("%s    {\"op\": \"%s\", \"threads\": %d, \"ops\": %zu, "
+           "\"ops_per_sec\": %.0f, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+           "\"p999_ns\": %llu}",
+           first ? "" : ",\n", op->name, n_threads, total,
+           (double)total * 1e9 / (double)(elapsed == 0 ? 1 : elapsed),
+           (unsigned long long)percentile(latencies, total, 0.5),
+           (unsigned long long)percentile(latencies, total, 0.99),
+           (unsigned long long)percentile(latencies, total, 0.999));
+    fflush(stdout);
+
+    free(latencies);
+    free(tasks);
+    free(workers);
+    free(tid);
+}
+
+static char const *const latency_modes[] = {
+    [TFS_LATENCY_LOOP] = "loop",
+    [TFS_LATENCY_NONE] = "none",
+    [TFS_LATENCY_SPIN] = "spin",
+    [TFS_LATENCY_SLEEP] = "sleep",
+};
+
+static int parse_latency_mode(char const *name, tfs_latency_mode_t *mode) {
+    for (size_t m = 0; m < sizeof(latency_modes) / sizeof(*latency_modes);
+         m++) {
+        if (strcmp(name, latency_modes[m]) == 0) {
+            *mode = (tfs_latency_mode_t)m;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Whether an operation is in a comma separated list (NULL for all of them)
+static bool selected(char const *list, char const *name) {
+    if (list == NULL) {
+        return true;
+    }
+    size_t len = strlen(name);
+    for (char const *p = list; p != NULL; p = strchr(p, ',')) {
+        p += *p == ',';
+        if (strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Threads of the runs: 1, 2, 4, ... up to max, and max itself
+static int next_thread_count(int n, int max) {
+    return n < max && 2 * n > max ? max : 2 * n;
+}
+
+static void usage(char const *program) {
+    fprintf(stderr,
+            "usage: %s [-t threads] [-n ops] [-o op,...] [-B block_size] "
+            "[-C block_cache] [-I inode_cache] [-L none|loop|spin|sleep] "
+            "[-M metadata_ns] [-D data_ns] [-V version]\n",
+            program);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int max_threads = 8;
+    int n_ops = 1000;
+    char const *op_list = NULL;
+    char const *version = "";
+    tfs_params params = tfs_default_params();
+    params.block_size = 16 * 1024;
+    params.latency.mode = TFS_LATENCY_NONE;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:o:B:C:I:L:M:D:V:")) != -1) {
+        switch (opt) {
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'n':
+            n_ops = atoi(optarg);
+            break;
+        case 'o':
+            op_list = optarg;
+            break;
+        case 'B':
+            params.block_size = strtoul(optarg, NULL, 10);
+            break;
+        case 'C':
+            params.block_cache_size = strtoul(optarg, NULL, 10);
+            break;
+        case 'I':
+            params.inode_cache_size = strtoul(optarg, NULL, 10);
+            break;
+        case 'L':
+            if (parse_latency_mode(optarg, &params.latency.mode) == -1) {
+                usage(argv[0]);
+            }
+            break;
+        case 'M':
+            params.latency.metadata_ns = strtoul(optarg, NULL, 10);
+            break;
+        case 'D':
+            params.latency.data_ns = strtoul(optarg, NULL, 10);
+            break;
+        case 'V':
+            version = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (max_threads < 1 || n_ops < 1 || params.block_size < SMALL_IO) {
+        usage(argv[0]);
+    }
+    block_size = params.block_size;
+
+    // each thread has a file and a scratch name open at most, and the
+    // blocks of both, plus those freed but not reclaimed yet
+    size_t threads = (size_t)max_threads;
+    params.max_inode_count = 2 * threads + 2;
+    params.max_open_files_count = 2 * threads;
+    params.max_block_count = 4 * threads + 64;
+
+    // the host file imported: a block long
+    int fd = mkstemp(import_path);
+    assert(fd != -1);
+    char *contents = calloc(1, block_size);
+    assert(contents != NULL);
+    assert(write(fd, contents, block_size) == (ssize_t)block_size);
+    assert(close(fd) == 0);
+    free(contents);
+
+    printf("{\n  \"version\": \"%s\",\n", version);
+    printf("  \"params\": {\"block_size\": %zu, \"block_cache_size\": %zu, "
+           "\"inode_cache_size\": %zu, \"latency_mode\": \"%s\", "
+           "\"metadata_ns\": %zu, \"data_ns\": %zu, \"ops_per_thread\": %d},\n",
+           params.block_size, params.block_cache_size,
+           params.inode_cache_size, latency_modes[params.latency.mode],
+           params.latency.metadata_ns, params.latency.data_ns, n_ops);
+    printf("  \"results\": [\n");
+    bool first = true;
+    for (size_t o = 0; o < N_OPS; o++) {
+        if (!selected(op_list, ops[o].name)) {
+            continue;
+        }
+        for (int n = 1; n <= max_threads;
+             n = next_thread_count(n, max_threads)) {
+            run_op(&ops[o], n, n_ops, &params, first);
+            first = false;
+        }
+    }
+    printf("\n  ]\n}\n");
+
+    unlink(import_path);
+    return 0;
+}
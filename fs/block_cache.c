@@ -0,0 +1,673 @@
+#include "block_cache.h"
+#include "betterassert.h"
+#include "instance.h"
+#include "latency.h"
+#include "lock_stats.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Block buffer cache.
+ *
+ * Tracks which data blocks are resident in (simulated) memory, so that
+ * accesses to them skip the simulated storage latency. The contents
+ * themselves always live in fs_data; only residency and dirtiness are kept
+ * here.
+ *
+ * The cache is set-associative: a block can only be held by the entries of
+ * the bucket it hashes to. Each bucket has its own lock and replaces its
+ * entries with the CLOCK (second chance) policy.
+ *
+ * Writes only dirty the cached block. A background flusher writes dirty
+ * blocks back once they are old enough, or once too many blocks are dirty,
+ * in batches sorted by block number where runs of consecutive blocks are
+ * written as a single transfer.
+ */
+
+#define CACHE_WAYS (8)
+
+// The flusher wakes up periodically, and writes back blocks dirty for longer
+// than DIRTY_EXPIRE_MS; it writes back every dirty block once more than
+// DIRTY_RATIO percent of the cache is dirty.
+#define FLUSH_INTERVAL_MS (5)
+#define DIRTY_EXPIRE_MS (20)
+#define DIRTY_RATIO (50)
+
+typedef struct {
+    int block_number; // -1 if the entry is unused
+    bool referenced;
+    bool dirty;
+    uint64_t dirtied_ns; // when the block was first dirtied
+    unsigned dirty_seq;  // renewed on every write, to detect re-dirtying
+    size_t valid;        // bytes of the block cached, from its start
+    size_t fetching;     // bytes cached once reads in flight complete
+} cache_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t fetched; // signaled when reads from storage complete
+    cache_entry_t entries[CACHE_WAYS];
+    size_t hand;
+    unsigned next_seq;
+
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t writebacks;
+    size_t flushed;
+    size_t prefetched;
+} cache_bucket_t;
+
+typedef struct {
+    int block_number;
+    unsigned dirty_seq;
+} flush_ref_t;
+
+struct block_cache {
+    cache_bucket_t* buckets;
+    size_t n_buckets;
+    size_t block_size;
+
+    // Lock order: a bucket's lock before dirty_lock; flush_lock before both.
+    size_t n_dirty;
+    bool flusher_stopping;
+    pthread_mutex_t dirty_lock;
+    pthread_cond_t dirty_cond;
+    pthread_t flusher;
+
+    // serializes write-back batches, which share the flush_refs scratch array
+    pthread_mutex_t flush_lock;
+    flush_ref_t* flush_refs;
+};
+typedef struct block_cache block_cache_t;
+
+// The block cache of the calling thread's instance
+static block_cache_t* cache_state(void) {
+    return instance_current()->block_cache;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static size_t capacity(void) {
+    block_cache_t* cache = cache_state();
+    return cache->n_buckets * CACHE_WAYS;
+}
+
+/**
+ * Account for a block becoming dirty (or clean, if delta is -1), waking up
+ * the flusher if too many blocks are dirty.
+ */
+static void count_dirty(int delta) {
+    block_cache_t* cache = cache_state();
+    pthread_mutex_lock(&cache->dirty_lock);
+    if (delta > 0) {
+        cache->n_dirty++;
+        if (cache->n_dirty * 100 > DIRTY_RATIO * capacity()) {
+            pthread_cond_signal(&cache->dirty_cond);
+        }
+    } else {
+        cache->n_dirty--;
+    }
+    pthread_mutex_unlock(&cache->dirty_lock);
+}
+
+static int flush_ref_cmp(void const* a, void const* b) {
+    flush_ref_t const* ra = a;
+    flush_ref_t const* rb = b;
+    return (ra->block_number > rb->block_number) -
+           (ra->block_number < rb->block_number);
+}
+
+static void flush_dirty(uint64_t dirtied_before_ns);
+
+/**
+ * Background flusher: writes dirty blocks back, as they age or pile up.
+ */
+static void* flusher_fn(void* arg) {
+    instance_bind(arg);
+    block_cache_t* cache = cache_state();
+
+    pthread_mutex_lock(&cache->dirty_lock);
+    while (!cache->flusher_stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += FLUSH_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&cache->dirty_cond, &cache->dirty_lock,
+                               &deadline);
+        if (cache->flusher_stopping || cache->n_dirty == 0) {
+            continue;
+        }
+
+        bool over_ratio = cache->n_dirty * 100 > DIRTY_RATIO * capacity();
+        pthread_mutex_unlock(&cache->dirty_lock);
+
+        uint64_t expire_ns = (uint64_t)DIRTY_EXPIRE_MS * 1000000ULL;
+        uint64_t now = now_ns();
+        flush_dirty(over_ratio ? UINT64_MAX
+                               : (now > expire_ns ? now - expire_ns : 0));
+
+        pthread_mutex_lock(&cache->dirty_lock);
+    }
+    pthread_mutex_unlock(&cache->dirty_lock);
+
+    return NULL;
+}
+
+/**
+ * Initialize the block cache, and start its flusher.
+ *
+ * Input:
+ *   - n_entries: number of blocks the cache holds (0 disables it); rounded up
+ *     to a multiple of the bucket size
+ *   - size: size of a block, in bytes
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int block_cache_init(size_t n_entries, size_t size) {
+    block_cache_t* cache = malloc(sizeof(block_cache_t));
+    if (cache == NULL) {
+        return -1;
+    }
+    instance_current()->block_cache = cache;
+
+    cache->n_buckets = (n_entries + CACHE_WAYS - 1) / CACHE_WAYS;
+    cache->block_size = size;
+    cache->buckets = NULL;
+    cache->flush_refs = NULL;
+    if (cache->n_buckets == 0) {
+        return 0;
+    }
+
+    cache_bucket_t* buckets = malloc(cache->n_buckets * sizeof(cache_bucket_t));
+    cache->flush_refs =
+        malloc(cache->n_buckets * CACHE_WAYS * sizeof(flush_ref_t));
+    if (buckets == NULL || cache->flush_refs == NULL) {
+        free(buckets);
+        free(cache->flush_refs);
+        cache->flush_refs = NULL;
+        cache->n_buckets = 0;
+        return -1;
+    }
+    cache->buckets = buckets;
+
+    for (size_t b = 0; b < cache->n_buckets; b++) {
+        ALWAYS_ASSERT(pthread_mutex_init(&buckets[b].lock, NULL) == 0,
+                      "block_cache_init: error initializing a bucket lock");
+        ALWAYS_ASSERT(pthread_cond_init(&buckets[b].fetched, NULL) == 0,
+                      "block_cache_init: error initializing a bucket condvar");
+        for (size_t w = 0; w < CACHE_WAYS; w++) {
+            buckets[b].entries[w].block_number = -1;
+            buckets[b].entries[w].referenced = false;
+            buckets[b].entries[w].dirty = false;
+            buckets[b].entries[w].dirtied_ns = 0;
+            buckets[b].entries[w].dirty_seq = 0;
+            buckets[b].entries[w].valid = 0;
+            buckets[b].entries[w].fetching = 0;
+        }
+        buckets[b].hand = 0;
+        buckets[b].next_seq = 0;
+        buckets[b].hits = 0;
+        buckets[b].misses = 0;
+        buckets[b].evictions = 0;
+        buckets[b].writebacks = 0;
+        buckets[b].flushed = 0;
+        buckets[b].prefetched = 0;
+    }
+
+    cache->n_dirty = 0;
+    cache->flusher_stopping = false;
+    ALWAYS_ASSERT(pthread_mutex_init(&cache->dirty_lock, NULL) == 0,
+                  "block_cache_init: error initializing the dirty lock");
+    ALWAYS_ASSERT(pthread_cond_init(&cache->dirty_cond, NULL) == 0,
+                  "block_cache_init: error initializing the dirty condvar");
+    ALWAYS_ASSERT(pthread_mutex_init(&cache->flush_lock, NULL) == 0,
+                  "block_cache_init: error initializing the flush lock");
+    // the flusher works on the instance being initialized
+    ALWAYS_ASSERT(pthread_create(&cache->flusher, NULL, flusher_fn,
+                                 instance_current()) == 0,
+                  "block_cache_init: error creating the flusher thread");
+    return 0;
+}
+
+/**
+ * Destroy the block cache (dirty blocks are discarded).
+ */
+void block_cache_destroy(void) {
+    block_cache_t* cache = cache_state();
+    if (cache->n_buckets > 0) {
+        pthread_mutex_lock(&cache->dirty_lock);
+        cache->flusher_stopping = true;
+        pthread_cond_signal(&cache->dirty_cond);
+        pthread_mutex_unlock(&cache->dirty_lock);
+        pthread_join(cache->flusher, NULL);
+
+        ALWAYS_ASSERT(pthread_mutex_destroy(&cache->flush_lock) == 0,
+                      "block_cache_destroy: error destroying the flush lock");
+        ALWAYS_ASSERT(
+            pthread_cond_destroy(&cache->dirty_cond) == 0,
+            "block_cache_destroy: error destroying the dirty condvar");
+        ALWAYS_ASSERT(pthread_mutex_destroy(&cache->dirty_lock) == 0,
+                      "block_cache_destroy: error destroying the dirty lock");
+    }
+
+    for (size_t b = 0; b < cache->n_buckets; b++) {
+        ALWAYS_ASSERT(pthread_mutex_destroy(&cache->buckets[b].lock) == 0,
+                      "block_cache_destroy: error destroying a bucket lock");
+        ALWAYS_ASSERT(
+            pthread_cond_destroy(&cache->buckets[b].fetched) == 0,
+            "block_cache_destroy: error destroying a bucket condvar");
+    }
+    free(cache->buckets);
+    free(cache->flush_refs);
+    free(cache);
+    instance_current()->block_cache = NULL;
+}
+
+static cache_bucket_t* bucket_of(int block_number) {
+    block_cache_t* cache = cache_state();
+    return &cache->buckets[(size_t)block_number % cache->n_buckets];
+}
+
+/**
+ * Find the entry holding a block in a bucket.
+ *
+ * The caller must hold the bucket's lock.
+ */
+static cache_entry_t* bucket_find(cache_bucket_t* bucket, int block_number) {
+    for (size_t w = 0; w < CACHE_WAYS; w++) {
+        if (bucket->entries[w].block_number == block_number) {
+            return &bucket->entries[w];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Take over an entry of a bucket for a block, evicting the block it held
+ * with the CLOCK policy.
+ *
+ * The caller must hold the bucket's lock.
+ *
+ * Input:
+ *   - bucket: the block's bucket
+ *   - block_number: the block number/index
+ *   - writeback: set to whether a dirty block was evicted (and must thus be
+ *     written back to storage)
+ *
+ * Returns the entry, holding none of the block's contents yet.
+ */
+static cache_entry_t* bucket_take(cache_bucket_t* bucket, int block_number,
+                                  bool* writeback) {
+    // CLOCK: skip (and clear) recently referenced entries
+    cache_entry_t* entry;
+    while (true) {
+        entry = &bucket->entries[bucket->hand];
+        bucket->hand = (bucket->hand + 1) % CACHE_WAYS;
+        if (entry->block_number == -1 || !entry->referenced) {
+            break;
+        }
+        entry->referenced = false;
+    }
+
+    if (entry->block_number != -1) {
+        bucket->evictions++;
+        if (entry->dirty) {
+            bucket->writebacks++;
+            *writeback = true;
+        }
+    }
+
+    entry->block_number = block_number;
+    entry->referenced = true;
+    entry->dirty = false;
+    entry->valid = 0;
+    entry->fetching = 0;
+    return entry;
+}
+
+/**
+ * Pay for writing an evicted dirty block back to storage.
+ */
+static void evicted_writeback(void) {
+    block_cache_t* cache = cache_state();
+    count_dirty(-1);
+    // simulate writing the evicted block back to storage
+    latency_wait(DEV_DATA, cache->block_size);
+}
+
+/**
+ * Make the first bytes of a block resident, reading what is missing from
+ * storage.
+ *
+ * Input:
+ *   - block_number: the block number/index
+ *   - end: number of bytes needed, from the start of the block
+ *   - prefetch: whether this is a readahead (which is counted apart, and
+ *     does not wait for reads already in flight)
+ */
+static void cache_fetch(int block_number, size_t end, bool prefetch) {
+    cache_bucket_t* bucket = bucket_of(block_number);
+    bool writeback = false;
+
+    profiled_mutex_lock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+    cache_entry_t* entry;
+    while (true) {
+        entry = bucket_find(bucket, block_number);
+        if (entry == NULL) {
+            entry = bucket_take(bucket, block_number, &writeback);
+        }
+        entry->referenced = true;
+
+        if (entry->valid >= end || (prefetch && entry->fetching >= end)) {
+            if (!prefetch) {
+                bucket->hits++;
+            }
+            profiled_mutex_unlock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+            if (writeback) {
+                evicted_writeback();
+            }
+            return;
+        }
+        if (entry->fetching < end) {
+            break;
+        }
+        // the bytes are on their way (e.g., being read ahead)
+        lock_stats_released(TFS_LOCK_BLOCK_CACHE, &bucket->lock);
+        pthread_cond_wait(&bucket->fetched, &bucket->lock);
+        lock_stats_acquired(TFS_LOCK_BLOCK_CACHE, &bucket->lock, false,
+                            lock_stats_clock());
+    }
+
+    size_t need = end - entry->valid;
+    entry->fetching = end;
+    if (prefetch) {
+        bucket->prefetched += need;
+    } else {
+        bucket->misses++;
+    }
+    profiled_mutex_unlock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+
+    if (writeback) {
+        evicted_writeback();
+    }
+    latency_wait(DEV_DATA, need); // simulate storage access delay to block
+
+    profiled_mutex_lock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+    entry = bucket_find(bucket, block_number);
+    if (entry != NULL && entry->valid < end) {
+        entry->valid = end;
+    }
+    pthread_cond_broadcast(&bucket->fetched);
+    profiled_mutex_unlock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+}
+
+/**
+ * Access the first bytes of a block, reading them from storage unless they
+ * are cached.
+ *
+ * Blocks are read in order, so a block is cached up to the furthest byte
+ * accessed so far.
+ *
+ * Input:
+ *   - block_number: the block number/index
+ *   - end: number of bytes accessed, from the start of the block
+ */
+void block_cache_get(int block_number, size_t end) {
+    block_cache_t* cache = cache_state();
+    if (cache->n_buckets == 0) {
+        latency_wait(DEV_DATA, end); // simulate storage access delay to block
+        return;
+    }
+    cache_fetch(block_number, end, false);
+}
+
+/**
+ * Start reading the first bytes of a block into the cache, ahead of their
+ * use.
+ *
+ * Input:
+ *   - block_number: the block number/index
+ *   - end: number of bytes to read ahead, from the start of the block
+ */
+void block_cache_prefetch(int block_number, size_t end) {
+    block_cache_t* cache = cache_state();
+    if (cache->n_buckets == 0) {
+        return;
+    }
+    cache_fetch(block_number, end, true);
+}
+
+/**
+ * Load a newly allocated block into the cache, without reading it from
+ * storage (its previous contents are irrelevant).
+ *
+ * Input:
+ *   - block_number: the block number/index
+ */
+void block_cache_insert(int block_number) {
+    block_cache_t* cache = cache_state();
+    if (cache->n_buckets == 0) {
+        return;
+    }
+
+    cache_bucket_t* bucket = bucket_of(block_number);
+    bool writeback = false;
+
+    profiled_mutex_lock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+    cache_entry_t* entry = bucket_find(bucket, block_number);
+    if (entry == NULL) {
+        entry = bucket_take(bucket, block_number, &writeback);
+    }
+    entry->referenced = true;
+    entry->valid = cache->block_size;
+    entry->fetching = cache->block_size;
+    pthread_cond_broadcast(&bucket->fetched);
+    profiled_mutex_unlock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+
+    if (writeback) {
+        evicted_writeback();
+    }
+}
+
+/**
+ * Mark a cached block as modified, so that it is written back on eviction.
+ *
+ * Input:
+ *   - block_number: the block number/index
+ */
+void block_cache_mark_dirty(int block_number) {
+    block_cache_t* cache = cache_state();
+    if (cache->n_buckets == 0) {
+        return;
+    }
+
+    cache_bucket_t* bucket = bucket_of(block_number);
+    profiled_mutex_lock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+    cache_entry_t* entry = bucket_find(bucket, block_number);
+    bool newly_dirty = entry != NULL && !entry->dirty;
+    if (entry != NULL) {
+        if (newly_dirty) {
+            entry->dirty = true;
+            entry->dirtied_ns = now_ns();
+        }
+        entry->dirty_seq = ++bucket->next_seq;
+    }
+    profiled_mutex_unlock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+
+    if (newly_dirty) {
+        count_dirty(1);
+    }
+}
+
+/**
+ * Drop a block from the cache without writing it back (e.g., when freed).
+ *
+ * Input:
+ *   - block_number: the block number/index
+ */
+void block_cache_invalidate(int block_number) {
+    block_cache_t* cache = cache_state();
+    if (cache->n_buckets == 0) {
+        return;
+    }
+
+    cache_bucket_t* bucket = bucket_of(block_number);
+    profiled_mutex_lock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+    cache_entry_t* entry = bucket_find(bucket, block_number);
+    bool was_dirty = entry != NULL && entry->dirty;
+    if (entry != NULL) {
+        entry->block_number = -1;
+        entry->referenced = false;
+        entry->dirty = false;
+    }
+    profiled_mutex_unlock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+
+    if (was_dirty) {
+        count_dirty(-1);
+    }
+}
+
+/**
+ * Mark the collected blocks clean, unless written to since collected.
+ */
+static void mark_flushed(flush_ref_t const* refs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        cache_bucket_t* bucket = bucket_of(refs[i].block_number);
+        profiled_mutex_lock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+        cache_entry_t* entry = bucket_find(bucket, refs[i].block_number);
+        bool cleaned = entry != NULL && entry->dirty &&
+                       entry->dirty_seq == refs[i].dirty_seq;
+        if (cleaned) {
+            entry->dirty = false;
+            bucket->flushed++;
+        }
+        profiled_mutex_unlock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+
+        if (cleaned) {
+            count_dirty(-1);
+        }
+    }
+}
+
+/**
+ * Write back the blocks dirtied before a given time, in block order, with
+ * each run of consecutive blocks written as a single transfer.
+ *
+ * Input:
+ *   - dirtied_before_ns: only blocks first dirtied up to this time (on the
+ *     CLOCK_MONOTONIC clock) are written back
+ */
+static void flush_dirty(uint64_t dirtied_before_ns) {
+    block_cache_t* cache = cache_state();
+    pthread_mutex_lock(&cache->flush_lock);
+
+    size_t count = 0;
+    for (size_t b = 0; b < cache->n_buckets; b++) {
+        profiled_mutex_lock(&cache->buckets[b].lock, TFS_LOCK_BLOCK_CACHE);
+        for (size_t w = 0; w < CACHE_WAYS; w++) {
+            cache_entry_t* entry = &cache->buckets[b].entries[w];
+            if (entry->dirty && entry->dirtied_ns <= dirtied_before_ns) {
+                cache->flush_refs[count].block_number = entry->block_number;
+                cache->flush_refs[count].dirty_seq = entry->dirty_seq;
+                count++;
+            }
+        }
+        profiled_mutex_unlock(&cache->buckets[b].lock, TFS_LOCK_BLOCK_CACHE);
+    }
+    flush_ref_t* refs = cache->flush_refs;
+    qsort(refs, count, sizeof(flush_ref_t), flush_ref_cmp);
+
+    for (size_t i = 0; i < count;) {
+        size_t run = 1;
+        while (i + run < count && refs[i + run].block_number ==
+                                      refs[i].block_number + (int)run) {
+            run++;
+        }
+        // simulate writing the run of blocks back to storage
+        latency_wait(DEV_DATA, run * cache->block_size);
+        i += run;
+    }
+
+    mark_flushed(refs, count);
+    pthread_mutex_unlock(&cache->flush_lock);
+}
+
+/**
+ * Write a block back to storage, if it is dirty.
+ *
+ * Input:
+ *   - block_number: the block number/index
+ */
+void block_cache_flush(int block_number) {
+    block_cache_t* cache = cache_state();
+    if (cache->n_buckets == 0) {
+        return;
+    }
+
+    cache_bucket_t* bucket = bucket_of(block_number);
+    profiled_mutex_lock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+    cache_entry_t* entry = bucket_find(bucket, block_number);
+    bool dirty = entry != NULL && entry->dirty;
+    flush_ref_t ref = {.block_number = block_number,
+                       .dirty_seq = dirty ? entry->dirty_seq : 0};
+    profiled_mutex_unlock(&bucket->lock, TFS_LOCK_BLOCK_CACHE);
+
+    if (dirty) {
+        // simulate writing the block back to storage
+        latency_wait(DEV_DATA, cache->block_size);
+        mark_flushed(&ref, 1);
+    }
+}
+
+/**
+ * Write every dirty block back to storage.
+ */
+void block_cache_sync(void) {
+    block_cache_t* cache = cache_state();
+    if (cache->n_buckets == 0) {
+        return;
+    }
+    flush_dirty(UINT64_MAX);
+}
+
+/**
+ * Collect the cache's counters.
+ *
+ * Input:
+ *   - stats: destination
+ */
+void block_cache_stats(tfs_cache_stats_t* stats) {
+    block_cache_t* cache = cache_state();
+    stats->hits = 0;
+    stats->misses = 0;
+    stats->evictions = 0;
+    stats->writebacks = 0;
+    stats->flushed = 0;
+    stats->prefetched = 0;
+
+    for (size_t b = 0; b < cache->n_buckets; b++) {
+        profiled_mutex_lock(&cache->buckets[b].lock, TFS_LOCK_BLOCK_CACHE);
+        stats->hits += cache->buckets[b].hits;
+        stats->misses += cache->buckets[b].misses;
+        stats->evictions += cache->buckets[b].evictions;
+        stats->writebacks += cache->buckets[b].writebacks;
+        stats->flushed += cache->buckets[b].flushed;
+        stats->prefetched += cache->buckets[b].prefetched;
+        profiled_mutex_unlock(&cache->buckets[b].lock, TFS_LOCK_BLOCK_CACHE);
+    }
+
+    size_t accesses = stats->hits + stats->misses;
+    stats->hit_ratio =
+        accesses > 0 ? (double)stats->hits / (double)accesses : 0.0;
+}
@@ -0,0 +1,21 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include "operations.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+int block_cache_init(size_t n_entries, size_t size);
+void block_cache_destroy(void);
+
+void block_cache_get(int block_number, size_t end);
+void block_cache_prefetch(int block_number, size_t end);
+void block_cache_insert(int block_number);
+void block_cache_mark_dirty(int block_number);
+void block_cache_invalidate(int block_number);
+void block_cache_flush(int block_number);
+void block_cache_sync(void);
+void block_cache_stats(tfs_cache_stats_t* stats);
+
+#endif // BLOCK_CACHE_H
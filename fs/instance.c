@@ -0,0 +1,11 @@
+#include "instance.h"
+
+tfs_instance_t instance_default = {.aio_eventfd = -1};
+_Thread_local tfs_instance_t* instance_bound;
+
+/**
+ * Bind the calling thread to an instance (NULL for the default one).
+ *
+ * Takes a void* so that it can run as the start hook of pool workers.
+ */
+void instance_bind(void* instance) { instance_bound = instance; }
@@ -0,0 +1,40 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "operations.h"
+#include "pool.h"
+
+#include <stddef.h>
+
+/**
+ * A file system instance: the state of each module, and of the operations
+ * layer. Instances share no state, nor locks, so a process may run several
+ * of them side by side (e.g., one per core, or per tenant).
+ *
+ * Each thread works on the instance it is bound to (see tfs_instance_use),
+ * or on the default instance, set up by tfs_init, if it is bound to none.
+ */
+struct tfs_instance {
+    struct fs_state* state;           // state.c
+    struct block_cache* block_cache;  // block_cache.c
+    struct latency_state* latency;    // latency.c
+    struct lock_stats* lock_stats;    // lock_stats.c (NULL if disabled)
+    struct rcu_domain* rcu;           // rcu.c
+
+    // Workers running asynchronous requests, and their completion eventfd
+    pool_t* aio_pool;
+    int aio_eventfd;
+    // Largest readahead window, in bytes
+    size_t readahead_max;
+};
+
+extern tfs_instance_t instance_default;
+extern _Thread_local tfs_instance_t* instance_bound;
+
+static inline tfs_instance_t* instance_current(void) {
+    return instance_bound != NULL ? instance_bound : &instance_default;
+}
+
+void instance_bind(void* instance);
+
+#endif // INSTANCE_H
@@ -0,0 +1,234 @@
+#include "latency.h"
+#include "betterassert.h"
+#include "instance.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Storage latency model.
+ *
+ * Every access to (simulated) persistent FS state waits for the latency of
+ * the device it is stored in. How the wait is carried out, and how long it
+ * takes, is set by tfs_params.latency.
+ */
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;
+    size_t in_flight;       // accesses being served (for the queue depth)
+    uint64_t busy_until_ns; // end of the last transfer (for the bandwidth)
+} device_t;
+
+struct latency_state {
+    tfs_latency_params model;
+    device_t devices[DEV_COUNT];
+};
+typedef struct latency_state latency_state_t;
+
+// The latency model of the calling thread's instance
+static latency_state_t* latency_state(void) {
+    return instance_current()->latency;
+}
+
+/**
+ * Do nothing, while preventing the compiler from performing any optimizations.
+ *
+ * We need to defeat the optimizer for the TFS_LATENCY_LOOP busy loop.
+ * Under optimization, the empty loop would be completely optimized away.
+ * This function tells the compiler that the assembly code being run (which is
+ * none) might potentially change *all memory in the process*.
+ *
+ * This prevents the optimizer from optimizing this code away, because it does
+ * not know what it does and it may have side effects.
+ *
+ * Reference with more information: https://youtu.be/nXaxk27zwlk?t=2775
+ *
+ * Exercise: try removing this function and look at the assembly generated to
+ * compare.
+ */
+static void touch_all_memory(void) { __asm volatile("" : : : "memory"); }
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Draw the latency of one access to a device.
+ */
+static uint64_t sample_latency(latency_state_t const* lat,
+                               latency_device_t device) {
+    uint64_t mean =
+        device == DEV_DATA ? lat->model.data_ns : lat->model.metadata_ns;
+
+    switch (lat->model.distribution) {
+    case TFS_LATENCY_FIXED:
+        return mean;
+    case TFS_LATENCY_UNIFORM: {
+        // xorshift64*, one generator per thread
+        static _Thread_local uint64_t state = 0;
+        if (state == 0) {
+            state = now_ns() | 1;
+        }
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        uint64_t r = state * 2685821657736338717ULL;
+        return mean == 0 ? 0 : r % (2 * mean + 1);
+    }
+    default:
+        PANIC("sample_latency: unknown latency distribution");
+    }
+}
+
+/**
+ * Wait until a given time, as set by the latency mode.
+ */
+static void wait_until(latency_state_t const* lat, uint64_t deadline_ns) {
+    if (lat->model.mode == TFS_LATENCY_SPIN) {
+        while (now_ns() < deadline_ns) {
+            touch_all_memory();
+        }
+        return;
+    }
+
+    struct timespec ts = {
+        .tv_sec = (time_t)(deadline_ns / 1000000000ULL),
+        .tv_nsec = (long)(deadline_ns % 1000000000ULL),
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+           EINTR) {
+    }
+}
+
+/**
+ * Initialize the latency model.
+ *
+ * Input:
+ *   - params: latency model parameters
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - Unknown latency mode or distribution.
+ *   - malloc failure.
+ */
+int latency_init(tfs_latency_params const* params) {
+    switch (params->mode) {
+    case TFS_LATENCY_LOOP:
+    case TFS_LATENCY_NONE:
+    case TFS_LATENCY_SPIN:
+    case TFS_LATENCY_SLEEP:
+        break;
+    default:
+        return -1;
+    }
+    switch (params->distribution) {
+    case TFS_LATENCY_FIXED:
+    case TFS_LATENCY_UNIFORM:
+        break;
+    default:
+        return -1;
+    }
+
+    latency_state_t* lat = malloc(sizeof(latency_state_t));
+    if (lat == NULL) {
+        return -1;
+    }
+    instance_current()->latency = lat;
+
+    lat->model = *params;
+    for (size_t d = 0; d < DEV_COUNT; d++) {
+        ALWAYS_ASSERT(pthread_mutex_init(&lat->devices[d].lock, NULL) == 0,
+                      "latency_init: error initializing a device lock");
+        ALWAYS_ASSERT(pthread_cond_init(&lat->devices[d].slot_free, NULL) == 0,
+                      "latency_init: error initializing a device condvar");
+        lat->devices[d].in_flight = 0;
+        lat->devices[d].busy_until_ns = 0;
+    }
+    return 0;
+}
+
+/**
+ * Destroy the latency model.
+ */
+void latency_destroy(void) {
+    latency_state_t* lat = latency_state();
+    for (size_t d = 0; d < DEV_COUNT; d++) {
+        ALWAYS_ASSERT(pthread_cond_destroy(&lat->devices[d].slot_free) == 0,
+                      "latency_destroy: error destroying a device condvar");
+        ALWAYS_ASSERT(pthread_mutex_destroy(&lat->devices[d].lock) == 0,
+                      "latency_destroy: error destroying a device lock");
+    }
+    free(lat);
+    instance_current()->latency = NULL;
+}
+
+/**
+ * Simulate an access to a storage device.
+ *
+ * Input:
+ *   - device: device accessed
+ *   - bytes: size of the transfer (only limited by the bandwidth on
+ *     DEV_DATA)
+ */
+void latency_wait(latency_device_t device, size_t bytes) {
+    latency_state_t* lat = latency_state();
+    switch (lat->model.mode) {
+    case TFS_LATENCY_NONE:
+        return;
+    case TFS_LATENCY_LOOP:
+        for (int i = 0; i < DELAY; i++) {
+            touch_all_memory();
+        }
+        return;
+    case TFS_LATENCY_SPIN:
+    case TFS_LATENCY_SLEEP:
+        break;
+    default:
+        PANIC("latency_wait: unknown latency mode");
+    }
+
+    device_t* dev = &lat->devices[device];
+    bool limited_depth = lat->model.queue_depth > 0;
+    bool limited_bandwidth =
+        lat->model.bandwidth > 0 && device == DEV_DATA && bytes > 0;
+
+    if (limited_depth) {
+        pthread_mutex_lock(&dev->lock);
+        while (dev->in_flight >= lat->model.queue_depth) {
+            pthread_cond_wait(&dev->slot_free, &dev->lock);
+        }
+        dev->in_flight++;
+        pthread_mutex_unlock(&dev->lock);
+    }
+
+    uint64_t deadline = now_ns() + sample_latency(lat, device);
+    if (limited_bandwidth) {
+        // transfers are served one at a time, after the access latency
+        uint64_t transfer_ns =
+            (uint64_t)bytes * 1000000000ULL / lat->model.bandwidth;
+        pthread_mutex_lock(&dev->lock);
+        if (dev->busy_until_ns > deadline) {
+            deadline = dev->busy_until_ns;
+        }
+        deadline += transfer_ns;
+        dev->busy_until_ns = deadline;
+        pthread_mutex_unlock(&dev->lock);
+    }
+
+    wait_until(lat, deadline);
+
+    if (limited_depth) {
+        pthread_mutex_lock(&dev->lock);
+        dev->in_flight--;
+        pthread_cond_signal(&dev->slot_free);
+        pthread_mutex_unlock(&dev->lock);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "operations.h"
+
+#include <stddef.h>
+
+/**
+ * Simulated storage devices.
+ */
+typedef enum {
+    DEV_METADATA, // inodes, allocation tables and directories
+    DEV_DATA,     // file data blocks
+    DEV_COUNT,
+} latency_device_t;
+
+int latency_init(tfs_latency_params const* params);
+void latency_destroy(void);
+
+void latency_wait(latency_device_t device, size_t bytes);
+
+#endif // LATENCY_H
@@ -0,0 +1,402 @@
+#include "lock_stats.h"
+#include "instance.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Lock contention profiling.
+ *
+ * The file system's locks are taken through the profiled_* wrappers. While
+ * profiling is disabled they only take the lock. Otherwise, they first try
+ * to take it without waiting, to tell contended acquisitions apart, and
+ * time how long the caller waited and, once it releases the lock, how long
+ * it held it. Locks with waits of their own (e.g., byte ranges) report
+ * acquisitions and releases with lock_stats_acquired and
+ * lock_stats_released instead.
+ *
+ * The counters are shared by every thread of the instance, so profiling
+ * adds some contention of its own.
+ */
+
+typedef struct {
+    atomic_size_t acquisitions;
+    atomic_size_t contended;
+    atomic_size_t wait_hist[TFS_LOCK_HIST_BUCKETS];
+    atomic_size_t hold_hist[TFS_LOCK_HIST_BUCKETS];
+} class_stats_t;
+
+struct lock_stats {
+    class_stats_t classes[TFS_LOCK_CLASS_COUNT];
+    size_t inode_count;
+    atomic_size_t* inode_contended; // contended acquisitions, per inode
+};
+typedef struct lock_stats lock_stats_t;
+
+// The lock statistics of the calling thread's instance (NULL if disabled)
+static lock_stats_t* lock_stats(void) {
+    return instance_current()->lock_stats;
+}
+
+/*
+ * Locks held by the calling thread, with the time each was taken, to time
+ * how long they are held. Locks taken while the list is full are counted,
+ * but their hold time is not.
+ */
+#define MAX_HELD (16)
+
+typedef struct {
+    void const* lock;
+    uint64_t since;
+} held_lock_t;
+
+static _Thread_local held_lock_t held[MAX_HELD];
+static _Thread_local size_t n_held;
+
+static char const* const class_names[TFS_LOCK_CLASS_COUNT] = {
+    [TFS_LOCK_OPEN_FILE] = "open_file",
+    [TFS_LOCK_INODE] = "inode",
+    [TFS_LOCK_RANGE] = "range",
+    [TFS_LOCK_DIR_NAMES] = "dir_names",
+    [TFS_LOCK_DIR_BUCKET] = "dir_bucket",
+    [TFS_LOCK_OPEN_FILE_TABLE] = "open_file_table",
+    [TFS_LOCK_ALLOC_TABLE] = "alloc_table",
+    [TFS_LOCK_DEFERRED] = "deferred",
+    [TFS_LOCK_BLOCK_TABLE] = "block_table",
+    [TFS_LOCK_INODE_CACHE] = "inode_cache",
+    [TFS_LOCK_BLOCK_CACHE] = "block_cache",
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Histogram bucket of a time (see TFS_LOCK_HIST_BUCKETS)
+static size_t hist_bucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    size_t bucket = 0;
+    while (us > 0 && bucket < TFS_LOCK_HIST_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+ * Initialize the lock statistics of the calling thread's instance.
+ *
+ * Input:
+ *   - enabled: whether to profile locks at all
+ *   - inode_count: number of inodes (for the per-inode counters)
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - malloc failure.
+ */
+int lock_stats_init(bool enabled, size_t inode_count) {
+    tfs_instance_t* instance = instance_current();
+    instance->lock_stats = NULL;
+    if (!enabled) {
+        return 0;
+    }
+
+    lock_stats_t* stats = calloc(1, sizeof(lock_stats_t));
+    if (stats == NULL) {
+        return -1;
+    }
+    stats->inode_count = inode_count;
+    stats->inode_contended = calloc(inode_count, sizeof(atomic_size_t));
+    if (stats->inode_contended == NULL) {
+        free(stats);
+        return -1;
+    }
+
+    instance->lock_stats = stats;
+    return 0;
+}
+
+void lock_stats_destroy(void) {
+    tfs_instance_t* instance = instance_current();
+    if (instance->lock_stats != NULL) {
+        free(instance->lock_stats->inode_contended);
+        free(instance->lock_stats);
+        instance->lock_stats = NULL;
+    }
+}
+
+/**
+ * Current time, to be passed to lock_stats_acquired, if profiling is
+ * enabled (0 otherwise).
+ */
+uint64_t lock_stats_clock(void) {
+    return lock_stats() != NULL ? now_ns() : 0;
+}
+
+/**
+ * Count the acquisition of a lock.
+ *
+ * Input:
+ *   - lock_class: class of the lock
+ *   - lock: the lock (which identifies it when released)
+ *   - contended: whether the caller had to wait for another holder
+ *   - since: lock_stats_clock when the caller started to acquire it
+ */
+void lock_stats_acquired(tfs_lock_class_t lock_class, void const* lock,
+                         bool contended, uint64_t since) {
+    lock_stats_t* stats = lock_stats();
+    if (stats == NULL) {
+        return;
+    }
+
+    class_stats_t* counters = &stats->classes[lock_class];
+    uint64_t now = now_ns();
+    atomic_fetch_add_explicit(&counters->acquisitions, 1,
+                              memory_order_relaxed);
+    if (contended) {
+        size_t bucket = hist_bucket(now - since);
+        atomic_fetch_add_explicit(&counters->contended, 1,
+                                  memory_order_relaxed);
+        atomic_fetch_add_explicit(&counters->wait_hist[bucket], 1,
+                                  memory_order_relaxed);
+    }
+
+    if (n_held < MAX_HELD) {
+        held[n_held++] = (held_lock_t){.lock = lock, .since = now};
+    }
+}
+
+/**
+ * Count the release of a lock counted by lock_stats_acquired.
+ *
+ * Input:
+ *   - lock_class: class of the lock
+ *   - lock: the lock
+ */
+void lock_stats_released(tfs_lock_class_t lock_class, void const* lock) {
+    lock_stats_t* stats = lock_stats();
+    if (stats == NULL) {
+        return;
+    }
+
+    for (size_t i = n_held; i > 0; i--) {
+        if (held[i - 1].lock == lock) {
+            uint64_t hold = now_ns() - held[i - 1].since;
+            atomic_fetch_add_explicit(
+                &stats->classes[lock_class].hold_hist[hist_bucket(hold)], 1,
+                memory_order_relaxed);
+            held[i - 1] = held[--n_held];
+            return;
+        }
+    }
+}
+
+/**
+ * Count a contended acquisition of the lock of an inode.
+ */
+void lock_stats_inode_contended(int inumber) {
+    lock_stats_t* stats = lock_stats();
+    if (stats == NULL || inumber < 0 ||
+        (size_t)inumber >= stats->inode_count) {
+        return;
+    }
+    atomic_fetch_add_explicit(&stats->inode_contended[inumber], 1,
+                              memory_order_relaxed);
+}
+
+/**
+ * Lock a mutex, counting the acquisition if profiling is enabled.
+ *
+ * Returns whether the caller had to wait for another holder (always false
+ * if profiling is disabled).
+ */
+bool profiled_mutex_lock(pthread_mutex_t* lock, tfs_lock_class_t lock_class) {
+    if (lock_stats() == NULL) {
+        pthread_mutex_lock(lock);
+        return false;
+    }
+
+    uint64_t since = now_ns();
+    bool contended = pthread_mutex_trylock(lock) != 0;
+    if (contended) {
+        pthread_mutex_lock(lock);
+    }
+    lock_stats_acquired(lock_class, lock, contended, since);
+    return contended;
+}
+
+void profiled_mutex_unlock(pthread_mutex_t* lock,
+                           tfs_lock_class_t lock_class) {
+    lock_stats_released(lock_class, lock);
+    pthread_mutex_unlock(lock);
+}
+
+/**
+ * Lock a rwlock for reading, counting the acquisition if profiling is
+ * enabled.
+ *
+ * Returns whether the caller had to wait for a writer (always false if
+ * profiling is disabled).
+ */
+bool profiled_rdlock(pthread_rwlock_t* lock, tfs_lock_class_t lock_class) {
+    if (lock_stats() == NULL) {
+        pthread_rwlock_rdlock(lock);
+        return false;
+    }
+
+    uint64_t since = now_ns();
+    bool contended = pthread_rwlock_tryrdlock(lock) != 0;
+    if (contended) {
+        pthread_rwlock_rdlock(lock);
+    }
+    lock_stats_acquired(lock_class, lock, contended, since);
+    return contended;
+}
+
+/**
+ * Lock a rwlock for writing, counting the acquisition if profiling is
+ * enabled.
+ *
+ * Returns whether the caller had to wait for other holders (always false if
+ * profiling is disabled).
+ */
+bool profiled_wrlock(pthread_rwlock_t* lock, tfs_lock_class_t lock_class) {
+    if (lock_stats() == NULL) {
+        pthread_rwlock_wrlock(lock);
+        return false;
+    }
+
+    uint64_t since = now_ns();
+    bool contended = pthread_rwlock_trywrlock(lock) != 0;
+    if (contended) {
+        pthread_rwlock_wrlock(lock);
+    }
+    lock_stats_acquired(lock_class, lock, contended, since);
+    return contended;
+}
+
+void profiled_rwlock_unlock(pthread_rwlock_t* lock,
+                            tfs_lock_class_t lock_class) {
+    lock_stats_released(lock_class, lock);
+    pthread_rwlock_unlock(lock);
+}
+
+/**
+ * Obtain the lock statistics of the calling thread's instance.
+ *
+ * Input:
+ *   - stats: destination
+ *
+ * Returns 0 if successful, -1 if profiling is disabled.
+ */
+int lock_stats_get(tfs_lock_stats_t* stats) {
+    lock_stats_t const* counters = lock_stats();
+    if (counters == NULL) {
+        return -1;
+    }
+
+    for (size_t c = 0; c < TFS_LOCK_CLASS_COUNT; c++) {
+        class_stats_t const* from = &counters->classes[c];
+        tfs_lock_class_stats_t* to = &stats->classes[c];
+        to->acquisitions = atomic_load(&from->acquisitions);
+        to->contended = atomic_load(&from->contended);
+        for (size_t b = 0; b < TFS_LOCK_HIST_BUCKETS; b++) {
+            to->wait_hist[b] = atomic_load(&from->wait_hist[b]);
+            to->hold_hist[b] = atomic_load(&from->hold_hist[b]);
+        }
+    }
+
+    // insertion into the (short, sorted) list of the most contended inodes
+    size_t n_top = 0;
+    for (size_t i = 0; i < counters->inode_count; i++) {
+        size_t contended = atomic_load(&counters->inode_contended[i]);
+        if (contended == 0) {
+            continue;
+        }
+        size_t pos = n_top < TFS_LOCK_TOP_INODES ? n_top++ : n_top;
+        while (pos > 0 && stats->top_inodes[pos - 1].contended < contended) {
+            if (pos < TFS_LOCK_TOP_INODES) {
+                stats->top_inodes[pos] = stats->top_inodes[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < TFS_LOCK_TOP_INODES) {
+            stats->top_inodes[pos] = (tfs_lock_inode_stats_t){
+                .inumber = (int)i, .contended = contended};
+        }
+    }
+    for (size_t i = n_top; i < TFS_LOCK_TOP_INODES; i++) {
+        stats->top_inodes[i] = (tfs_lock_inode_stats_t){.inumber = -1};
+    }
+    return 0;
+}
+
+// Write a histogram as its non-empty buckets, e.g. "<1us:5 2-4us:1"
+static void dump_hist(FILE* out, size_t const* hist) {
+    bool empty = true;
+    for (size_t b = 0; b < TFS_LOCK_HIST_BUCKETS; b++) {
+        if (hist[b] == 0) {
+            continue;
+        }
+        empty = false;
+        if (b == 0) {
+            fprintf(out, " <1us:%zu", hist[b]);
+        } else if (b == TFS_LOCK_HIST_BUCKETS - 1) {
+            fprintf(out, " >=%zuus:%zu", (size_t)1 << (b - 1), hist[b]);
+        } else {
+            fprintf(out, " %zu-%zuus:%zu", (size_t)1 << (b - 1),
+                    (size_t)1 << b, hist[b]);
+        }
+    }
+    fprintf(out, empty ? " -\n" : "\n");
+}
+
+/**
+ * Write a report of the lock statistics of the calling thread's instance.
+ *
+ * Input:
+ *   - out: stream to write to
+ *
+ * Returns 0 if successful, -1 if profiling is disabled.
+ */
+int lock_stats_dump(FILE* out) {
+    tfs_lock_stats_t stats;
+    if (lock_stats_get(&stats) == -1) {
+        return -1;
+    }
+
+    fprintf(out, "%-16s %12s %12s %9s\n", "lock", "acquisitions",
+            "contended", "contended%");
+    for (size_t c = 0; c < TFS_LOCK_CLASS_COUNT; c++) {
+        tfs_lock_class_stats_t const* lock = &stats.classes[c];
+        double ratio = lock->acquisitions == 0
+                           ? 0.0
+                           : 100.0 * (double)lock->contended /
+                                 (double)lock->acquisitions;
+        fprintf(out, "%-16s %12zu %12zu %9.2f\n", class_names[c],
+                lock->acquisitions, lock->contended, ratio);
+    }
+
+    for (size_t c = 0; c < TFS_LOCK_CLASS_COUNT; c++) {
+        if (stats.classes[c].acquisitions == 0) {
+            continue;
+        }
+        fprintf(out, "%s wait:", class_names[c]);
+        dump_hist(out, stats.classes[c].wait_hist);
+        fprintf(out, "%s hold:", class_names[c]);
+        dump_hist(out, stats.classes[c].hold_hist);
+    }
+
+    fprintf(out, "most contended inodes:");
+    for (size_t i = 0; i < TFS_LOCK_TOP_INODES; i++) {
+        if (stats.top_inodes[i].inumber != -1) {
+            fprintf(out, " %d:%zu", stats.top_inodes[i].inumber,
+                    stats.top_inodes[i].contended);
+        }
+    }
+    fprintf(out, "\n");
+    return 0;
+}
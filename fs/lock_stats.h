@@ -0,0 +1,32 @@
+#ifndef LOCK_STATS_H
+#define LOCK_STATS_H
+
+#include "operations.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+int lock_stats_init(bool enabled, size_t inode_count);
+void lock_stats_destroy(void);
+
+uint64_t lock_stats_clock(void);
+void lock_stats_acquired(tfs_lock_class_t lock_class, void const* lock,
+                         bool contended, uint64_t since);
+void lock_stats_released(tfs_lock_class_t lock_class, void const* lock);
+void lock_stats_inode_contended(int inumber);
+
+bool profiled_mutex_lock(pthread_mutex_t* lock, tfs_lock_class_t lock_class);
+void profiled_mutex_unlock(pthread_mutex_t* lock,
+                           tfs_lock_class_t lock_class);
+bool profiled_rdlock(pthread_rwlock_t* lock, tfs_lock_class_t lock_class);
+bool profiled_wrlock(pthread_rwlock_t* lock, tfs_lock_class_t lock_class);
+void profiled_rwlock_unlock(pthread_rwlock_t* lock,
+                            tfs_lock_class_t lock_class);
+
+int lock_stats_get(tfs_lock_stats_t* stats);
+int lock_stats_dump(FILE* out);
+
+#endif // LOCK_STATS_H
@@ -1,10 +1,23 @@
 #include "operations.h"
+#include "block_cache.h"
 #include "config.h"
+#include "instance.h"
+#include "lock_stats.h"
+#include "pool.h"
 #include "state.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "betterassert.h"
 
@@ -14,10 +27,22 @@ tfs_params tfs_default_params() {
         .max_block_count = 1024,
         .max_open_files_count = 16,
         .block_size = 1024,
+        .aio_worker_count = 4,
+        .block_cache_size = 128,
+        .inode_cache_size = 32,
+        .readahead_max = 256 * 1024,
+        .latency = {.mode = TFS_LATENCY_LOOP},
     };
     return params;
 }
 
+// Readahead windows start at READAHEAD_MIN_WINDOW, doubling on each
+// sequential read up to the instance's readahead_max
+#define READAHEAD_MIN_WINDOW (16 * 1024)
+
+// Optimistic (lock-free) attempts of a read before it takes the inode's lock
+#define OPTIMISTIC_READ_TRIES (4)
+
 int tfs_init(const tfs_params* params_ptr) {
     tfs_params params;
     if (params_ptr != NULL) {
@@ -29,23 +54,95 @@ int tfs_init(const tfs_params* params_ptr) {
     if (state_init(params) != 0) {
         return -1;
     }
+    tfs_instance_t* instance = instance_current();
+    instance->readahead_max = params.readahead_max;
 
     // create root inode
     int root = inode_create(T_DIRECTORY);
     if (root != ROOT_DIR_INUM) {
         return -1;
     }
+    inode_pin(root); // the root directory is always resident
+
+    if (params.aio_worker_count > 0) {
+        instance->aio_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (instance->aio_eventfd == -1) {
+            return -1;
+        }
+        // the workers run requests on this instance
+        instance->aio_pool =
+            pool_create(params.aio_worker_count, instance_bind, instance);
+        if (instance->aio_pool == NULL) {
+            return -1;
+        }
+    }
 
     return 0;
 }
 
 int tfs_destroy() {
+    tfs_instance_t* instance = instance_current();
+
+    // let in-flight asynchronous requests finish first
+    if (instance->aio_pool != NULL) {
+        pool_destroy(instance->aio_pool);
+        instance->aio_pool = NULL;
+    }
+    if (instance->aio_eventfd != -1) {
+        close(instance->aio_eventfd);
+        instance->aio_eventfd = -1;
+    }
+
     if (state_destroy() != 0) {
         return -1;
     }
     return 0;
 }
 
+tfs_instance_t* tfs_instance_create(const tfs_params* params) {
+    tfs_instance_t* instance = calloc(1, sizeof(tfs_instance_t));
+    if (instance == NULL) {
+        return NULL;
+    }
+    instance->aio_eventfd = -1;
+
+    tfs_instance_t* previous = tfs_instance_use(instance);
+    int ret = tfs_init(params);
+    tfs_instance_use(previous);
+
+    if (ret == -1) {
+        free(instance);
+        return NULL;
+    }
+    return instance;
+}
+
+int tfs_instance_destroy(tfs_instance_t* instance) {
+    if (instance == NULL || instance == &instance_default) {
+        return -1;
+    }
+
+    tfs_instance_t* previous = tfs_instance_use(instance);
+    int ret = tfs_destroy();
+    tfs_instance_use(previous == instance ? NULL : previous);
+
+    free(instance);
+    return ret;
+}
+
+tfs_instance_t* tfs_instance_use(tfs_instance_t* instance) {
+    tfs_instance_t* previous = instance_bound;
+    instance_bind(instance);
+    return previous;
+}
+
+int tfs_private_files(size_t max_open_files) {
+    if (max_open_files == 0) {
+        return private_file_table_destroy();
+    }
+    return private_file_table_create(max_open_files);
+}
+
 static bool valid_pathname(const char* name) {
     return name != NULL && strlen(name) > 1 && name[0] == '/';
 }
@@ -82,7 +179,10 @@ int tfs_open(const char* name, tfs_file_mode_t mode) {
     inode_t* root_dir_inode = inode_get(ROOT_DIR_INUM);
     ALWAYS_ASSERT(root_dir_inode != NULL,
                   "tfs_open: root dir inode must exist");
-    int inum = tfs_lookup(name, root_dir_inode);
+    // An exclusive create fails if the name exists, so it needs no lookup:
+    // the insertion of the entry finds it
+    bool exclusive = (mode & TFS_O_CREAT) && (mode & TFS_O_EXCL);
+    int inum = exclusive ? -1 : tfs_lookup(name, root_dir_inode);
     size_t offset;
 
     if (inum >= 0) {
@@ -100,10 +200,13 @@ int tfs_open(const char* name, tfs_file_mode_t mode) {
 
         // Truncate (if requested)
         if (mode & TFS_O_TRUNC) {
-            if (inode->i_size > 0) {
-                data_block_free(inode->i_data_block);
-                inode->i_size = 0;
-            }
+            inode_release_block(inode);
+        }
+
+        // Reserve the data block up front (if requested)
+        if ((mode & TFS_O_PREALLOC) && inode_reserve_block(inode) == -1) {
+            inode_unlock(inode);
+            return -1; // no space
         }
 
         // Determine initial offset
@@ -122,10 +225,29 @@ int tfs_open(const char* name, tfs_file_mode_t mode) {
             return -1; // no space in inode table
         }
 
-        // Add entry in the root directory
-        if (add_dir_entry(root_dir_inode, name + 1, inum) == -1) {
+        // Reserve the data block up front (if requested)
+        if (mode & TFS_O_PREALLOC) {
+            inode_t* inode = inode_get(inum);
+            inode_lock(inode, READ_WRITE);
+            int reserved = inode_reserve_block(inode);
+            inode_unlock(inode);
+            if (reserved == -1) {
+                inode_delete(inum);
+                return -1; // no space
+            }
+        }
+
+        // Add entry in the root directory, unless the name was created
+        // meanwhile
+        bool inserted;
+        int existing =
+            dir_find_or_insert(root_dir_inode, name + 1, inum, &inserted);
+        if (!inserted) {
             inode_delete(inum);
-            return -1; // no space in directory
+            if (existing == -1 || exclusive) {
+                return -1; // no space in directory, or file exists
+            }
+            return tfs_open(name, mode & (tfs_file_mode_t)~TFS_O_CREAT);
         }
 
         offset = 0;
@@ -135,7 +257,8 @@ int tfs_open(const char* name, tfs_file_mode_t mode) {
 
     // Finally, add entry to the open file table and return the corresponding
     // handle
-    return add_to_open_file_table(inum, offset);
+    return add_to_open_file_table(inum, offset, (mode & TFS_O_APPEND) != 0,
+                                  (mode & TFS_O_SHARED) != 0);
 
     // Note: for simplification, if file was created with TFS_O_CREAT and there
     // is an error adding an entry to the open file table, the file is not
@@ -156,8 +279,8 @@ int tfs_sym_link(const char* target, const char* link_name) {
     if (!(target_i_num > 0))
         return -1;
 
-    // target is not greater than a block size.
-    if (strlen(target) == (tfs_default_params().block_size + 1)) {
+    // target must fit in the inode
+    if (strlen(target) >= MAX_FILE_NAME) {
         return -1;
     }
     // creat link to target
@@ -166,7 +289,8 @@ int tfs_sym_link(const char* target, const char* link_name) {
     strcpy(sym_link_inode->target, target);
 
     if (add_dir_entry(root_dir_inode, link_name + 1, sym_link_inum) == -1) {
-        return -1; // no space
+        inode_delete(sym_link_inum);
+        return -1; // no space, or link_name exists
     };
     return 0;
 }
@@ -192,21 +316,27 @@ int tfs_link(const char* target, const char* link_name) {
     if (!(target_i_num > 0))
         return -1; // target file/directory doesn't exist
 
-    if (add_dir_entry(root_dir_inode, link_name + 1, target_i_num) == -1)
-        return -1; // no space in directory
-
-    inode_t* target_inode = inode_get(target_i_num);
-
-    inode_lock(target_inode, READ_WRITE);
+    // count the link before it can be found, so a concurrent unlink of the
+    // target cannot free the inode under it
+    if (inode_add_link(target_i_num) == -1) {
+        return -1; // target was unlinked meanwhile
+    }
 
-    if (target_inode->i_node_type == T_SYM_LINK) {
-        inode_unlock(target_inode);
+    // the target may have been unlinked and its inumber reused (for another
+    // file, or a symlink) between the lookup and the count: the link must
+    // only stand if the name still refers to the inode that was counted,
+    // whose type cannot change while it is counted
+    inode_t const* target_inode = inode_get(target_i_num);
+    if (tfs_lookup(target, root_dir_inode) != target_i_num ||
+        target_inode->i_node_type == T_SYM_LINK) {
+        inode_delete(target_i_num);
         return -1;
     }
 
-    target_inode->hard_link_counter++;
-
-    inode_unlock(target_inode);
+    if (add_dir_entry(root_dir_inode, link_name + 1, target_i_num) == -1) {
+        inode_delete(target_i_num);
+        return -1; // no space in directory
+    }
     return 0;
 }
 
@@ -216,6 +346,10 @@ int tfs_close(int fhandle) {
         return -1; // invalid fd
     }
 
+    inode_t const* inode = inode_get(file->of_inumber);
+    ALWAYS_ASSERT(inode != NULL, "tfs_close: inode of open file deleted");
+    inode_unlock_ranges(inode, file);
+
     remove_from_open_file_table(fhandle);
 
     return 0;
@@ -230,41 +364,94 @@ ssize_t tfs_write(int fhandle, const void* buffer, size_t to_write) {
     //  From the open file table entry, we get the inode
     inode_t* inode = inode_get(file->of_inumber);
     ALWAYS_ASSERT(inode != NULL, "tfs_write: inode of open file deleted");
-    inode_lock(inode, READ_WRITE);
-
-    // Determine how many bytes to write
-    size_t block_size = state_block_size();
-    if (to_write + file->of_offset > block_size) {
-        to_write = block_size - file->of_offset;
+    if (inode->i_node_type != T_FILE) {
+        return -1; // directory handle
     }
 
-    if (to_write > 0) {
-        if (inode->i_size == 0) {
-            // If empty file, allocate new block
-            int bnum = data_block_alloc();
-            if (bnum == -1) {
-                inode_unlock(inode);
-                return -1; // no space
-            }
+    // Overwrites only lock the bytes they write, so that writes to disjoint
+    // ranges of a file run in parallel. Appends need the end of the file to
+    // hold still, so they always take the inode's lock for writing.
+    open_file_lock(file);
+    bool done = false;
+    if (!file->of_append) {
+        inode_lock(inode, READ_ONLY);
+        done = inode_overwrite(inode, file->of_offset, buffer, to_write);
+        inode_unlock(inode);
+    }
 
-            inode->i_data_block = bnum;
+    ssize_t written = (ssize_t)to_write;
+    if (!done) {
+        inode_lock(inode, READ_WRITE);
+        if (file->of_append) {
+            file->of_offset = inode->i_size;
         }
+        written = inode_write_at(inode, file->of_offset, buffer, to_write);
+        inode_unlock(inode);
+    }
 
-        void* block = data_block_get(inode->i_data_block);
-        ALWAYS_ASSERT(block != NULL, "tfs_write: data block deleted mid-write");
+    if (written > 0) {
+        // The offset associated with the file handle is incremented accordingly
+        file->of_offset += (size_t)written;
+    }
+    open_file_unlock(file);
+    return written;
+}
 
-        // Perform the actual write
-        memcpy(block + file->of_offset, buffer, to_write);
+typedef struct {
+    int block;
+    size_t end;
+} readahead_job_t;
 
-        // The offset associated with the file handle is incremented accordingly
-        file->of_offset += to_write;
-        if (file->of_offset > inode->i_size) {
-            inode->i_size = file->of_offset;
+static void readahead_run(void* arg) {
+    readahead_job_t* job = arg;
+    data_block_prefetch(job->block, job->end);
+    free(job);
+}
+
+/**
+ * Track the access pattern of a handle, reading its file ahead in the
+ * background while it is read sequentially.
+ *
+ * The caller must call this before moving the handle's offset past the bytes
+ * just read.
+ *
+ * Input:
+ *   - file: open file entry
+ *   - extent: the file's size and block, as seen by the read
+ *   - read: number of bytes just read, at the handle's offset
+ */
+static void readahead(open_file_entry_t* file, inode_extent_t extent,
+                      size_t read) {
+    tfs_instance_t* instance = instance_current();
+    if (file->of_offset != file->of_ra_next) {
+        // random access: no readahead until reads are sequential again
+        file->of_ra_window = 0;
+        file->of_ra_end = 0;
+    } else if (read > 0 && instance->readahead_max > 0 &&
+               instance->aio_pool != NULL) {
+        size_t window = file->of_ra_window == 0 ? READAHEAD_MIN_WINDOW
+                                                : 2 * file->of_ra_window;
+        size_t max = instance->readahead_max;
+        file->of_ra_window = window < max ? window : max;
+
+        size_t end = file->of_offset + read + file->of_ra_window;
+        if (end > extent.size) {
+            end = extent.size;
+        }
+        if (end > file->of_ra_end) {
+            readahead_job_t* job = malloc(sizeof(readahead_job_t));
+            if (job != NULL) {
+                job->block = extent.data_block;
+                job->end = end;
+                if (pool_submit(instance->aio_pool, readahead_run, job) == -1) {
+                    free(job);
+                } else {
+                    file->of_ra_end = end;
+                }
+            }
         }
     }
-
-    inode_unlock(inode);
-    return (ssize_t)to_write;
+    file->of_ra_next = file->of_offset + read;
 }
 
 ssize_t tfs_read(int fhandle, void* buffer, size_t len) {
@@ -276,28 +463,271 @@ ssize_t tfs_read(int fhandle, void* buffer, size_t len) {
     // From the open file table entry, we get the inode
     const inode_t* inode = inode_get(file->of_inumber);
     ALWAYS_ASSERT(inode != NULL, "tfs_read: inode of open file deleted");
-    inode_lock(inode, READ_ONLY);
+    if (inode->i_node_type != T_FILE) {
+        return -1; // directory handle
+    }
 
-    // Determine how many bytes to read
-    size_t to_read = inode->i_size - file->of_offset;
-    if (to_read > len) {
-        to_read = len;
+    // Reads only take the lock if writers keep getting in their way
+    open_file_lock(file);
+    size_t to_read;
+    inode_extent_t extent;
+    bool done = false;
+    for (int i = 0; i < OPTIMISTIC_READ_TRIES && !done; i++) {
+        done = inode_read_optimistic(inode, file->of_offset, buffer, len,
+                                     &to_read, &extent);
+    }
+    if (!done) {
+        inode_lock(inode, READ_ONLY);
+        to_read = inode_read_at(inode, file->of_offset, buffer, len);
+        extent.size = inode->i_size;
+        extent.data_block = inode->i_data_block;
+        inode_unlock(inode);
     }
 
-    if (to_read > 0) {
-        void* block = data_block_get(inode->i_data_block);
-        ALWAYS_ASSERT(block != NULL, "tfs_read: data block deleted mid-read");
+    readahead(file, extent, to_read);
+    // The offset associated with the file handle is incremented accordingly
+    file->of_offset += to_read;
+    open_file_unlock(file);
 
-        // Perform the actual read
-        memcpy(buffer, block + file->of_offset, to_read);
-        // The offset associated with the file handle is incremented accordingly
-        file->of_offset += to_read;
+    return (ssize_t)to_read;
+}
+
+ssize_t tfs_copy_file_range(int fhandle_in, size_t off_in, int fhandle_out,
+                            size_t off_out, size_t len) {
+    open_file_entry_t* file_in = get_open_file_entry(fhandle_in);
+    open_file_entry_t* file_out = get_open_file_entry(fhandle_out);
+    if (file_in == NULL || file_out == NULL) {
+        return -1;
     }
 
-    inode_unlock(inode);
-    return (ssize_t)to_read;
+    int inum_in = file_in->of_inumber;
+    int inum_out = file_out->of_inumber;
+    inode_t* inode_in = inode_get(inum_in);
+    inode_t* inode_out = inum_out == inum_in ? inode_in : inode_get(inum_out);
+    ALWAYS_ASSERT(inode_in != NULL && inode_out != NULL,
+                  "tfs_copy_file_range: inode of open file deleted");
+    if (inode_in->i_node_type != T_FILE || inode_out->i_node_type != T_FILE) {
+        return -1; // directory handle
+    }
+
+    // inode locks are always taken in increasing inumber order
+    if (inum_in == inum_out) {
+        inode_lock(inode_out, READ_WRITE);
+    } else if (inum_in < inum_out) {
+        inode_lock(inode_in, READ_ONLY);
+        inode_lock(inode_out, READ_WRITE);
+    } else {
+        inode_lock(inode_out, READ_WRITE);
+        inode_lock(inode_in, READ_ONLY);
+    }
+
+    ssize_t copied =
+        inode_copy_range(inode_in, off_in, inode_out, off_out, len);
+
+    if (inum_in != inum_out) {
+        inode_unlock(inode_in);
+    }
+    inode_unlock(inode_out);
+    return copied;
+}
+
+typedef struct {
+    bool is_write;
+    int fhandle;
+    void* buffer;
+    size_t len;
+    tfs_aio_callback_t callback;
+    void* arg;
+} aio_request_t;
+
+static void aio_run(void* arg) {
+    tfs_instance_t* instance = instance_current();
+    aio_request_t* request = (aio_request_t*)arg;
+
+    ssize_t result;
+    if (request->is_write) {
+        result = tfs_write(request->fhandle, request->buffer, request->len);
+    } else {
+        result = tfs_read(request->fhandle, request->buffer, request->len);
+    }
+
+    if (request->callback != NULL) {
+        request->callback(result, request->arg);
+    }
+
+    uint64_t one = 1;
+    ALWAYS_ASSERT(
+        write(instance->aio_eventfd, &one, sizeof(one)) == sizeof(one),
+        "aio_run: failed to signal completion");
+    free(request);
 }
 
+/**
+ * Queue an asynchronous read or write on the aio worker pool.
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+static int aio_submit(bool is_write, int fhandle, void* buffer, size_t len,
+                      tfs_aio_callback_t callback, void* arg) {
+    tfs_instance_t* instance = instance_current();
+    if (instance->aio_pool == NULL || get_open_file_entry(fhandle) == NULL) {
+        return -1;
+    }
+    if (private_file_handle(fhandle)) {
+        return -1; // the workers cannot see the caller's private table
+    }
+
+    aio_request_t* request = malloc(sizeof(aio_request_t));
+    if (request == NULL) {
+        return -1;
+    }
+    request->is_write = is_write;
+    request->fhandle = fhandle;
+    request->buffer = buffer;
+    request->len = len;
+    request->callback = callback;
+    request->arg = arg;
+
+    if (pool_submit(instance->aio_pool, aio_run, request) == -1) {
+        free(request);
+        return -1;
+    }
+    return 0;
+}
+
+int tfs_aread(int fhandle, void* buffer, size_t len,
+              tfs_aio_callback_t callback, void* arg) {
+    return aio_submit(false, fhandle, buffer, len, callback, arg);
+}
+
+int tfs_awrite(int fhandle, const void* buffer, size_t len,
+               tfs_aio_callback_t callback, void* arg) {
+    return aio_submit(true, fhandle, (void*)buffer, len, callback, arg);
+}
+
+int tfs_aio_eventfd(void) { return instance_current()->aio_eventfd; }
+
+int tfs_opendir(const char* name) {
+    if (name == NULL || strcmp(name, "/") != 0) {
+        return -1; // only the root directory exists
+    }
+
+    // the offset of a directory handle is the slot where listing resumes
+    return add_to_open_file_table(ROOT_DIR_INUM, 0, false, false);
+}
+
+static tfs_file_type_t file_type(inode_type type) {
+    switch (type) {
+    case T_DIRECTORY:
+        return TFS_DT_DIR;
+    case T_SYM_LINK:
+        return TFS_DT_SYMLINK;
+    case T_FILE:
+    default:
+        return TFS_DT_FILE;
+    }
+}
+
+/**
+ * Read the next entries of an open directory, along with their inodes.
+ *
+ * Returns the number of entries read, or -1 in case of error.
+ */
+static ssize_t dir_read_batch(int dhandle, size_t max, dir_entry_t* entries,
+                              inode_t** inodes) {
+    open_file_entry_t* dir = get_open_file_entry(dhandle);
+    if (dir == NULL) {
+        return -1;
+    }
+
+    inode_t const* dir_inode = inode_get(dir->of_inumber);
+    ALWAYS_ASSERT(dir_inode != NULL,
+                  "dir_read_batch: inode of open dir deleted");
+
+    open_file_lock(dir);
+    ssize_t count = dir_list(dir_inode, &dir->of_offset, entries, max);
+    open_file_unlock(dir);
+    if (count <= 0) {
+        return count;
+    }
+
+    int* inumbers = malloc((size_t)count * sizeof(int));
+    if (inumbers == NULL) {
+        return -1;
+    }
+    for (ssize_t i = 0; i < count; i++) {
+        inumbers[i] = entries[i].d_inumber;
+    }
+    int ret = inode_get_batch(inumbers, (size_t)count, inodes);
+    free(inumbers);
+
+    return ret == -1 ? -1 : count;
+}
+
+static void fill_dirent(tfs_dirent_t* dirent, dir_entry_t const* entry,
+                        inode_t const* inode) {
+    memcpy(dirent->d_name, entry->d_name, MAX_FILE_NAME);
+    dirent->d_inumber = entry->d_inumber;
+    dirent->d_type = file_type(inode->i_node_type);
+}
+
+ssize_t tfs_getdents(int dhandle, tfs_dirent_t* buffer, size_t len) {
+    size_t max = len / sizeof(tfs_dirent_t);
+    if (max == 0) {
+        return -1; // buffer too small
+    }
+
+    dir_entry_t* entries = malloc(max * sizeof(dir_entry_t));
+    inode_t** inodes = malloc(max * sizeof(inode_t*));
+    ssize_t count = -1;
+    if (entries != NULL && inodes != NULL) {
+        count = dir_read_batch(dhandle, max, entries, inodes);
+    }
+
+    for (ssize_t i = 0; i < count; i++) {
+        fill_dirent(&buffer[i], &entries[i], inodes[i]);
+    }
+
+    free(entries);
+    free(inodes);
+    return count == -1 ? -1 : count * (ssize_t)sizeof(tfs_dirent_t);
+}
+
+ssize_t tfs_readdir_plus(int dhandle, tfs_dirent_plus_t* buffer, size_t len) {
+    size_t max = len / sizeof(tfs_dirent_plus_t);
+    if (max == 0) {
+        return -1; // buffer too small
+    }
+
+    dir_entry_t* entries = malloc(max * sizeof(dir_entry_t));
+    inode_t** inodes = malloc(max * sizeof(inode_t*));
+    ssize_t count = -1;
+    if (entries != NULL && inodes != NULL) {
+        count = dir_read_batch(dhandle, max, entries, inodes);
+    }
+
+    for (ssize_t i = 0; i < count; i++) {
+        inode_t const* inode = inodes[i];
+
+        inode_lock(inode, READ_ONLY);
+        fill_dirent(&buffer[i].d_entry, &entries[i], inode);
+        if (inode->i_node_type == T_SYM_LINK) {
+            buffer[i].st_size = strlen(inode->target);
+            buffer[i].st_nlink = 1;
+        } else {
+            buffer[i].st_size = inode->i_size;
+            buffer[i].st_nlink = atomic_load(&inode->hard_link_counter);
+        }
+        inode_unlock(inode);
+    }
+
+    free(entries);
+    free(inodes);
+    return count == -1 ? -1 : count * (ssize_t)sizeof(tfs_dirent_plus_t);
+}
+
+int tfs_closedir(int dhandle) { return tfs_close(dhandle); }
+
 int tfs_unlink(const char* target) {
     inode_t* root_dir_inode = inode_get(ROOT_DIR_INUM);
     ALWAYS_ASSERT(root_dir_inode != NULL,
@@ -308,52 +738,612 @@ int tfs_unlink(const char* target) {
     if (!(target_i_num > 0))
         return -1; // target file/directory doesn't exist
 
-    inode_t* inode_target = inode_get(target_i_num);
-    if (inode_target->i_node_type == T_SYM_LINK) {
-        clear_dir_entry(root_dir_inode, target + 1);
-        inode_delete(target_i_num);
+    // only the thread that removes the entry drops its link
+    if (clear_dir_entry(root_dir_inode, target + 1) == -1) {
+        return -1; // unlinked meanwhile
     }
-
-    clear_dir_entry(root_dir_inode, target + 1);
     inode_delete(target_i_num);
     return 0;
 }
 
+int tfs_ftruncate(int fhandle, size_t len) {
+    open_file_entry_t* file = get_open_file_entry(fhandle);
+    if (file == NULL) {
+        return -1;
+    }
+
+    inode_t* inode = inode_get(file->of_inumber);
+    ALWAYS_ASSERT(inode != NULL, "tfs_ftruncate: inode of open file deleted");
+    if (inode->i_node_type != T_FILE) {
+        return -1; // directory handle
+    }
+
+    inode_lock(inode, READ_WRITE);
+    int ret = inode_truncate(inode, len);
+    inode_unlock(inode);
+    return ret;
+}
+
+int tfs_fallocate(int fhandle, size_t offset, size_t len) {
+    open_file_entry_t* file = get_open_file_entry(fhandle);
+    if (file == NULL) {
+        return -1;
+    }
+
+    // the range must fit in the maximum file size
+    size_t block_size = state_block_size();
+    if (len == 0 || offset >= block_size || len > block_size - offset) {
+        return -1;
+    }
+
+    inode_t* inode = inode_get(file->of_inumber);
+    ALWAYS_ASSERT(inode != NULL, "tfs_fallocate: inode of open file deleted");
+    if (inode->i_node_type != T_FILE) {
+        return -1; // directory handle
+    }
+
+    inode_lock(inode, READ_WRITE);
+    int ret = inode_reserve_block(inode);
+    inode_unlock(inode);
+    return ret;
+}
+
+int tfs_fsync(int fhandle) {
+    open_file_entry_t* file = get_open_file_entry(fhandle);
+    if (file == NULL) {
+        return -1;
+    }
+
+    inode_t const* inode = inode_get(file->of_inumber);
+    ALWAYS_ASSERT(inode != NULL, "tfs_fsync: inode of open file deleted");
+
+    inode_lock(inode, READ_ONLY);
+    inode_sync(inode);
+    inode_unlock(inode);
+    return 0;
+}
+
+int tfs_sync(void) {
+    block_cache_sync();
+    return 0;
+}
+
+int tfs_lock_range(int fhandle, size_t offset, size_t len,
+                   tfs_lock_mode_t mode) {
+    open_file_entry_t* file = get_open_file_entry(fhandle);
+    if (file == NULL || len == 0 || offset + len < offset) {
+        return -1;
+    }
+
+    inode_t const* inode = inode_get(file->of_inumber);
+    ALWAYS_ASSERT(inode != NULL, "tfs_lock_range: inode of open file deleted");
+
+    return inode_lock_range(inode, file, offset, len,
+                            mode == TFS_LOCK_EXCLUSIVE);
+}
+
+int tfs_unlock_range(int fhandle, size_t offset, size_t len) {
+    open_file_entry_t* file = get_open_file_entry(fhandle);
+    if (file == NULL) {
+        return -1;
+    }
+
+    inode_t const* inode = inode_get(file->of_inumber);
+    ALWAYS_ASSERT(inode != NULL,
+                  "tfs_unlock_range: inode of open file deleted");
+
+    return inode_unlock_range(inode, file, offset, len);
+}
+
+/**
+ * Copy a host file into TécnicoFS (see tfs_copy_from_external_fs).
+ *
+ * Returns the number of bytes copied, or -1 in case of error.
+ */
+static ssize_t copy_from_external(const char* source_path,
+                                  const char* dest_path) {
+    int source = open(source_path, O_RDONLY);
+    if (source == -1) {
+        return -1;
+    }
+    // the whole source is streamed once, front to back
+    posix_fadvise(source, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    int fhandle = tfs_open(dest_path, TFS_O_CREAT | TFS_O_TRUNC);
+    if (fhandle == -1) {
+        close(source);
+        return -1;
+    }
+
+    open_file_entry_t* file = get_open_file_entry(fhandle);
+    ALWAYS_ASSERT(file != NULL, "copy_from_external: file handle just opened");
+    inode_t* inode = inode_get(file->of_inumber);
+    ALWAYS_ASSERT(inode != NULL,
+                  "copy_from_external: inode of open file deleted");
+
+    inode_lock(inode, READ_WRITE);
+    ssize_t copied = -1;
+    // the file may have been written to since it was truncated, in which
+    // case the copy is not made (rather than overwrite those writes)
+    if (inode->i_size == 0) {
+        copied = inode_fill_from_fd(inode, source);
+    }
+    inode_unlock(inode);
+
+    tfs_close(fhandle);
+    close(source);
+    return copied;
+}
+
 int tfs_copy_from_external_fs(const char* source_path, const char* dest_path) {
-    int fhandle = tfs_open(dest_path, TFS_O_CREAT);
+    if (copy_from_external(source_path, dest_path) == -1) {
+        fprintf(stderr,
+                "tfs_copy_from_external_fs: failed to copy '%s' to '%s'.\n",
+                source_path, dest_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Files found while walking a host directory tree, to be imported.
+ */
+typedef struct {
+    char** host_paths;
+    char** tfs_paths;
+    size_t count;
+    size_t capacity;
+
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    size_t pending_batches;
+    size_t imported;
+    size_t failed;
+    size_t bytes;
+} import_job_t;
+
+typedef struct {
+    import_job_t* job;
+    size_t start;
+    size_t end;
+} import_batch_t;
+
+// Files copied by each worker task
+#define IMPORT_BATCH_SIZE (16)
+
+static char* path_join(const char* dir, const char* name, const char* sep) {
+    size_t len = strlen(dir) + strlen(sep) + strlen(name) + 1;
+    char* path = malloc(len);
+    if (path != NULL) {
+        snprintf(path, len, "%s%s%s", dir, sep, name);
+    }
+    return path;
+}
+
+static int import_job_add(import_job_t* job, char* host_path,
+                          char* tfs_path) {
+    if (job->count == job->capacity) {
+        size_t capacity = job->capacity == 0 ? 64 : 2 * job->capacity;
+        char** host_paths = realloc(job->host_paths, capacity * sizeof(char*));
+        if (host_paths == NULL) {
+            return -1;
+        }
+        job->host_paths = host_paths;
+        char** tfs_paths = realloc(job->tfs_paths, capacity * sizeof(char*));
+        if (tfs_paths == NULL) {
+            return -1;
+        }
+        job->tfs_paths = tfs_paths;
+        job->capacity = capacity;
+    }
+
+    job->host_paths[job->count] = host_path;
+    job->tfs_paths[job->count] = tfs_path;
+    job->count++;
+    return 0;
+}
+
+/**
+ * Collect the regular files under host_dir. A host file at <host_dir>/a/b is
+ * named <tfs_prefix>a/b in TécnicoFS.
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+static int import_walk(import_job_t* job, const char* host_dir,
+                       const char* tfs_prefix) {
+    DIR* dir = opendir(host_dir);
+    if (dir == NULL) {
+        return -1;
+    }
+
+    int ret = 0;
+    struct dirent* entry;
+    while (ret == 0 && (entry = readdir(dir)) != NULL) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+            continue;
+        }
+
+        char* host_path = path_join(host_dir, entry->d_name, "/");
+        char* tfs_path = path_join(tfs_prefix, entry->d_name, "");
+        struct stat st;
+        if (host_path == NULL || tfs_path == NULL ||
+            lstat(host_path, &st) == -1) {
+            ret = -1;
+        } else if (S_ISDIR(st.st_mode)) {
+            char* sub_prefix = path_join(tfs_path, "", "/");
+            ret = sub_prefix == NULL ? -1
+                                     : import_walk(job, host_path, sub_prefix);
+            free(sub_prefix);
+        } else if (S_ISREG(st.st_mode) ||
+                   (S_ISLNK(st.st_mode) && stat(host_path, &st) == 0 &&
+                    S_ISREG(st.st_mode))) {
+            // links are only followed to regular files: one to a directory
+            // would import it twice, or forever if it is an ancestor
+            if (import_job_add(job, host_path, tfs_path) == 0) {
+                continue; // paths now owned by the job
+            }
+            ret = -1;
+        }
+
+        free(host_path);
+        free(tfs_path);
+    }
+
+    closedir(dir);
+    return ret;
+}
+
+static void import_run_batch(void* arg) {
+    import_batch_t* batch = (import_batch_t*)arg;
+    import_job_t* job = batch->job;
+
+    size_t imported = 0;
+    size_t failed = 0;
+    size_t bytes = 0;
+    for (size_t i = batch->start; i < batch->end; i++) {
+        ssize_t copied =
+            copy_from_external(job->host_paths[i], job->tfs_paths[i]);
+        if (copied == -1) {
+            failed++;
+        } else {
+            imported++;
+            bytes += (size_t)copied;
+        }
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->imported += imported;
+    job->failed += failed;
+    job->bytes += bytes;
+    job->pending_batches--;
+    pthread_cond_signal(&job->finished);
+    pthread_mutex_unlock(&job->lock);
+
+    free(batch);
+}
+
+static double elapsed_seconds(struct timespec const* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double)(end.tv_sec - start->tv_sec) +
+           (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int tfs_import_tree(const char* host_dir, const char* tfs_dir,
+                    tfs_import_stats_t* stats) {
+    tfs_instance_t* instance = instance_current();
+    if (host_dir == NULL || tfs_dir == NULL || tfs_dir[0] != '/') {
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    import_job_t job = {0};
+    ALWAYS_ASSERT(pthread_mutex_init(&job.lock, NULL) == 0,
+                  "tfs_import_tree: error initializing mutex");
+    ALWAYS_ASSERT(pthread_cond_init(&job.finished, NULL) == 0,
+                  "tfs_import_tree: error initializing condvar");
+
+    // names of the imported files start with tfs_dir (as a directory)
+    char* tfs_prefix = path_join(tfs_dir, "",
+                                 tfs_dir[strlen(tfs_dir) - 1] == '/' ? ""
+                                                                     : "/");
+    int ret = tfs_prefix == NULL ? -1 : import_walk(&job, host_dir, tfs_prefix);
+    free(tfs_prefix);
+
+    for (size_t start_i = 0; ret == 0 && start_i < job.count;
+         start_i += IMPORT_BATCH_SIZE) {
+        import_batch_t* batch = malloc(sizeof(import_batch_t));
+        if (batch == NULL) {
+            ret = -1;
+            break;
+        }
+        batch->job = &job;
+        batch->start = start_i;
+        batch->end = start_i + IMPORT_BATCH_SIZE < job.count
+                         ? start_i + IMPORT_BATCH_SIZE
+                         : job.count;
+
+        pthread_mutex_lock(&job.lock);
+        job.pending_batches++;
+        pthread_mutex_unlock(&job.lock);
+
+        // without a worker pool, files are copied by the calling thread
+        if (instance->aio_pool == NULL ||
+            pool_submit(instance->aio_pool, import_run_batch, batch) == -1) {
+            import_run_batch(batch);
+        }
+    }
+
+    pthread_mutex_lock(&job.lock);
+    while (job.pending_batches > 0) {
+        pthread_cond_wait(&job.finished, &job.lock);
+    }
+    pthread_mutex_unlock(&job.lock);
+
+    if (stats != NULL) {
+        stats->files = job.imported;
+        stats->failed = job.failed;
+        stats->bytes = job.bytes;
+        stats->seconds = elapsed_seconds(&start);
+        stats->files_per_second =
+            stats->seconds > 0 ? (double)job.imported / stats->seconds : 0;
+        stats->bytes_per_second =
+            stats->seconds > 0 ? (double)job.bytes / stats->seconds : 0;
+    }
+
+    for (size_t i = 0; i < job.count; i++) {
+        free(job.host_paths[i]);
+        free(job.tfs_paths[i]);
+    }
+    free(job.host_paths);
+    free(job.tfs_paths);
+    ALWAYS_ASSERT(pthread_cond_destroy(&job.finished) == 0,
+                  "tfs_import_tree: error destroying condvar");
+    ALWAYS_ASSERT(pthread_mutex_destroy(&job.lock) == 0,
+                  "tfs_import_tree: error destroying mutex");
+
+    return ret == 0 && job.failed == 0 ? 0 : -1;
+}
+
+// Files at least this large are exported in parallel, in chunks
+#define EXPORT_PARALLEL_THRESHOLD (4 << 20)
+#define EXPORT_CHUNK_SIZE (1 << 20)
+
+// Directory entries listed at a time by tfs_export_tree
+#define EXPORT_LIST_BATCH (32)
+
+typedef struct {
+    inode_t const* inode;
+    int fd;
+    atomic_bool failed;
+} export_job_t;
+
+typedef struct {
+    export_job_t* job;
+    size_t offset;
+    size_t len;
+} export_chunk_t;
+
+static void export_run_chunk(void* arg) {
+    export_chunk_t* chunk = (export_chunk_t*)arg;
+    export_job_t* job = chunk->job;
+
+    ssize_t written =
+        inode_write_to_fd(job->inode, job->fd, chunk->offset, chunk->len);
+    if (written != (ssize_t)chunk->len) {
+        atomic_store(&job->failed, true);
+    }
+
+    free(chunk);
+}
+
+/**
+ * Write the whole contents of a file inode to a host file descriptor.
+ *
+ * The caller must hold the inode's lock (at least for reading), which keeps
+ * it valid while the chunks of a large file are exported in parallel.
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+static int export_inode(inode_t const* inode, int fd) {
+    tfs_instance_t* instance = instance_current();
+    size_t size = inode->i_size;
+    if (size < EXPORT_PARALLEL_THRESHOLD || instance->aio_pool == NULL) {
+        return inode_write_to_fd(inode, fd, 0, size) == (ssize_t)size ? 0
+                                                                      : -1;
+    }
+
+    // The aio workers may be waiting for the inode's lock (e.g., to append
+    // to the file), and so could not run the chunks while it is held: the
+    // chunks get workers of their own, as many as the aio pool has
+    size_t n_chunks = (size + EXPORT_CHUNK_SIZE - 1) / EXPORT_CHUNK_SIZE;
+    size_t n_workers = pool_size(instance->aio_pool);
+    pool_t* pool = pool_create(n_workers < n_chunks ? n_workers : n_chunks,
+                               instance_bind, instance);
+    if (pool == NULL) {
+        return inode_write_to_fd(inode, fd, 0, size) == (ssize_t)size ? 0
+                                                                      : -1;
+    }
+
+    export_job_t job = {.inode = inode, .fd = fd};
+    atomic_init(&job.failed, false);
+    for (size_t offset = 0; offset < size; offset += EXPORT_CHUNK_SIZE) {
+        export_chunk_t* chunk = malloc(sizeof(export_chunk_t));
+        if (chunk == NULL) {
+            atomic_store(&job.failed, true);
+            break;
+        }
+        chunk->job = &job;
+        chunk->offset = offset;
+        chunk->len = size - offset < EXPORT_CHUNK_SIZE ? size - offset
+                                                       : EXPORT_CHUNK_SIZE;
+
+        if (pool_submit(pool, export_run_chunk, chunk) == -1) {
+            export_run_chunk(chunk);
+        }
+    }
+
+    pool_destroy(pool); // after running every chunk
+    return atomic_load(&job.failed) ? -1 : 0;
+}
+
+int tfs_copy_to_external_fs(const char* source_path, const char* dest_path) {
+    int fhandle = tfs_open(source_path, 0);
     if (fhandle == -1) {
-        perror(
-            "tfs_copy_from_external_fs: failed to open/create tfs file: '%s'.");
         return -1;
     }
 
-    char* buffer = malloc(sizeof(char) * (tfs_default_params().block_size));
-    if (buffer == NULL) {
+    int dest = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (dest == -1) {
         tfs_close(fhandle);
-        perror("tfs_copy_from_external_fs: failed to alloc memory for the "
-               "buffer.");
         return -1;
     }
 
-    FILE* extFile = fopen(source_path, "r");
-    if (extFile == NULL) {
-        tfs_close(fhandle);
-        free(buffer);
-        perror("tfs_copy_from_external_fs: failed to open external file.");
+    open_file_entry_t* file = get_open_file_entry(fhandle);
+    ALWAYS_ASSERT(file != NULL,
+                  "tfs_copy_to_external_fs: file handle just opened");
+    inode_t const* inode = inode_get(file->of_inumber);
+    ALWAYS_ASSERT(inode != NULL,
+                  "tfs_copy_to_external_fs: inode of open file deleted");
+
+    inode_lock(inode, READ_ONLY);
+    int ret = export_inode(inode, dest);
+    inode_unlock(inode);
+
+    tfs_close(fhandle);
+    if (close(dest) == -1) {
+        ret = -1;
+    }
+    return ret;
+}
+
+/**
+ * Create the missing parent directories of a host path name.
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+static int make_parent_dirs(char* path) {
+    for (char* sep = strchr(path + 1, '/'); sep != NULL;
+         sep = strchr(sep + 1, '/')) {
+        *sep = '\0';
+        int ret = mkdir(path, 0777);
+        *sep = '/';
+        if (ret == -1 && errno != EEXIST) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Check whether a relative path name only has proper components (none empty,
+ * "." or ".."), so that, joined to a directory, it names a file inside it.
+ */
+static bool contained_path(const char* path) {
+    if (path[0] == '\0' || path[0] == '/') {
+        return false;
+    }
+    for (const char* part = path; part != NULL;) {
+        const char* sep = strchr(part, '/');
+        size_t len = sep != NULL ? (size_t)(sep - part) : strlen(part);
+        if (len == 0 || (len == 1 && part[0] == '.') ||
+            (len == 2 && part[0] == '.' && part[1] == '.')) {
+            return false;
+        }
+        part = sep != NULL ? sep + 1 : NULL;
+    }
+    return true;
+}
+
+int tfs_export_tree(const char* tfs_dir, const char* host_dir) {
+    if (tfs_dir == NULL || tfs_dir[0] != '/' || host_dir == NULL) {
         return -1;
     }
 
-    memset(buffer, 0, sizeof(char) * (tfs_default_params().block_size));
-    size_t bytes_read =
-        fread(buffer, sizeof(char), (tfs_default_params().block_size), extFile);
+    // only files whose names start with tfs_dir (as a directory) are exported
+    char* tfs_prefix = path_join(tfs_dir, "",
+                                 tfs_dir[strlen(tfs_dir) - 1] == '/' ? ""
+                                                                     : "/");
+    if (tfs_prefix == NULL) {
+        return -1;
+    }
+    size_t prefix_len = strlen(tfs_prefix);
 
-    if (bytes_read)
-        buffer[bytes_read] = '\0';
+    inode_t* root_dir_inode = inode_get(ROOT_DIR_INUM);
+    ALWAYS_ASSERT(root_dir_inode != NULL,
+                  "tfs_export_tree: root dir inode must exist");
+
+    int ret = 0;
+    size_t cursor = 0;
+    dir_entry_t entries[EXPORT_LIST_BATCH];
+    ssize_t count;
+    while ((count = dir_list(root_dir_inode, &cursor, entries,
+                             EXPORT_LIST_BATCH)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            char* tfs_path = path_join("/", entries[i].d_name, "");
+            if (tfs_path == NULL) {
+                ret = -1;
+                continue;
+            }
+            if (strncmp(tfs_path, tfs_prefix, prefix_len) != 0) {
+                free(tfs_path);
+                continue;
+            }
 
-    ssize_t bytes_wrote = tfs_write(fhandle, buffer, strlen(buffer));
+            // TécnicoFS names are flat: one such as /a/../../b would
+            // otherwise be written outside host_dir
+            if (!contained_path(tfs_path + prefix_len)) {
+                free(tfs_path);
+                ret = -1;
+                continue;
+            }
 
-    tfs_close(fhandle);
-    free(buffer);
-    fclose(extFile);
-    return (int)bytes_wrote;
+            char* host_path = path_join(host_dir, tfs_path + prefix_len, "/");
+            if (host_path == NULL || make_parent_dirs(host_path) == -1 ||
+                tfs_copy_to_external_fs(tfs_path, host_path) == -1) {
+                ret = -1;
+            }
+            free(host_path);
+            free(tfs_path);
+        }
+    }
+
+    free(tfs_prefix);
+    return count == -1 ? -1 : ret;
+}
+
+int tfs_block_cache_stats(tfs_cache_stats_t* stats) {
+    if (stats == NULL) {
+        return -1;
+    }
+
+    block_cache_stats(stats);
+    return 0;
+}
+
+int tfs_inode_cache_stats(tfs_cache_stats_t* stats) {
+    if (stats == NULL) {
+        return -1;
+    }
+
+    inode_cache_stats(stats);
+    return 0;
+}
+
+int tfs_lock_stats(tfs_lock_stats_t* stats) {
+    if (stats == NULL) {
+        return -1;
+    }
+
+    return lock_stats_get(stats);
+}
+
+int tfs_lock_stats_dump(FILE* out) {
+    if (out == NULL) {
+        return -1;
+    }
+
+    return lock_stats_dump(out);
 }
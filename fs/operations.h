@@ -2,8 +2,46 @@
 #define OPERATIONS_H
 
 #include "config.h"
+#include <stdbool.h>
+#include <stdio.h>
 #include <sys/types.h>
 
+/**
+ * How accesses to (simulated) storage are delayed.
+ */
+typedef enum {
+    TFS_LATENCY_LOOP,  // busy loop of DELAY iterations (depends on the CPU)
+    TFS_LATENCY_NONE,  // no delay at all
+    TFS_LATENCY_SPIN,  // busy wait for the access latency
+    TFS_LATENCY_SLEEP, // sleep (releasing the CPU) for the access latency
+} tfs_latency_mode_t;
+
+/**
+ * Distribution of the access latencies.
+ */
+typedef enum {
+    TFS_LATENCY_FIXED,   // every access takes the mean latency
+    TFS_LATENCY_UNIFORM, // uniformly distributed in [0, 2 * mean]
+} tfs_latency_dist_t;
+
+/**
+ * Storage latency model.
+ *
+ * Metadata (inodes, allocation tables and directories) and data blocks are
+ * stored in separate devices, each with its own latency and queue.
+ */
+typedef struct {
+    tfs_latency_mode_t mode;
+    tfs_latency_dist_t distribution;
+    size_t metadata_ns; // mean latency of a metadata access
+    size_t data_ns;     // mean latency of a data block access
+
+    // data transfer rate, in bytes per second (0 for unlimited)
+    size_t bandwidth;
+    // accesses served at once by each device (0 for unlimited)
+    size_t queue_depth;
+} tfs_latency_params;
+
 /**
  * TécnicoFS parameters.
  */
@@ -13,6 +51,32 @@ typedef struct {
     size_t max_open_files_count;
 
     size_t block_size;
+
+    // worker threads running asynchronous requests (0 disables tfs_aread
+    // and tfs_awrite)
+    size_t aio_worker_count;
+
+    // data blocks kept in the block cache, whose accesses skip the simulated
+    // storage latency; writes to cached blocks are written back later, in
+    // the background (0 disables the cache)
+    size_t block_cache_size;
+
+    // inodes kept in the inode cache besides pinned ones (those of open files
+    // and the root directory), whose accesses skip the simulated storage
+    // latency (0 disables the cache)
+    size_t inode_cache_size;
+
+    // largest readahead window of a sequential reader, in bytes (0 disables
+    // readahead, which also needs aio workers)
+    size_t readahead_max;
+
+    // profile the contention of the file system's locks (see
+    // tfs_lock_stats); this slows down every lock acquisition
+    bool lock_stats;
+
+    // simulated storage latency (the default busy loop ignores the rest of
+    // the model)
+    tfs_latency_params latency;
 } tfs_params;
 
 /**
@@ -22,16 +86,81 @@ tfs_params tfs_default_params();
 
 /**
  * Initialize tecnicofs, optionally with a given configuration.
+ *
+ * This sets up the instance the calling thread is bound to (by default, the
+ * process-wide instance, which every unbound thread uses).
+ *
  * Returns 0 if successful, -1 otherwise.
  */
 int tfs_init(tfs_params const *params);
 
 /**
- * Destroy tecnicofs.
+ * Destroy tecnicofs (the instance the calling thread is bound to).
  * Returns 0 if successful, -1 otherwise.
  */
 int tfs_destroy();
 
+/**
+ * An independent tecnicofs instance, with its own files, caches, storage
+ * latency model and workers. Instances share no locks, so a process may run
+ * one per core, or per tenant.
+ *
+ * Every tfs_* function works on the instance of the calling thread, set with
+ * tfs_instance_use; threads that never set one use the default instance.
+ * File handles are only valid in the instance that returned them.
+ */
+typedef struct tfs_instance tfs_instance_t;
+
+/**
+ * Create and initialize an instance (as with tfs_init).
+ *
+ * Input:
+ *   - params: configuration of the instance (NULL for the default one)
+ *
+ * Returns the new instance, or NULL in case of error.
+ */
+tfs_instance_t *tfs_instance_create(tfs_params const *params);
+
+/**
+ * Destroy an instance created with tfs_instance_create. No thread may be
+ * using it.
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_instance_destroy(tfs_instance_t *instance);
+
+/**
+ * Bind the calling thread to an instance: its later tfs_* calls work on it.
+ *
+ * Input:
+ *   - instance: the instance, or NULL for the default one
+ *
+ * Returns the instance the thread was bound to (NULL for the default one),
+ * so that it can be restored.
+ */
+tfs_instance_t *tfs_instance_use(tfs_instance_t *instance);
+
+/**
+ * Give the calling thread its own table of open files, in its current
+ * instance, or free it.
+ *
+ * Files the thread then opens go to its table (unless opened with
+ * TFS_O_SHARED), which no other thread touches: opening and closing them
+ * takes no lock shared with other threads. Their handles are only valid in
+ * that thread and instance, so they cannot be passed to other threads, nor
+ * used with tfs_aread, tfs_awrite or rings.
+ *
+ * The table must be freed before the thread exits, or its instance is
+ * destroyed.
+ *
+ * Input:
+ *   - max_open_files: size of the table, or 0 to free it (which fails while
+ *     files are open in it)
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_private_files(size_t max_open_files);
+
 /**
  * TécnicoFS file opening modes.
  */
@@ -39,6 +168,9 @@ typedef enum {
     TFS_O_CREAT = 0b001,
     TFS_O_TRUNC = 0b010,
     TFS_O_APPEND = 0b100,
+    TFS_O_PREALLOC = 0b1000,
+    TFS_O_EXCL = 0b10000,
+    TFS_O_SHARED = 0b100000,
 } tfs_file_mode_t;
 
 /**
@@ -47,9 +179,14 @@ typedef enum {
  * Input:
  *   - name: absolute path name
  *   - mode: can be a combination (with bitwise or) of the following flags:
- *     - append mode (TFS_O_APPEND)
+ *     - append mode (TFS_O_APPEND): every write goes to the end of the file
  *     - truncate file contents (TFS_O_TRUNC)
  *     - create file if it does not exist (TFS_O_CREAT)
+ *     - with TFS_O_CREAT, fail if the file already exists (TFS_O_EXCL)
+ *     - return a handle usable by any thread, even if the caller has a
+ *       private table (TFS_O_SHARED; see tfs_private_files)
+ *     - reserve storage for the file's contents up front, as with
+ *       tfs_fallocate (TFS_O_PREALLOC)
  *
  * Returns file handle of the opened file if successful, -1 otherwise.
  */
@@ -113,6 +250,159 @@ ssize_t tfs_write(int fhandle, void const *buffer, size_t len);
  */
 ssize_t tfs_read(int fhandle, void *buffer, size_t len);
 
+/**
+ * Copy a range of data from one open file to another (or within the same
+ * file), without going through a user buffer.
+ *
+ * The offsets of the file handles are neither used nor updated.
+ *
+ * Input:
+ *   - fhandle_in: file handle of the source file
+ *   - off_in: position in the source file where the range starts
+ *   - fhandle_out: file handle of the destination file
+ *   - off_out: position in the destination file where the range is copied to
+ *   - len: length of the range (in bytes)
+ *
+ * Returns the number of bytes that were copied (can be lower than 'len' if
+ * the end of the source file or the maximum file size is reached), or -1 in
+ * case of error.
+ */
+ssize_t tfs_copy_file_range(int fhandle_in, size_t off_in, int fhandle_out,
+                            size_t off_out, size_t len);
+
+/**
+ * Completion callback of an asynchronous read or write.
+ *
+ * Input:
+ *   - result: what the synchronous call would have returned
+ *   - arg: the argument given when the request was issued
+ */
+typedef void (*tfs_aio_callback_t)(ssize_t result, void *arg);
+
+/**
+ * Asynchronously read from an open file, starting at the current offset.
+ *
+ * The read runs on one of TécnicoFS's worker threads. Once it finishes,
+ * callback (if not NULL) is called from that thread and the counter of the
+ * file descriptor returned by tfs_aio_eventfd is incremented.
+ *
+ * Requests on the same file handle that are in flight at the same time run in
+ * an unspecified order.
+ *
+ * Input:
+ *   - fhandle: file handle (obtained from a previous call to tfs_open)
+ *   - buffer: destination buffer, which must remain valid until completion
+ *   - len: length of the buffer
+ *   - callback: completion callback
+ *   - arg: argument passed to callback
+ *
+ * Returns 0 if the request was issued, -1 otherwise.
+ */
+int tfs_aread(int fhandle, void *buffer, size_t len,
+              tfs_aio_callback_t callback, void *arg);
+
+/**
+ * Asynchronously write to an open file, starting at the current offset.
+ *
+ * Same semantics as tfs_aread; buffer must remain valid until completion.
+ *
+ * Returns 0 if the request was issued, -1 otherwise.
+ */
+int tfs_awrite(int fhandle, void const *buffer, size_t len,
+               tfs_aio_callback_t callback, void *arg);
+
+/**
+ * Obtain a non-blocking eventfd counting completed asynchronous requests.
+ *
+ * It becomes readable (e.g., for poll) whenever requests complete; reading it
+ * returns, as an uint64_t, how many completed since the previous read.
+ *
+ * Returns the file descriptor, or -1 if asynchronous requests are disabled.
+ */
+int tfs_aio_eventfd(void);
+
+/**
+ * TécnicoFS file types, as reported in directory listings.
+ */
+typedef enum {
+    TFS_DT_FILE,
+    TFS_DT_DIR,
+    TFS_DT_SYMLINK,
+} tfs_file_type_t;
+
+/**
+ * Directory entry, as filled by tfs_getdents.
+ */
+typedef struct {
+    char d_name[MAX_FILE_NAME];
+    int d_inumber;
+    tfs_file_type_t d_type;
+} tfs_dirent_t;
+
+/**
+ * Open a directory for listing.
+ *
+ * Input:
+ *   - name: absolute path name of the directory (only the root directory,
+ *     "/", exists)
+ *
+ * Returns directory handle if successful, -1 otherwise.
+ */
+int tfs_opendir(char const *name);
+
+/**
+ * Read the next entries of an open directory.
+ *
+ * As many entries as fit are packed in the buffer, as an array of
+ * tfs_dirent_t. Entries are listed at most once, even if the directory is
+ * modified in between calls; entries added or removed meanwhile may or may
+ * not be listed.
+ *
+ * Input:
+ *   - dhandle: directory handle (obtained from a previous call to
+ *     tfs_opendir)
+ *   - buffer: destination buffer
+ *   - len: length of the buffer (must fit at least one tfs_dirent_t)
+ *
+ * Returns the number of bytes filled in the buffer, 0 if the end of the
+ * directory was reached, or -1 in case of error.
+ */
+ssize_t tfs_getdents(int dhandle, tfs_dirent_t *buffer, size_t len);
+
+/**
+ * Directory entry with the attributes of the file, as filled by
+ * tfs_readdir_plus.
+ */
+typedef struct {
+    tfs_dirent_t d_entry;
+    size_t st_size; // in bytes (length of the target, for symbolic links)
+    int st_nlink;   // number of hard links
+} tfs_dirent_plus_t;
+
+/**
+ * Read the next entries of an open directory, along with the attributes of
+ * each file.
+ *
+ * Same as tfs_getdents, except the buffer is filled with tfs_dirent_plus_t.
+ * The inodes of a batch of entries are fetched together, in inumber order,
+ * so this costs much less than a stat of every entry.
+ *
+ * Returns the number of bytes filled in the buffer, 0 if the end of the
+ * directory was reached, or -1 in case of error.
+ */
+ssize_t tfs_readdir_plus(int dhandle, tfs_dirent_plus_t *buffer, size_t len);
+
+/**
+ * Close a directory.
+ *
+ * Input:
+ *   - dhandle: directory handle (obtained from a previous call to
+ *     tfs_opendir)
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_closedir(int dhandle);
+
 /**
  * Delete a link, or a file if the number of hard links reaches 0, that
  * exists in TécnicoFS.
@@ -124,17 +414,289 @@ ssize_t tfs_read(int fhandle, void *buffer, size_t len);
  */
 int tfs_unlink(char const *target);
 
+/**
+ * Set the size of an open file, cutting its contents short or extending them
+ * with zeros.
+ *
+ * The offsets of the file's handles are not changed. Storage released by a
+ * file that shrinks to nothing is reclaimed in the background.
+ *
+ * Input:
+ *   - fhandle: file handle (obtained from a previous call to tfs_open)
+ *   - len: new size of the file (in bytes)
+ *
+ * Returns 0 if successful, -1 otherwise (e.g., if fhandle is a directory
+ * handle, len is larger than the maximum file size, or there is no space
+ * left).
+ */
+int tfs_ftruncate(int fhandle, size_t len);
+
+/**
+ * Reserve storage for a range of an open file, so that later writes to it
+ * do not need to allocate storage (and cannot fail for lack of space).
+ *
+ * The file size is not changed.
+ *
+ * Input:
+ *   - fhandle: file handle (obtained from a previous call to tfs_open)
+ *   - offset: position in the file where the range starts
+ *   - len: length of the range (in bytes)
+ *
+ * Returns 0 if successful, -1 otherwise (e.g., if fhandle is a directory
+ * handle, the range goes beyond the maximum file size, or there is no space
+ * left).
+ */
+int tfs_fallocate(int fhandle, size_t offset, size_t len);
+
+/**
+ * Write the data of an open file back to storage.
+ *
+ * Writes only reach the block cache; dirty blocks are written back in the
+ * background. Once this returns, the writes made before the call are
+ * durable.
+ *
+ * Input:
+ *   - fhandle: file handle (obtained from a previous call to tfs_open)
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_fsync(int fhandle);
+
+/**
+ * Write every dirty data block back to storage.
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_sync(void);
+
+typedef enum {
+    TFS_LOCK_SHARED,    // may overlap other shared ranges
+    TFS_LOCK_EXCLUSIVE, // may not overlap any other range, even of the handle
+} tfs_lock_mode_t;
+
+/**
+ * Lock a byte range of an open file, waiting while other handles hold
+ * conflicting ranges.
+ *
+ * The locks are advisory: reads and writes do not check them, only other
+ * calls to tfs_lock_range do. A range stays locked until it is released with
+ * tfs_unlock_range, or the handle is closed.
+ *
+ * Input:
+ *   - fhandle: file handle (obtained from a previous call to tfs_open)
+ *   - offset: position in the file where the range starts
+ *   - len: length of the range (in bytes); it may go past the end of file
+ *   - mode: TFS_LOCK_SHARED or TFS_LOCK_EXCLUSIVE
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_lock_range(int fhandle, size_t offset, size_t len,
+                   tfs_lock_mode_t mode);
+
+/**
+ * Release a byte range locked with tfs_lock_range.
+ *
+ * Input:
+ *   - fhandle: the file handle that locked the range
+ *   - offset: position in the file where the range starts
+ *   - len: length of the range (in bytes)
+ *
+ * Returns 0 if successful, -1 otherwise (e.g., if the handle did not lock
+ * that exact range).
+ */
+int tfs_unlock_range(int fhandle, size_t offset, size_t len);
+
 /**
  * Copy the contents of a file that exists in the OS' file system tree
  * (outside TécnicoFS) to the TécnicoFS.
  *
+ * The contents are copied byte for byte (binary-safe). A source larger than
+ * the maximum file size (one block) is not copied; the destination is then
+ * left empty.
+ *
  * Input:
  *   - source_path: path name of the source file (from the OS' file system)
  *   - dest_path: absolute path name of the destination file (in TécnicoFS),
  *    which is created if needed, and overwritten if it already exists.
  *
- * Returns 0 if successful, -1 otherwise.
+ * Returns 0 if successful, -1 otherwise (e.g., if the source is larger than
+ * the maximum file size, or the destination is written to during the copy).
  */
 int tfs_copy_from_external_fs(char const *source_path, char const *dest_path);
 
+/**
+ * Statistics of a tfs_import_tree call.
+ */
+typedef struct {
+    size_t files;  // files imported
+    size_t failed; // files that could not be imported
+    size_t bytes;  // bytes imported
+
+    double seconds;
+    double files_per_second;
+    double bytes_per_second;
+} tfs_import_stats_t;
+
+/**
+ * Copy every regular file under a directory of the OS' file system tree
+ * (outside TécnicoFS) to the TécnicoFS.
+ *
+ * As TécnicoFS only has a root directory, the host file <host_dir>/a/b is
+ * copied to the TécnicoFS file named <tfs_dir>/a/b (a flat name). Files are
+ * copied in batches by the asynchronous I/O worker threads, if enabled.
+ * Symbolic links are followed only to regular files; other links are skipped.
+ *
+ * Input:
+ *   - host_dir: path name of the source directory (from the OS' file system)
+ *   - tfs_dir: absolute path name prefix of the destination files (in
+ *     TécnicoFS), e.g., "/" to keep the names relative to host_dir
+ *   - stats: if not NULL, filled with statistics of the import
+ *
+ * Returns 0 if every file was copied, -1 otherwise.
+ */
+int tfs_import_tree(char const *host_dir, char const *tfs_dir,
+                    tfs_import_stats_t *stats);
+
+/**
+ * Copy the contents of a file that exists in the TécnicoFS to the OS' file
+ * system tree (outside TécnicoFS).
+ *
+ * The data is written straight from the file's data block, without an
+ * intermediate buffer; large files are written in parallel, if asynchronous
+ * I/O is enabled, by as many threads of their own as it has workers.
+ *
+ * Input:
+ *   - source_path: absolute path name of the source file (in TécnicoFS)
+ *   - dest_path: path name of the destination file (in the OS' file system),
+ *     which is created if needed, and overwritten if it already exists.
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_copy_to_external_fs(char const *source_path, char const *dest_path);
+
+/**
+ * Copy TécnicoFS files to a directory of the OS' file system tree (outside
+ * TécnicoFS); the reverse of tfs_import_tree.
+ *
+ * Every file named <tfs_dir>/a/b in TécnicoFS is copied to <host_dir>/a/b,
+ * creating the missing host directories. Files whose names would lead
+ * outside host_dir (with empty, "." or ".." components after tfs_dir) are
+ * not copied.
+ *
+ * Input:
+ *   - tfs_dir: absolute path name prefix of the files to export, e.g., "/"
+ *     to export every file
+ *   - host_dir: path name of the destination directory (in the OS' file
+ *     system), which must exist
+ *
+ * Returns 0 if every file was copied, -1 otherwise.
+ */
+int tfs_export_tree(char const *tfs_dir, char const *host_dir);
+
+/**
+ * Cache counters.
+ */
+typedef struct {
+    size_t hits;
+    size_t misses;
+    size_t evictions;  // blocks dropped to make room for others
+    size_t writebacks; // evicted blocks that were dirty
+    size_t flushed;    // dirty blocks written back by the flusher or a sync
+    size_t prefetched; // bytes read ahead of their use
+    double hit_ratio;  // hits / (hits + misses)
+} tfs_cache_stats_t;
+
+/**
+ * Obtain the block cache counters (accumulated since tfs_init).
+ *
+ * Input:
+ *   - stats: destination
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_block_cache_stats(tfs_cache_stats_t *stats);
+
+/**
+ * Obtain the inode cache counters (accumulated since tfs_init).
+ *
+ * Each hit is a simulated storage access saved. Inodes are written through,
+ * so writebacks, flushed and prefetched are always 0.
+ *
+ * Input:
+ *   - stats: destination
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_inode_cache_stats(tfs_cache_stats_t *stats);
+
+/**
+ * Classes of locks whose contention is profiled.
+ */
+typedef enum {
+    TFS_LOCK_OPEN_FILE,       // per-handle offset locks
+    TFS_LOCK_INODE,           // per-inode rwlocks
+    TFS_LOCK_RANGE,           // byte ranges of the data being accessed
+    TFS_LOCK_DIR_NAMES,       // directory bucket name locks
+    TFS_LOCK_DIR_BUCKET,      // directory bucket rwlocks
+    TFS_LOCK_OPEN_FILE_TABLE, // open_file_table_rwlock
+    TFS_LOCK_ALLOC_TABLE,     // alloc_table_rwlock (inode allocation)
+    TFS_LOCK_DEFERRED,        // blocks waiting for the reclaimer
+    TFS_LOCK_BLOCK_TABLE,     // block_table_rwlock (block allocation)
+    TFS_LOCK_INODE_CACHE,     // inode cache
+    TFS_LOCK_BLOCK_CACHE,     // block cache buckets
+    TFS_LOCK_CLASS_COUNT,
+} tfs_lock_class_t;
+
+// Histograms of times have buckets of powers of two: bucket 0 counts times
+// under 1 us, bucket k times in [2^(k-1), 2^k) us, and the last bucket also
+// every longer time
+#define TFS_LOCK_HIST_BUCKETS (16)
+
+// Inodes whose locks were the most contended, reported by tfs_lock_stats
+#define TFS_LOCK_TOP_INODES (8)
+
+/**
+ * Contention of a class of locks.
+ */
+typedef struct {
+    size_t acquisitions;
+    size_t contended; // acquisitions that had to wait for another holder
+    size_t wait_hist[TFS_LOCK_HIST_BUCKETS]; // waits of contended ones
+    size_t hold_hist[TFS_LOCK_HIST_BUCKETS]; // times until released
+} tfs_lock_class_stats_t;
+
+typedef struct {
+    int inumber; // -1 if fewer inode locks were ever contended
+    size_t contended;
+} tfs_lock_inode_stats_t;
+
+/**
+ * Lock contention counters.
+ */
+typedef struct {
+    tfs_lock_class_stats_t classes[TFS_LOCK_CLASS_COUNT];
+    tfs_lock_inode_stats_t top_inodes[TFS_LOCK_TOP_INODES]; // most first
+} tfs_lock_stats_t;
+
+/**
+ * Obtain the lock contention counters (accumulated since tfs_init), if
+ * enabled with tfs_params.lock_stats.
+ *
+ * Input:
+ *   - stats: destination
+ *
+ * Returns 0 if successful, -1 otherwise (e.g., if profiling is disabled).
+ */
+int tfs_lock_stats(tfs_lock_stats_t *stats);
+
+/**
+ * Write a report of the lock contention counters (see tfs_lock_stats).
+ *
+ * Input:
+ *   - out: stream to write to
+ *
+ * Returns 0 if successful, -1 otherwise.
+ */
+int tfs_lock_stats_dump(FILE *out);
+
 #endif // OPERATIONS_H
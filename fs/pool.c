@@ -0,0 +1,346 @@
+#include "pool.h"
+#include "betterassert.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct pool_task {
+    pool_task_fn fn;
+    void* arg;
+    struct pool_task* next;
+} pool_task_t;
+
+/**
+ * Per-worker FIFO of pending tasks
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pool_task_t* head;
+    pool_task_t* tail;
+} pool_queue_t;
+
+/**
+ * Per-worker wakeup, so that submitting a task only disturbs the one idle
+ * worker it wakes
+ */
+typedef struct {
+    atomic_bool sleeping; // cleared by whoever claims the wakeup
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool woken;
+} pool_waiter_t;
+
+struct pool {
+    size_t n_workers;
+    pthread_t* workers;
+    pool_queue_t* queues;
+    pool_waiter_t* waiters;
+
+    atomic_size_t pending; // tasks submitted but not yet taken from a queue
+    atomic_size_t next_queue;
+    atomic_bool stopping;
+};
+
+typedef struct {
+    pool_t* pool;
+    size_t index;
+    pool_task_fn start;
+    void* start_arg;
+} pool_worker_arg_t;
+
+// Pool and queue index of the calling thread, if it is a pool worker
+static _Thread_local pool_t* current_pool;
+static _Thread_local size_t current_queue;
+
+static void queue_push(pool_queue_t* queue, pool_task_t* task) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail == NULL) {
+        queue->head = task;
+    } else {
+        queue->tail->next = task;
+    }
+    queue->tail = task;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static pool_task_t* queue_pop(pool_queue_t* queue) {
+    pthread_mutex_lock(&queue->lock);
+    pool_task_t* task = queue->head;
+    if (task != NULL) {
+        queue->head = task->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return task;
+}
+
+/**
+ * Take a task from the worker's own queue or, failing that, steal one from
+ * the other workers' queues.
+ */
+static pool_task_t* pool_take(pool_t* pool, size_t index) {
+    for (size_t i = 0; i < pool->n_workers; i++) {
+        pool_task_t* task =
+            queue_pop(&pool->queues[(index + i) % pool->n_workers]);
+        if (task != NULL) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Wake a worker, if it is sleeping (or about to).
+ *
+ * Returns true if this call claimed the worker's wakeup.
+ */
+static bool waiter_wake(pool_waiter_t* waiter) {
+    bool sleeping = true;
+    if (!atomic_compare_exchange_strong(&waiter->sleeping, &sleeping, false)) {
+        return false; // awake, or already being woken
+    }
+    pthread_mutex_lock(&waiter->lock);
+    waiter->woken = true;
+    pthread_cond_signal(&waiter->wake);
+    pthread_mutex_unlock(&waiter->lock);
+    return true;
+}
+
+/**
+ * Put an idle worker to sleep until a task is submitted or the pool stops.
+ */
+static void waiter_sleep(pool_t* pool, pool_waiter_t* waiter) {
+    atomic_store(&waiter->sleeping, true);
+    // a submitter that counted its task before the flag was set may not have
+    // seen it: check again before sleeping
+    if (atomic_load(&pool->pending) > 0 || atomic_load(&pool->stopping)) {
+        bool sleeping = true;
+        if (atomic_compare_exchange_strong(&waiter->sleeping, &sleeping,
+                                           false)) {
+            sched_yield(); // the task may still be on its way to a queue
+            return;
+        }
+        // otherwise a waker claimed the wakeup: consume it
+    }
+
+    pthread_mutex_lock(&waiter->lock);
+    while (!waiter->woken) {
+        pthread_cond_wait(&waiter->wake, &waiter->lock);
+    }
+    waiter->woken = false;
+    pthread_mutex_unlock(&waiter->lock);
+}
+
+/**
+ * Worker thread main loop: runs tasks until the pool is stopping and every
+ * queue has been drained.
+ */
+static void* pool_worker(void* arg) {
+    pool_worker_arg_t* worker = (pool_worker_arg_t*)arg;
+    pool_t* pool = worker->pool;
+    size_t index = worker->index;
+    if (worker->start != NULL) {
+        worker->start(worker->start_arg);
+    }
+    free(worker);
+
+    current_pool = pool;
+    current_queue = index;
+
+    while (true) {
+        pool_task_t* task = pool_take(pool, index);
+        if (task != NULL) {
+            atomic_fetch_sub(&pool->pending, 1);
+            task->fn(task->arg);
+            free(task);
+            continue;
+        }
+
+        if (atomic_load(&pool->stopping) && atomic_load(&pool->pending) == 0) {
+            break; // stopping, and nothing left to run
+        }
+        waiter_sleep(pool, &pool->waiters[index]);
+    }
+
+    return NULL;
+}
+
+/**
+ * Stop the workers of a pool, once every task already submitted has run, and
+ * free the pool.
+ *
+ * Input:
+ *   - pool: the worker pool
+ *   - n_started: number of workers that were started
+ */
+static void pool_stop(pool_t* pool, size_t n_started) {
+    atomic_store(&pool->stopping, true);
+    for (size_t i = 0; i < pool->n_workers; i++) {
+        waiter_wake(&pool->waiters[i]);
+    }
+    for (size_t i = 0; i < n_started; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    for (size_t i = 0; i < pool->n_workers; i++) {
+        ALWAYS_ASSERT(pthread_mutex_destroy(&pool->queues[i].lock) == 0,
+                      "pool_stop: error destroying a queue's mutex");
+        ALWAYS_ASSERT(pthread_cond_destroy(&pool->waiters[i].wake) == 0,
+                      "pool_stop: error destroying a worker's condvar");
+        ALWAYS_ASSERT(pthread_mutex_destroy(&pool->waiters[i].lock) == 0,
+                      "pool_stop: error destroying a worker's mutex");
+    }
+    free(pool->waiters);
+    free(pool->queues);
+    free(pool->workers);
+    free(pool);
+}
+
+/**
+ * Create a pool of worker threads.
+ *
+ * Input:
+ *   - n_workers: number of worker threads (must be positive)
+ *   - start: function each worker runs before its first task (or NULL),
+ *     e.g., to set up thread-local state
+ *   - start_arg: argument of start
+ *
+ * Returns the new pool, or NULL in case of error.
+ *
+ * Possible errors:
+ *   - n_workers is 0.
+ *   - malloc or thread creation failure.
+ */
+pool_t* pool_create(size_t n_workers, pool_task_fn start, void* start_arg) {
+    if (n_workers == 0) {
+        return NULL;
+    }
+
+    pool_t* pool = malloc(sizeof(pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->workers = malloc(n_workers * sizeof(pthread_t));
+    pool->queues = malloc(n_workers * sizeof(pool_queue_t));
+    pool->waiters = malloc(n_workers * sizeof(pool_waiter_t));
+    if (pool->workers == NULL || pool->queues == NULL ||
+        pool->waiters == NULL) {
+        free(pool->workers);
+        free(pool->queues);
+        free(pool->waiters);
+        free(pool);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < n_workers; i++) {
+        ALWAYS_ASSERT(pthread_mutex_init(&pool->queues[i].lock, NULL) == 0,
+                      "pool_create: error initializing a queue's mutex");
+        pool->queues[i].head = NULL;
+        pool->queues[i].tail = NULL;
+
+        pool_waiter_t* waiter = &pool->waiters[i];
+        ALWAYS_ASSERT(pthread_mutex_init(&waiter->lock, NULL) == 0,
+                      "pool_create: error initializing a worker's mutex");
+        ALWAYS_ASSERT(pthread_cond_init(&waiter->wake, NULL) == 0,
+                      "pool_create: error initializing a worker's condvar");
+        atomic_init(&waiter->sleeping, false);
+        waiter->woken = false;
+    }
+
+    // queues must exist before any worker starts stealing from them
+    pool->n_workers = n_workers;
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->next_queue, 0);
+    atomic_init(&pool->stopping, false);
+
+    for (size_t i = 0; i < n_workers; i++) {
+        pool_worker_arg_t* worker = malloc(sizeof(pool_worker_arg_t));
+        if (worker == NULL) {
+            pool_stop(pool, i);
+            return NULL;
+        }
+        worker->pool = pool;
+        worker->index = i;
+        worker->start = start;
+        worker->start_arg = start_arg;
+        if (pthread_create(&pool->workers[i], NULL, pool_worker, worker) !=
+            0) {
+            free(worker);
+            pool_stop(pool, i);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+/**
+ * Queue a task to be run by one of the pool's workers.
+ *
+ * Tasks submitted from a worker go to that worker's own queue; others are
+ * spread round-robin.
+ *
+ * Input:
+ *   - pool: the worker pool
+ *   - fn: function to run
+ *   - arg: argument passed to fn
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - The pool is being destroyed.
+ *   - malloc failure.
+ */
+int pool_submit(pool_t* pool, pool_task_fn fn, void* arg) {
+    pool_task_t* task = malloc(sizeof(pool_task_t));
+    if (task == NULL) {
+        return -1;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->next = NULL;
+
+    // counted before the check, so that workers of a stopping pool cannot
+    // exit while the task is on its way to a queue
+    atomic_fetch_add(&pool->pending, 1);
+    if (atomic_load(&pool->stopping)) {
+        atomic_fetch_sub(&pool->pending, 1);
+        free(task);
+        return -1;
+    }
+    size_t index;
+    if (current_pool == pool) {
+        index = current_queue;
+    } else {
+        index = atomic_fetch_add(&pool->next_queue, 1) % pool->n_workers;
+    }
+
+    queue_push(&pool->queues[index], task);
+    // wake the queue's worker if it sleeps, or else some other idle worker
+    // to steal the task
+    for (size_t i = 0; i < pool->n_workers; i++) {
+        if (waiter_wake(&pool->waiters[(index + i) % pool->n_workers])) {
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Number of worker threads of a pool.
+ */
+size_t pool_size(pool_t const* pool) { return pool->n_workers; }
+
+/**
+ * Destroy a pool, after running every task already submitted to it.
+ *
+ * Input:
+ *   - pool: the worker pool
+ */
+void pool_destroy(pool_t* pool) { pool_stop(pool, pool->n_workers); }
@@ -0,0 +1,19 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/**
+ * Fixed-size pool of worker threads. Each worker has its own task queue, and
+ * idle workers steal tasks from the queues of busy ones.
+ */
+typedef struct pool pool_t;
+
+typedef void (*pool_task_fn)(void* arg);
+
+pool_t* pool_create(size_t n_workers, pool_task_fn start, void* start_arg);
+int pool_submit(pool_t* pool, pool_task_fn fn, void* arg);
+size_t pool_size(pool_t const* pool);
+void pool_destroy(pool_t* pool);
+
+#endif // POOL_H
@@ -0,0 +1,148 @@
+#include "range_lock.h"
+#include "betterassert.h"
+
+#include <stdlib.h>
+
+void range_lock_init(range_lock_t* lock) {
+    ALWAYS_ASSERT(pthread_mutex_init(&lock->lock, NULL) == 0,
+                  "Error initializing a range lock mutex");
+    ALWAYS_ASSERT(pthread_cond_init(&lock->released, NULL) == 0,
+                  "Error initializing a range lock condvar");
+    lock->held = NULL;
+}
+
+void range_lock_destroy(range_lock_t* lock) {
+    ALWAYS_ASSERT(pthread_mutex_destroy(&lock->lock) == 0,
+                  "Error destroying a range lock mutex");
+    ALWAYS_ASSERT(pthread_cond_destroy(&lock->released) == 0,
+                  "Error destroying a range lock condvar");
+}
+
+static bool range_lock_conflicts(range_lock_t const* lock,
+                                 range_lock_entry_t const* entry) {
+    for (range_lock_entry_t const* held = lock->held; held != NULL;
+         held = held->next) {
+        bool overlap = held->start < entry->end && entry->start < held->end;
+        if (overlap && (held->exclusive || entry->exclusive)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Lock a byte range, waiting for conflicting ranges to be released.
+ *
+ * Input:
+ *   - lock: the range lock
+ *   - entry: where the range is recorded, until it is released
+ *   - start: first byte of the range
+ *   - len: length of the range (an empty range conflicts with nothing)
+ *   - exclusive: whether the range may be shared with other (shared) ones
+ *
+ * Returns whether the caller had to wait.
+ */
+bool range_lock_acquire(range_lock_t* lock, range_lock_entry_t* entry,
+                        size_t start, size_t len, bool exclusive) {
+    entry->start = start;
+    entry->end = start + len;
+    entry->exclusive = exclusive;
+
+    bool waited = false;
+    pthread_mutex_lock(&lock->lock);
+    while (range_lock_conflicts(lock, entry)) {
+        waited = true;
+        pthread_cond_wait(&lock->released, &lock->lock);
+    }
+    entry->next = lock->held;
+    lock->held = entry;
+    pthread_mutex_unlock(&lock->lock);
+    return waited;
+}
+
+// The caller must hold lock->lock
+static void range_lock_unlink(range_lock_t* lock, range_lock_entry_t* entry) {
+    range_lock_entry_t** link = &lock->held;
+    while (*link != entry) {
+        ALWAYS_ASSERT(*link != NULL, "range_lock: range not held");
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    pthread_cond_broadcast(&lock->released);
+}
+
+/**
+ * Release a range locked with range_lock_acquire.
+ *
+ * Input:
+ *   - lock: the range lock
+ *   - entry: the entry passed to range_lock_acquire
+ */
+void range_lock_release(range_lock_t* lock, range_lock_entry_t* entry) {
+    pthread_mutex_lock(&lock->lock);
+    range_lock_unlink(lock, entry);
+    pthread_mutex_unlock(&lock->lock);
+}
+
+/**
+ * Release a range held by a given owner, given its position.
+ *
+ * Input:
+ *   - lock: the range lock
+ *   - owner: the owner of the range
+ *   - start: first byte of the range
+ *   - len: length of the range
+ *
+ * Returns the entry of the range released (for the caller to dispose of), or
+ * NULL if the owner holds no such range.
+ */
+range_lock_entry_t* range_lock_release_owner(range_lock_t* lock,
+                                             void const* owner,
+                                             size_t start, size_t len) {
+    pthread_mutex_lock(&lock->lock);
+    range_lock_entry_t* entry = lock->held;
+    while (entry != NULL &&
+           (entry->owner != owner || entry->start != start ||
+            entry->end != start + len)) {
+        entry = entry->next;
+    }
+    if (entry != NULL) {
+        range_lock_unlink(lock, entry);
+    }
+    pthread_mutex_unlock(&lock->lock);
+    return entry;
+}
+
+/**
+ * Release every range held by a given owner.
+ *
+ * Input:
+ *   - lock: the range lock
+ *   - owner: the owner of the ranges
+ *
+ * Returns the entries of the ranges released, linked through their next
+ * field (for the caller to dispose of).
+ */
+range_lock_entry_t* range_lock_release_all(range_lock_t* lock,
+                                           void const* owner) {
+    range_lock_entry_t* released = NULL;
+
+    pthread_mutex_lock(&lock->lock);
+    range_lock_entry_t** link = &lock->held;
+    while (*link != NULL) {
+        range_lock_entry_t* entry = *link;
+        if (entry->owner == owner) {
+            *link = entry->next;
+            entry->next = released;
+            released = entry;
+        } else {
+            link = &entry->next;
+        }
+    }
+    if (released != NULL) {
+        pthread_cond_broadcast(&lock->released);
+    }
+    pthread_mutex_unlock(&lock->lock);
+
+    return released;
+}
@@ -0,0 +1,42 @@
+#ifndef RANGE_LOCK_H
+#define RANGE_LOCK_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A byte range held in a range lock. Entries are provided by the holders
+ * (they usually live on the holder's stack), so locking allocates nothing.
+ */
+typedef struct range_lock_entry {
+    size_t start;
+    size_t end; // exclusive
+    bool exclusive;
+    void const* owner; // identifies the holder, for range_lock_release_owner
+    struct range_lock_entry* next;
+} range_lock_entry_t;
+
+/**
+ * Lock over the byte ranges of a file: shared ranges may overlap each other,
+ * exclusive ones may not overlap any other range.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+    range_lock_entry_t* held;
+} range_lock_t;
+
+void range_lock_init(range_lock_t* lock);
+void range_lock_destroy(range_lock_t* lock);
+
+bool range_lock_acquire(range_lock_t* lock, range_lock_entry_t* entry,
+                        size_t start, size_t len, bool exclusive);
+void range_lock_release(range_lock_t* lock, range_lock_entry_t* entry);
+range_lock_entry_t* range_lock_release_owner(range_lock_t* lock,
+                                             void const* owner,
+                                             size_t start, size_t len);
+range_lock_entry_t* range_lock_release_all(range_lock_t* lock,
+                                           void const* owner);
+
+#endif // RANGE_LOCK_H
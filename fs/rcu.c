@@ -0,0 +1,132 @@
+#include "rcu.h"
+#include "betterassert.h"
+#include "instance.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#define RCU_SLOTS (64)
+#define CACHE_LINE (64)
+
+/**
+ * Read-side critical sections in progress in the threads using a slot, for
+ * each parity of the epoch. Threads beyond RCU_SLOTS share slots.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_uint readers[2];
+} rcu_slot_t;
+
+struct rcu_domain {
+    rcu_slot_t slots[RCU_SLOTS];
+    atomic_uint epoch;
+    atomic_uint next_slot;
+    pthread_mutex_t synchronize_lock;
+};
+typedef struct rcu_domain rcu_domain_t;
+
+// The slot of the calling thread, in the domain it last used
+static _Thread_local rcu_domain_t const* thread_domain;
+static _Thread_local size_t thread_slot;
+
+// The RCU domain of the calling thread's instance
+static rcu_domain_t* rcu_domain(void) { return instance_current()->rcu; }
+
+static rcu_slot_t* my_slot(rcu_domain_t* rcu) {
+    if (thread_domain != rcu) {
+        thread_domain = rcu;
+        thread_slot = atomic_fetch_add(&rcu->next_slot, 1) % RCU_SLOTS;
+    }
+    return &rcu->slots[thread_slot];
+}
+
+/**
+ * Initialize the RCU domain of the calling thread's instance.
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - malloc failure.
+ */
+int rcu_init(void) {
+    rcu_domain_t* rcu = aligned_alloc(CACHE_LINE, sizeof(rcu_domain_t));
+    if (rcu == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < RCU_SLOTS; i++) {
+        atomic_init(&rcu->slots[i].readers[0], 0);
+        atomic_init(&rcu->slots[i].readers[1], 0);
+    }
+    atomic_init(&rcu->epoch, 0);
+    atomic_init(&rcu->next_slot, 0);
+    ALWAYS_ASSERT(pthread_mutex_init(&rcu->synchronize_lock, NULL) == 0,
+                  "rcu_init: error initializing mutex");
+    instance_current()->rcu = rcu;
+    return 0;
+}
+
+/**
+ * Destroy the RCU domain of the calling thread's instance.
+ */
+void rcu_destroy(void) {
+    rcu_domain_t* rcu = rcu_domain();
+    ALWAYS_ASSERT(pthread_mutex_destroy(&rcu->synchronize_lock) == 0,
+                  "rcu_destroy: error destroying mutex");
+    free(rcu);
+    instance_current()->rcu = NULL;
+}
+
+/**
+ * Enter a read-side critical section. Data retired before it started is not
+ * reused until rcu_read_unlock is called.
+ *
+ * Returns the epoch to pass to rcu_read_unlock.
+ */
+unsigned rcu_read_lock(void) {
+    rcu_domain_t* rcu = rcu_domain();
+    rcu_slot_t* slot = my_slot(rcu);
+    for (;;) {
+        unsigned parity = atomic_load(&rcu->epoch) & 1;
+        atomic_fetch_add(&slot->readers[parity], 1);
+        if ((atomic_load(&rcu->epoch) & 1) == parity) {
+            return parity;
+        }
+        // a grace period started meanwhile, and may not be waiting for us
+        atomic_fetch_sub(&slot->readers[parity], 1);
+    }
+}
+
+/**
+ * Leave a read-side critical section.
+ *
+ * Input:
+ *   - parity: epoch returned by the matching rcu_read_lock
+ */
+void rcu_read_unlock(unsigned parity) {
+    atomic_fetch_sub(&my_slot(rcu_domain())->readers[parity], 1);
+}
+
+static void wait_for_readers(rcu_domain_t* rcu, unsigned parity) {
+    for (size_t i = 0; i < RCU_SLOTS; i++) {
+        while (atomic_load(&rcu->slots[i].readers[parity]) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * Wait for a grace period: every read-side critical section in progress when
+ * called has ended when this returns.
+ */
+void rcu_synchronize(void) {
+    rcu_domain_t* rcu = rcu_domain();
+    pthread_mutex_lock(&rcu->synchronize_lock);
+    unsigned parity = atomic_load(&rcu->epoch) & 1;
+    // late readers of the previous grace period, which saw the old epoch
+    wait_for_readers(rcu, parity ^ 1);
+    atomic_fetch_add(&rcu->epoch, 1);
+    wait_for_readers(rcu, parity);
+    pthread_mutex_unlock(&rcu->synchronize_lock);
+}
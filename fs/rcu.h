@@ -0,0 +1,20 @@
+#ifndef RCU_H
+#define RCU_H
+
+/**
+ * Read-copy-update style synchronization: readers run without locks, and
+ * writers wait for a grace period (all readers that may still see some data
+ * to finish) before reusing that data.
+ *
+ * Each instance has an RCU domain of its own. In it, each thread counts its
+ * read-side critical sections in its own slot, split by the parity of the
+ * domain's epoch. A grace period flips the epoch and waits for the count of
+ * the previous parity to drop to 0.
+ */
+int rcu_init(void);
+void rcu_destroy(void);
+unsigned rcu_read_lock(void);
+void rcu_read_unlock(unsigned parity);
+void rcu_synchronize(void);
+
+#endif // RCU_H
@@ -0,0 +1,353 @@
+#include "ring.h"
+#include "betterassert.h"
+#include "instance.h"
+#include "pool.h"
+#include "state.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct tfs_ring {
+    size_t entries;
+
+    // Submission ring (only touched by the submitting thread)
+    tfs_sqe_t* sq;
+    size_t sq_head;
+    size_t sq_tail;
+
+    // Completion ring
+    tfs_cqe_t* cq;
+    size_t cq_head;
+    size_t cq_tail;
+
+    // Requests submitted but not yet reaped
+    size_t outstanding;
+
+    pthread_mutex_t lock;
+    pthread_cond_t completed;
+
+    pool_t* pool;
+};
+
+/**
+ * Requests that must run in order on the same worker, as a single task.
+ */
+typedef struct {
+    tfs_ring_t* ring;
+    size_t count;
+    tfs_sqe_t sqes[];
+} ring_group_t;
+
+typedef struct {
+    uint64_t key;
+    size_t seq;
+} ring_key_t;
+
+#define RING_KEY_FHANDLE (1ULL << 32)
+#define RING_KEY_NAME (2ULL << 32)
+#define RING_KEY_NOP (3ULL << 32)
+
+static uint32_t name_hash(char const* name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (; name != NULL && *name != '\0'; name++) {
+        hash ^= (uint8_t)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Key that requests which must be ordered among themselves have in common.
+ */
+static uint64_t sqe_key(tfs_sqe_t const* sqe, size_t seq) {
+    switch (sqe->opcode) {
+    case TFS_OP_CLOSE:
+    case TFS_OP_READ:
+    case TFS_OP_WRITE:
+        return RING_KEY_FHANDLE | (uint32_t)sqe->fhandle;
+    case TFS_OP_OPEN:
+    case TFS_OP_UNLINK:
+        return RING_KEY_NAME | name_hash(sqe->name);
+    case TFS_OP_NOP:
+    default:
+        return RING_KEY_NOP | (uint32_t)seq;
+    }
+}
+
+static int ring_key_cmp(void const* a, void const* b) {
+    ring_key_t const* ka = a;
+    ring_key_t const* kb = b;
+    if (ka->key != kb->key) {
+        return ka->key < kb->key ? -1 : 1;
+    }
+    return ka->seq < kb->seq ? -1 : (ka->seq > kb->seq);
+}
+
+static void ring_complete(tfs_ring_t* ring, uint64_t user_data,
+                          ssize_t result) {
+    pthread_mutex_lock(&ring->lock);
+    tfs_cqe_t* cqe = &ring->cq[ring->cq_tail % ring->entries];
+    cqe->user_data = user_data;
+    cqe->result = result;
+    ring->cq_tail++;
+    pthread_cond_broadcast(&ring->completed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+static bool is_rw(tfs_sqe_t const* sqe) {
+    return sqe->opcode == TFS_OP_READ || sqe->opcode == TFS_OP_WRITE;
+}
+
+/**
+ * Run a sequence of reads/writes on the same file handle, paying for the
+ * inode access and its lock only once.
+ */
+static void ring_run_rw(tfs_ring_t* ring, tfs_sqe_t const* sqes,
+                        size_t count) {
+    open_file_entry_t* file = get_open_file_entry(sqes[0].fhandle);
+    if (file == NULL) {
+        for (size_t i = 0; i < count; i++) {
+            ring_complete(ring, sqes[i].user_data, -1);
+        }
+        return;
+    }
+
+    open_permission_t permission = READ_ONLY;
+    for (size_t i = 0; i < count; i++) {
+        if (sqes[i].opcode == TFS_OP_WRITE) {
+            permission = READ_WRITE;
+        }
+    }
+
+    inode_t* inode = inode_get(file->of_inumber);
+    ALWAYS_ASSERT(inode != NULL, "ring_run_rw: inode of open file deleted");
+    if (inode->i_node_type != T_FILE) {
+        // directory handle
+        for (size_t i = 0; i < count; i++) {
+            ring_complete(ring, sqes[i].user_data, -1);
+        }
+        return;
+    }
+    open_file_lock(file);
+    inode_lock(inode, permission);
+
+    for (size_t i = 0; i < count; i++) {
+        ssize_t result;
+        if (sqes[i].opcode == TFS_OP_WRITE) {
+            if (file->of_append) {
+                file->of_offset = inode->i_size;
+            }
+            result = inode_write_at(inode, file->of_offset, sqes[i].buffer,
+                                    sqes[i].len);
+        } else {
+            result = (ssize_t)inode_read_at(inode, file->of_offset,
+                                            sqes[i].buffer, sqes[i].len);
+        }
+        if (result > 0) {
+            file->of_offset += (size_t)result;
+        }
+        ring_complete(ring, sqes[i].user_data, result);
+    }
+
+    inode_unlock(inode);
+    open_file_unlock(file);
+}
+
+static ssize_t ring_run_single(tfs_sqe_t const* sqe) {
+    switch (sqe->opcode) {
+    case TFS_OP_OPEN:
+        return tfs_open(sqe->name, sqe->mode);
+    case TFS_OP_CLOSE:
+        return tfs_close(sqe->fhandle);
+    case TFS_OP_UNLINK:
+        return tfs_unlink(sqe->name);
+    case TFS_OP_NOP:
+        return 0;
+    case TFS_OP_READ:
+    case TFS_OP_WRITE:
+    default:
+        return -1;
+    }
+}
+
+static void ring_run_group(void* arg) {
+    ring_group_t* group = (ring_group_t*)arg;
+
+    size_t i = 0;
+    while (i < group->count) {
+        if (is_rw(&group->sqes[i])) {
+            size_t end = i + 1;
+            while (end < group->count && is_rw(&group->sqes[end])) {
+                end++;
+            }
+            ring_run_rw(group->ring, &group->sqes[i], end - i);
+            i = end;
+        } else {
+            ring_complete(group->ring, group->sqes[i].user_data,
+                          ring_run_single(&group->sqes[i]));
+            i++;
+        }
+    }
+
+    free(group);
+}
+
+tfs_ring_t* tfs_ring_create(size_t entries, size_t n_workers) {
+    if (entries == 0) {
+        return NULL;
+    }
+
+    tfs_ring_t* ring = malloc(sizeof(tfs_ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    ring->entries = entries;
+    ring->sq = malloc(entries * sizeof(tfs_sqe_t));
+    ring->cq = malloc(entries * sizeof(tfs_cqe_t));
+    ring->pool = pool_create(n_workers, instance_bind, instance_current());
+    if (ring->sq == NULL || ring->cq == NULL || ring->pool == NULL) {
+        if (ring->pool != NULL) {
+            pool_destroy(ring->pool);
+        }
+        free(ring->sq);
+        free(ring->cq);
+        free(ring);
+        return NULL;
+    }
+
+    ring->sq_head = 0;
+    ring->sq_tail = 0;
+    ring->cq_head = 0;
+    ring->cq_tail = 0;
+    ring->outstanding = 0;
+
+    ALWAYS_ASSERT(pthread_mutex_init(&ring->lock, NULL) == 0,
+                  "tfs_ring_create: error initializing the ring's mutex");
+    ALWAYS_ASSERT(pthread_cond_init(&ring->completed, NULL) == 0,
+                  "tfs_ring_create: error initializing the ring's condvar");
+
+    return ring;
+}
+
+void tfs_ring_destroy(tfs_ring_t* ring) {
+    pool_destroy(ring->pool);
+
+    ALWAYS_ASSERT(pthread_cond_destroy(&ring->completed) == 0,
+                  "tfs_ring_destroy: error destroying the ring's condvar");
+    ALWAYS_ASSERT(pthread_mutex_destroy(&ring->lock) == 0,
+                  "tfs_ring_destroy: error destroying the ring's mutex");
+    free(ring->sq);
+    free(ring->cq);
+    free(ring);
+}
+
+tfs_sqe_t* tfs_ring_get_sqe(tfs_ring_t* ring) {
+    size_t pending = ring->sq_tail - ring->sq_head;
+
+    pthread_mutex_lock(&ring->lock);
+    bool full = pending + ring->outstanding >= ring->entries;
+    pthread_mutex_unlock(&ring->lock);
+    if (full) {
+        return NULL;
+    }
+
+    tfs_sqe_t* sqe = &ring->sq[ring->sq_tail % ring->entries];
+    memset(sqe, 0, sizeof(tfs_sqe_t));
+    ring->sq_tail++;
+    return sqe;
+}
+
+int tfs_ring_submit(tfs_ring_t* ring) {
+    size_t pending = ring->sq_tail - ring->sq_head;
+    if (pending == 0) {
+        return 0;
+    }
+
+    ring_key_t* keys = malloc(pending * sizeof(ring_key_t));
+    if (keys == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < pending; i++) {
+        tfs_sqe_t const* sqe = &ring->sq[(ring->sq_head + i) % ring->entries];
+        keys[i].key = sqe_key(sqe, i);
+        keys[i].seq = i;
+    }
+    // requests with the same key become adjacent, in submission order
+    qsort(keys, pending, sizeof(ring_key_t), ring_key_cmp);
+
+    pthread_mutex_lock(&ring->lock);
+    ring->outstanding += pending;
+    pthread_mutex_unlock(&ring->lock);
+
+    size_t start = 0;
+    while (start < pending) {
+        size_t end = start + 1;
+        while (end < pending && keys[end].key == keys[start].key) {
+            end++;
+        }
+
+        size_t count = end - start;
+        ring_group_t* group =
+            malloc(sizeof(ring_group_t) + count * sizeof(tfs_sqe_t));
+        if (group == NULL) {
+            for (size_t i = start; i < end; i++) {
+                ring_complete(ring,
+                              ring->sq[(ring->sq_head + keys[i].seq) %
+                                       ring->entries]
+                                  .user_data,
+                              -1);
+            }
+        } else {
+            group->ring = ring;
+            group->count = count;
+            for (size_t i = 0; i < count; i++) {
+                size_t seq = keys[start + i].seq;
+                group->sqes[i] =
+                    ring->sq[(ring->sq_head + seq) % ring->entries];
+            }
+
+            if (pool_submit(ring->pool, ring_run_group, group) == -1) {
+                for (size_t i = 0; i < count; i++) {
+                    ring_complete(ring, group->sqes[i].user_data, -1);
+                }
+                free(group);
+            }
+        }
+
+        start = end;
+    }
+
+    ring->sq_head = ring->sq_tail;
+    free(keys);
+    return (int)pending;
+}
+
+size_t tfs_ring_reap(tfs_ring_t* ring, tfs_cqe_t* cqes, size_t max,
+                     size_t min_complete) {
+    pthread_mutex_lock(&ring->lock);
+
+    if (min_complete > ring->outstanding) {
+        min_complete = ring->outstanding;
+    }
+    if (min_complete > max) {
+        min_complete = max;
+    }
+    while (ring->cq_tail - ring->cq_head < min_complete) {
+        pthread_cond_wait(&ring->completed, &ring->lock);
+    }
+
+    size_t reaped = 0;
+    while (reaped < max && ring->cq_head != ring->cq_tail) {
+        cqes[reaped++] = ring->cq[ring->cq_head % ring->entries];
+        ring->cq_head++;
+    }
+    ring->outstanding -= reaped;
+
+    pthread_mutex_unlock(&ring->lock);
+    return reaped;
+}
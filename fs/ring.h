@@ -0,0 +1,116 @@
+#ifndef RING_H
+#define RING_H
+
+#include "operations.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * TécnicoFS batched operations.
+ *
+ * A client queues requests in a submission ring (tfs_ring_get_sqe), hands
+ * them to the engine in one go (tfs_ring_submit) and later reaps their results
+ * from a completion ring (tfs_ring_reap).
+ *
+ * Submitted requests run on the ring's worker threads. Requests on the same
+ * file handle, or on the same path name, run in submission order, and
+ * consecutive reads/writes on the same file handle are coalesced under a
+ * single inode access. There is no ordering between any other requests.
+ *
+ * A ring must only be used for submissions by one thread at a time.
+ */
+typedef struct tfs_ring tfs_ring_t;
+
+typedef enum {
+    TFS_OP_NOP,
+    TFS_OP_OPEN,
+    TFS_OP_CLOSE,
+    TFS_OP_READ,
+    TFS_OP_WRITE,
+    TFS_OP_UNLINK,
+} tfs_op_t;
+
+/**
+ * Submission queue entry.
+ *
+ * Fields used by each operation:
+ *   - TFS_OP_OPEN: name, mode
+ *   - TFS_OP_CLOSE: fhandle
+ *   - TFS_OP_READ: fhandle, buffer, len
+ *   - TFS_OP_WRITE: fhandle, buffer, len
+ *   - TFS_OP_UNLINK: name
+ *
+ * name and buffer must remain valid until the request completes.
+ */
+typedef struct {
+    tfs_op_t opcode;
+    int fhandle;
+    char const *name;
+    tfs_file_mode_t mode;
+    void *buffer;
+    size_t len;
+
+    uint64_t user_data; // copied, untouched, to the completion entry
+} tfs_sqe_t;
+
+/**
+ * Completion queue entry.
+ *
+ * result holds what the equivalent synchronous call would have returned
+ * (e.g., the file handle for TFS_OP_OPEN, the byte count for TFS_OP_READ).
+ */
+typedef struct {
+    uint64_t user_data;
+    ssize_t result;
+} tfs_cqe_t;
+
+/**
+ * Create a ring. Its requests run on the instance of the calling thread.
+ *
+ * Input:
+ *   - entries: maximum number of requests queued or in flight at once
+ *   - n_workers: number of worker threads processing the requests
+ *
+ * Returns the new ring, or NULL in case of error.
+ */
+tfs_ring_t *tfs_ring_create(size_t entries, size_t n_workers);
+
+/**
+ * Destroy a ring, waiting for all submitted requests to finish first.
+ * Unreaped completions are discarded.
+ */
+void tfs_ring_destroy(tfs_ring_t *ring);
+
+/**
+ * Get the next free submission queue entry, to be filled by the caller.
+ *
+ * Returns a zeroed entry, or NULL if the ring is full (reap some completions
+ * first).
+ */
+tfs_sqe_t *tfs_ring_get_sqe(tfs_ring_t *ring);
+
+/**
+ * Submit every entry queued since the previous call.
+ *
+ * Returns the number of requests submitted, or -1 in case of error.
+ */
+int tfs_ring_submit(tfs_ring_t *ring);
+
+/**
+ * Reap completed requests.
+ *
+ * Input:
+ *   - ring: the ring
+ *   - cqes: destination array for the completion entries
+ *   - max: length of cqes
+ *   - min_complete: minimum number of entries to wait for (capped at the
+ *     number of requests in flight)
+ *
+ * Returns the number of completion entries copied to cqes.
+ */
+size_t tfs_ring_reap(tfs_ring_t *ring, tfs_cqe_t *cqes, size_t max,
+                     size_t min_complete);
+
+#endif // RING_H
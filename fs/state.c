@@ -1,87 +1,274 @@
 #include "state.h"
 #include "betterassert.h"
+#include "block_cache.h"
+#include "instance.h"
+#include "latency.h"
+#include "lock_stats.h"
+#include "rcu.h"
 
+#include <errno.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 /*
- * Persistent FS state
- * (in reality, it should be maintained in secondary memory;
- * for simplicity, this project maintains it in primary memory).
+ * Lock order (a thread only takes a lock ranked after every lock it holds):
+ *   1. the offset lock of an open file entry, one at a time
+ *   2. inode locks, in increasing inumber order
+ *   3. byte ranges of an inode it holds locked, one at a time
+ *   4. directory bucket name locks, one at a time
+ *   5. directory bucket locks, one at a time
+ *   6. open_file_table_rwlock
+ *   7. alloc_table_rwlock
+ *   8. deferred_lock
+ *   9. block_table_rwlock
+ * The locks of the inode cache, the block cache, the latency model and the
+ * grace periods of rcu.c are only held for short sections that take no other
+ * lock of this list. Ranges locked with tfs_lock_range are advisory, and
+ * held across calls: threads never wait for them while holding a lock.
+ *
+ * The ranks of the locks held by each thread are tracked, so that taking a
+ * lock out of order aborts right away instead of deadlocking some day.
  */
-static tfs_params fs_params;
+typedef enum {
+    RANK_OPEN_FILE,
+    RANK_INODE,
+    RANK_RANGE,
+    RANK_DIR_NAMES,
+    RANK_DIR_BUCKET,
+    RANK_OPEN_FILE_TABLE,
+    RANK_ALLOC_TABLE,
+    RANK_DEFERRED,
+    RANK_BLOCK_TABLE,
+    RANK_COUNT,
+} lock_rank_t;
+
+static _Thread_local unsigned locks_held[RANK_COUNT];
+
+static void lock_rank_acquire(lock_rank_t rank) {
+    for (size_t r = rank + 1; r < RANK_COUNT; r++) {
+        ALWAYS_ASSERT(locks_held[r] == 0, "lock order violated");
+    }
+    // several inodes may be locked at once (in inumber order)
+    ALWAYS_ASSERT(rank == RANK_INODE || locks_held[rank] == 0,
+                  "lock order violated: lock taken twice");
+    locks_held[rank]++;
+}
+
+static void lock_rank_release(lock_rank_t rank) {
+    ALWAYS_ASSERT(locks_held[rank] > 0, "lock released but not held");
+    locks_held[rank]--;
+}
 
-// Inode table
-static inode_t* inode_table;
-static allocation_state_t* freeinode_ts;
-pthread_rwlock_t alloc_table_rwlock;
+// The reclaimer frees blocks once this many are deferred, or periodically
+#define RECLAIM_BATCH (64)
+#define RECLAIM_INTERVAL_MS (10)
 
-// Data blocks
-static char* fs_data; // # blocks * block size
-static allocation_state_t* free_blocks;
-pthread_rwlock_t block_table_rwlock;
+/*
+ * Inode cache: which inodes are resident in (simulated) memory, so that
+ * accesses to them skip the simulated storage latency. Pinned inodes (those
+ * of open files, and the root directory) are never evicted; the others are
+ * replaced with the CLOCK policy once the cache is full.
+ */
+typedef struct {
+    bool resident;
+    bool referenced;
+    int pins;
+} icache_entry_t;
 
 /*
- * Volatile FS state
+ * Directory entries are partitioned into buckets of consecutive slots, each
+ * with its own lock, so that operations on names of different buckets run in
+ * parallel. A name is stored in the bucket its hash selects (its home), or,
+ * if that one is full, in the first bucket after it with a free slot. The
+ * bucket locks are shared by all directories (only the root one exists).
+ *
+ * Only writers take the bucket locks: lookups read the entries inside RCU
+ * read-side critical sections. A removed entry is marked DIR_ENTRY_RETIRED
+ * and keeps its name until a grace period has passed, when its slot can be
+ * reused.
+ *
+ * Entries are only added while holding the names lock of their home bucket,
+ * so that a name is never added twice, wherever its entries are stored.
  */
-static open_file_entry_t* open_file_table;
-static allocation_state_t* free_open_file_entries;
-pthread_rwlock_t open_file_table_rwlock;
+#define DIR_BUCKETS (8)
+#define DIR_ENTRY_RETIRED (-2)
+
+typedef struct {
+    pthread_rwlock_t lock;
+    pthread_mutex_t names; // held to add entries of names of this home
+    atomic_size_t overflow; // entries of this home stored in other buckets
+} dir_bucket_t;
 
-// Convenience macros
-#define INODE_TABLE_SIZE (fs_params.max_inode_count)
-#define DATA_BLOCKS (fs_params.max_block_count)
-#define MAX_OPEN_FILES (fs_params.max_open_files_count)
-#define BLOCK_SIZE (fs_params.block_size)
+/*
+ * FS state of an instance
+ */
+struct fs_state {
+    tfs_params fs_params;
+
+    /*
+     * Persistent FS state
+     * (in reality, it should be maintained in secondary memory;
+     * for simplicity, this project maintains it in primary memory).
+     */
+
+    // Inode table
+    inode_t* inode_table;
+    allocation_state_t* freeinode_ts;
+    pthread_rwlock_t alloc_table_rwlock;
+
+    // Data blocks
+    char* fs_data; // # blocks * block size
+    allocation_state_t* free_blocks;
+    pthread_rwlock_t block_table_rwlock;
+
+    // Blocks released by files, still TAKEN until the reclaimer frees them.
+    // Lock order: deferred_lock before block_table_rwlock.
+    int* deferred_blocks;
+    size_t deferred_count;
+    pthread_mutex_t deferred_lock;
+    pthread_cond_t deferred_cond;
+    pthread_t reclaimer;
+    bool reclaimer_stopping;
+
+    /*
+     * Volatile FS state
+     */
+    open_file_entry_t* open_file_table;
+    allocation_state_t* free_open_file_entries;
+    pthread_rwlock_t open_file_table_rwlock;
+
+    icache_entry_t* icache; // NULL if the cache is disabled
+    size_t icache_resident;
+    size_t icache_hand;
+    size_t icache_hits;
+    size_t icache_misses;
+    size_t icache_evictions;
+    pthread_mutex_t icache_lock;
+
+    dir_bucket_t dir_buckets[DIR_BUCKETS];
+};
+typedef struct fs_state fs_state_t;
+
+// The FS state of the calling thread's instance
+static fs_state_t* fs_state(void) { return instance_current()->state; }
+
+// Convenience macros (for functions with the FS state in fs)
+#define INODE_TABLE_SIZE (fs->fs_params.max_inode_count)
+#define DATA_BLOCKS (fs->fs_params.max_block_count)
+#define MAX_OPEN_FILES (fs->fs_params.max_open_files_count)
+#define BLOCK_SIZE (fs->fs_params.block_size)
 #define MAX_DIR_ENTRIES (BLOCK_SIZE / sizeof(dir_entry_t))
 
 static inline bool valid_inumber(int inumber) {
+    fs_state_t* fs = fs_state();
     return inumber >= 0 && inumber < INODE_TABLE_SIZE;
 }
 
 static inline bool valid_block_number(int block_number) {
+    fs_state_t* fs = fs_state();
     return block_number >= 0 && block_number < DATA_BLOCKS;
 }
 
 static inline bool valid_file_handle(int file_handle) {
+    fs_state_t* fs = fs_state();
     return file_handle >= 0 && file_handle < MAX_OPEN_FILES;
 }
 
-size_t state_block_size(void) { return BLOCK_SIZE; }
+/*
+ * Private open file tables (see tfs_private_files). A thread's table is only
+ * ever touched by that thread, so it needs no lock. Its handles start at
+ * PRIVATE_HANDLE_BASE, past those of the instance's table.
+ */
+#define PRIVATE_HANDLE_BASE (1 << 24)
+
+typedef struct {
+    fs_state_t* fs; // state of the instance the table belongs to
+    size_t size;
+    size_t open; // entries in use
+    open_file_entry_t* entries;
+    allocation_state_t* free_entries;
+} private_file_table_t;
+
+static _Thread_local private_file_table_t* private_files;
+
+size_t state_block_size(void) {
+    fs_state_t* fs = fs_state();
+    return BLOCK_SIZE;
+}
 
 /**
- * Do nothing, while preventing the compiler from performing any optimizations.
- *
- * We need to defeat the optimizer for the insert_delay() function.
- * Under optimization, the empty loop would be completely optimized away.
- * This function tells the compiler that the assembly code being run (which is
- * none) might potentially change *all memory in the process*.
- *
- * This prevents the optimizer from optimizing this code away, because it does
- * not know what it does and it may have side effects.
+ * Artifically delay execution.
  *
- * Reference with more information: https://youtu.be/nXaxk27zwlk?t=2775
- *
- * Exercise: try removing this function and look at the assembly generated to
- * compare.
+ * Auxiliary function to insert a delay.
+ * Used in accesses to persistent FS metadata as a way of emulating access
+ * latencies as if such data structures were really stored in secondary memory
+ * (data blocks go through latency_wait(DEV_DATA, ...) instead).
  */
-static void touch_all_memory(void) { __asm volatile("" : : : "memory"); }
+static void insert_delay(void) { latency_wait(DEV_METADATA, 0); }
 
 /**
- * Artifically delay execution (busy loop).
+ * Return every deferred block to the allocator, in a single pass over
+ * free_blocks.
  *
- * Auxiliary function to insert a delay.
- * Used in accesses to persistent FS state as a way of emulating access
- * latencies as if such data structures were really stored in secondary memory.
+ * The caller must hold deferred_lock.
+ */
+static void reclaim_deferred_blocks(void) {
+    fs_state_t* fs = fs_state();
+    if (fs->deferred_count == 0) {
+        return;
+    }
+
+    insert_delay(); // simulate storage access delay to free_blocks
+
+    lock_rank_acquire(RANK_BLOCK_TABLE);
+    profiled_wrlock(&fs->block_table_rwlock, TFS_LOCK_BLOCK_TABLE);
+    for (size_t i = 0; i < fs->deferred_count; i++) {
+        block_cache_invalidate(fs->deferred_blocks[i]);
+        fs->free_blocks[fs->deferred_blocks[i]] = FREE;
+    }
+    profiled_rwlock_unlock(&fs->block_table_rwlock, TFS_LOCK_BLOCK_TABLE);
+    lock_rank_release(RANK_BLOCK_TABLE);
+
+    fs->deferred_count = 0;
+}
+
+/**
+ * Background block reclaimer: frees deferred blocks in batches.
  */
-static void insert_delay(void) {
-    for (int i = 0; i < DELAY; i++) {
-        touch_all_memory();
+static void* reclaimer_fn(void* arg) {
+    instance_bind(arg);
+    fs_state_t* fs = fs_state();
+
+    lock_rank_acquire(RANK_DEFERRED);
+    profiled_mutex_lock(&fs->deferred_lock, TFS_LOCK_DEFERRED);
+    while (!fs->reclaimer_stopping) {
+        if (fs->deferred_count < RECLAIM_BATCH) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += RECLAIM_INTERVAL_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            // the lock is not held while waiting
+            lock_stats_released(TFS_LOCK_DEFERRED, &fs->deferred_lock);
+            pthread_cond_timedwait(&fs->deferred_cond, &fs->deferred_lock,
+                                   &deadline);
+            lock_stats_acquired(TFS_LOCK_DEFERRED, &fs->deferred_lock, false,
+                                lock_stats_clock());
+        }
+        reclaim_deferred_blocks();
     }
+    profiled_mutex_unlock(&fs->deferred_lock, TFS_LOCK_DEFERRED);
+    lock_rank_release(RANK_DEFERRED);
+
+    return NULL;
 }
 
 /**
@@ -97,51 +284,128 @@ static void insert_delay(void) {
  *   - malloc failure when allocating TFS structures.
  */
 int state_init(tfs_params params) {
-    fs_params = params;
-
-    if (inode_table != NULL) {
+    if (fs_state() != NULL) {
         return -1; // already initialized
     }
 
-    inode_table = malloc(INODE_TABLE_SIZE * sizeof(inode_t));
-    freeinode_ts = malloc(INODE_TABLE_SIZE * sizeof(allocation_state_t));
+    if (params.max_open_files_count > PRIVATE_HANDLE_BASE) {
+        return -1; // handles would overlap those of private tables
+    }
+
+    if (latency_init(&params.latency) != 0) {
+        return -1; // invalid latency model
+    }
+    if (lock_stats_init(params.lock_stats, params.max_inode_count) != 0) {
+        latency_destroy();
+        return -1;
+    }
+    if (rcu_init() != 0) {
+        lock_stats_destroy();
+        latency_destroy();
+        return -1;
+    }
+
+    fs_state_t* fs = calloc(1, sizeof(fs_state_t));
+    if (fs == NULL) {
+        return -1;
+    }
+    instance_current()->state = fs;
+    fs->fs_params = params;
+
+    fs->inode_table = malloc(INODE_TABLE_SIZE * sizeof(inode_t));
+    fs->freeinode_ts = malloc(INODE_TABLE_SIZE * sizeof(allocation_state_t));
 
-    ALWAYS_ASSERT(pthread_rwlock_init(&alloc_table_rwlock, NULL) == 0,
+    ALWAYS_ASSERT(pthread_rwlock_init(&fs->alloc_table_rwlock, NULL) == 0,
         "Error initializing inode allocation table rwlock");
 
-    fs_data = malloc(DATA_BLOCKS * BLOCK_SIZE);
-    free_blocks = malloc(DATA_BLOCKS * sizeof(allocation_state_t));
+    fs->fs_data = malloc(DATA_BLOCKS * BLOCK_SIZE);
+    fs->free_blocks = malloc(DATA_BLOCKS * sizeof(allocation_state_t));
+    fs->deferred_blocks = malloc(DATA_BLOCKS * sizeof(int));
+    fs->deferred_count = 0;
 
-    ALWAYS_ASSERT(pthread_rwlock_init(&block_table_rwlock, NULL) == 0,
+    ALWAYS_ASSERT(pthread_rwlock_init(&fs->block_table_rwlock, NULL) == 0,
         "Error initializing inode allocation table rwlock");
 
-    open_file_table = malloc(MAX_OPEN_FILES * sizeof(open_file_entry_t));
+    fs->open_file_table = malloc(MAX_OPEN_FILES * sizeof(open_file_entry_t));
 
-    ALWAYS_ASSERT(pthread_rwlock_init(&open_file_table_rwlock, NULL) == 0,
+    ALWAYS_ASSERT(pthread_rwlock_init(&fs->open_file_table_rwlock, NULL) == 0,
         "Error initializing inode allocation table rwlock");
 
-    free_open_file_entries =
+    fs->free_open_file_entries =
         malloc(MAX_OPEN_FILES * sizeof(allocation_state_t));
 
-    if (!inode_table || !freeinode_ts || !fs_data || !free_blocks ||
-        !open_file_table || !free_open_file_entries) {
+    if (!fs->inode_table || !fs->freeinode_ts || !fs->fs_data ||
+        !fs->free_blocks || !fs->deferred_blocks || !fs->open_file_table ||
+        !fs->free_open_file_entries) {
         return -1; // allocation failed
     }
 
+    for (size_t i = 0; i < MAX_OPEN_FILES; i++) {
+        ALWAYS_ASSERT(
+            pthread_mutex_init(&fs->open_file_table[i].of_lock, NULL) == 0,
+            "Error initializing an open file entry's mutex");
+    }
+
     for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
-        inode_table[i].rwlock =
-            (pthread_rwlock_t*)malloc(sizeof(pthread_rwlock_t));
-            ALWAYS_ASSERT(pthread_rwlock_init(inode_table[i].rwlock, NULL) == 0,
+        inode_t* inode = &fs->inode_table[i];
+        inode->rwlock = (pthread_rwlock_t*)malloc(sizeof(pthread_rwlock_t));
+            ALWAYS_ASSERT(pthread_rwlock_init(inode->rwlock, NULL) == 0,
                 "Error initializing an inode's rwlock");
-        freeinode_ts[i] = FREE;
+        inode->ranges = malloc(sizeof(range_lock_t));
+        inode->advisory = malloc(sizeof(range_lock_t));
+        if (!inode->ranges || !inode->advisory) {
+            return -1; // allocation failed
+        }
+        range_lock_init(inode->ranges);
+        range_lock_init(inode->advisory);
+        atomic_init(&inode->i_seq, 0);
+        atomic_init(&inode->i_overwriters, 0);
+        fs->freeinode_ts[i] = FREE;
     }
 
     for (size_t i = 0; i < DATA_BLOCKS; i++) {
-        free_blocks[i] = FREE;
+        fs->free_blocks[i] = FREE;
     }
 
     for (size_t i = 0; i < MAX_OPEN_FILES; i++) {
-        free_open_file_entries[i] = FREE;
+        fs->free_open_file_entries[i] = FREE;
+    }
+
+    ALWAYS_ASSERT(pthread_mutex_init(&fs->deferred_lock, NULL) == 0,
+                  "Error initializing deferred blocks mutex");
+    ALWAYS_ASSERT(pthread_cond_init(&fs->deferred_cond, NULL) == 0,
+                  "Error initializing deferred blocks condvar");
+    if (block_cache_init(params.block_cache_size, params.block_size) != 0) {
+        return -1;
+    }
+
+    // the reclaimer works on the instance being initialized
+    fs->reclaimer_stopping = false;
+    ALWAYS_ASSERT(pthread_create(&fs->reclaimer, NULL, reclaimer_fn,
+                                 instance_current()) == 0,
+                  "Error creating the block reclaimer thread");
+
+    ALWAYS_ASSERT(pthread_mutex_init(&fs->icache_lock, NULL) == 0,
+                  "Error initializing inode cache mutex");
+    fs->icache_resident = 0;
+    fs->icache_hand = 0;
+    fs->icache_hits = 0;
+    fs->icache_misses = 0;
+    fs->icache_evictions = 0;
+    fs->icache = NULL;
+    if (params.inode_cache_size > 0) {
+        fs->icache = calloc(INODE_TABLE_SIZE, sizeof(icache_entry_t));
+        if (fs->icache == NULL) {
+            return -1;
+        }
+    }
+
+    for (size_t b = 0; b < DIR_BUCKETS; b++) {
+        ALWAYS_ASSERT(pthread_rwlock_init(&fs->dir_buckets[b].lock, NULL) == 0,
+                      "Error initializing a directory bucket rwlock");
+        ALWAYS_ASSERT(pthread_mutex_init(&fs->dir_buckets[b].names, NULL) == 0,
+                      "Error initializing a directory bucket mutex");
+        atomic_store(&fs->dir_buckets[b].overflow, 0);
     }
 
     return 0;
@@ -153,41 +417,278 @@ int state_init(tfs_params params) {
  * Returns 0 if succesful, -1 otherwise.
  */
 int state_destroy(void) {
+    fs_state_t* fs = fs_state();
+    if (fs == NULL) {
+        return -1; // not initialized
+    }
+
+    // stopping the block reclaimer
+    lock_rank_acquire(RANK_DEFERRED);
+    profiled_mutex_lock(&fs->deferred_lock, TFS_LOCK_DEFERRED);
+    fs->reclaimer_stopping = true;
+    pthread_cond_signal(&fs->deferred_cond);
+    profiled_mutex_unlock(&fs->deferred_lock, TFS_LOCK_DEFERRED);
+    lock_rank_release(RANK_DEFERRED);
+    pthread_join(fs->reclaimer, NULL);
+    ALWAYS_ASSERT(pthread_cond_destroy(&fs->deferred_cond) == 0,
+                  "Error destroying deferred blocks condvar");
+    ALWAYS_ASSERT(pthread_mutex_destroy(&fs->deferred_lock) == 0,
+                  "Error destroying deferred blocks mutex");
+    free(fs->deferred_blocks);
+
+    block_cache_destroy();
+
+    ALWAYS_ASSERT(pthread_mutex_destroy(&fs->icache_lock) == 0,
+                  "Error destroying inode cache mutex");
+    free(fs->icache);
+    fs->icache = NULL;
+
+    for (size_t b = 0; b < DIR_BUCKETS; b++) {
+        ALWAYS_ASSERT(pthread_rwlock_destroy(&fs->dir_buckets[b].lock) == 0,
+                      "Error destroying a directory bucket rwlock");
+        ALWAYS_ASSERT(pthread_mutex_destroy(&fs->dir_buckets[b].names) == 0,
+                      "Error destroying a directory bucket mutex");
+    }
+
     // destroying inode table
     for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
-        ALWAYS_ASSERT(pthread_rwlock_destroy(inode_table[i].rwlock) == 0,
+        ALWAYS_ASSERT(pthread_rwlock_destroy(fs->inode_table[i].rwlock) == 0,
             "Error deleting an inode's rwlock");
+        range_lock_destroy(fs->inode_table[i].ranges);
+        range_lock_destroy(fs->inode_table[i].advisory);
+        free(fs->inode_table[i].ranges);
+        free(fs->inode_table[i].advisory);
     }
-    free(inode_table);
+    free(fs->inode_table);
 
     // destroying inode allocation table
-    ALWAYS_ASSERT(pthread_rwlock_destroy(&alloc_table_rwlock) == 0,
+    ALWAYS_ASSERT(pthread_rwlock_destroy(&fs->alloc_table_rwlock) == 0,
         "Error initializing inode allocation table rwlock");
-    free(freeinode_ts);
+    free(fs->freeinode_ts);
 
     // destroying datablocks and their allocation table
-    ALWAYS_ASSERT(pthread_rwlock_destroy(&block_table_rwlock) == 0,
+    ALWAYS_ASSERT(pthread_rwlock_destroy(&fs->block_table_rwlock) == 0,
         "Error initializing inode allocation table rwlock");
-    free(fs_data);
-    free(free_blocks);
+    free(fs->fs_data);
+    free(fs->free_blocks);
     //
     // destroying open file table and its allocation table
-    ALWAYS_ASSERT(pthread_rwlock_destroy(&open_file_table_rwlock) == 0,
+    ALWAYS_ASSERT(pthread_rwlock_destroy(&fs->open_file_table_rwlock) == 0,
         "Error initializing inode allocation table rwlock");
-    free(open_file_table);
-    free(free_open_file_entries);
+    for (size_t i = 0; i < MAX_OPEN_FILES; i++) {
+        ALWAYS_ASSERT(
+            pthread_mutex_destroy(&fs->open_file_table[i].of_lock) == 0,
+            "Error destroying an open file entry's mutex");
+    }
+    free(fs->open_file_table);
+    free(fs->free_open_file_entries);
 
+    free(fs);
+    instance_current()->state = NULL;
 
-    inode_table = NULL;
-    freeinode_ts = NULL;
-    fs_data = NULL;
-    free_blocks = NULL;
-    open_file_table = NULL;
-    free_open_file_entries = NULL;
+    latency_destroy();
+    lock_stats_destroy();
+    rcu_destroy();
 
     return 0;
 }
 
+/**
+ * Make room in the inode cache, evicting an unpinned inode if it is full.
+ *
+ * Pinned inodes always stay resident, even if that makes the cache go over
+ * its size. The caller must hold icache_lock.
+ */
+static void icache_make_room(void) {
+    fs_state_t* fs = fs_state();
+    if (fs->icache_resident < fs->fs_params.inode_cache_size) {
+        return;
+    }
+
+    // CLOCK: two passes are enough to find an entry with no second chance
+    for (size_t n = 0; n < 2 * INODE_TABLE_SIZE; n++) {
+        icache_entry_t* entry = &fs->icache[fs->icache_hand];
+        fs->icache_hand = (fs->icache_hand + 1) % INODE_TABLE_SIZE;
+        if (!entry->resident || entry->pins > 0) {
+            continue;
+        }
+        if (entry->referenced) {
+            entry->referenced = false;
+            continue;
+        }
+
+        entry->resident = false;
+        fs->icache_resident--;
+        fs->icache_evictions++;
+        return;
+    }
+}
+
+/**
+ * Record an access to an inode, loading it into the inode cache on a miss.
+ *
+ * Input:
+ *   - inumber: inode's number
+ *
+ * Returns true on a cache hit, false on a miss (the caller must then pay for
+ * reading the inode from storage).
+ */
+static bool icache_access(int inumber) {
+    fs_state_t* fs = fs_state();
+    if (fs->icache == NULL) {
+        return false;
+    }
+
+    profiled_mutex_lock(&fs->icache_lock, TFS_LOCK_INODE_CACHE);
+    icache_entry_t* entry = &fs->icache[inumber];
+    bool hit = entry->resident;
+    if (hit) {
+        fs->icache_hits++;
+    } else {
+        fs->icache_misses++;
+        icache_make_room();
+        entry->resident = true;
+        fs->icache_resident++;
+    }
+    entry->referenced = true;
+    profiled_mutex_unlock(&fs->icache_lock, TFS_LOCK_INODE_CACHE);
+
+    return hit;
+}
+
+/**
+ * Drop a freed inode from the inode cache.
+ *
+ * Input:
+ *   - inumber: inode's number
+ */
+static void icache_drop(int inumber) {
+    fs_state_t* fs = fs_state();
+    if (fs->icache == NULL) {
+        return;
+    }
+
+    profiled_mutex_lock(&fs->icache_lock, TFS_LOCK_INODE_CACHE);
+    if (fs->icache[inumber].resident) {
+        fs->icache[inumber].resident = false;
+        fs->icache[inumber].referenced = false;
+        fs->icache_resident--;
+    }
+    profiled_mutex_unlock(&fs->icache_lock, TFS_LOCK_INODE_CACHE);
+}
+
+/**
+ * Access an inode, paying the storage latency unless it is cached.
+ *
+ * The root directory is pinned while the FS is mounted, so it always hits:
+ * its accesses, part of almost every operation, skip icache_lock.
+ *
+ * Input:
+ *   - inumber: inode's number
+ */
+static void inode_load(int inumber) {
+    fs_state_t* fs = fs_state();
+    if (inumber == ROOT_DIR_INUM && fs->icache != NULL) {
+        return;
+    }
+    if (!icache_access(inumber)) {
+        insert_delay(); // simulate storage access delay to inode
+    }
+}
+
+static int inode_number(inode_t const* inode) {
+    fs_state_t* fs = fs_state();
+    return (int)(inode - fs->inode_table);
+}
+
+// Like the lock, the sequence counter is not part of the inode's contents
+static atomic_uint* inode_seq(inode_t const* inode) {
+    return (atomic_uint*)&inode->i_seq;
+}
+
+// Lock a byte range of the data of an inode the caller holds locked
+static void inode_range_acquire(inode_t const* inode, range_lock_entry_t* range,
+                                size_t offset, size_t len, bool exclusive) {
+    lock_rank_acquire(RANK_RANGE);
+    range->owner = NULL; // not released by owner
+    uint64_t since = lock_stats_clock();
+    bool waited =
+        range_lock_acquire(inode->ranges, range, offset, len, exclusive);
+    lock_stats_acquired(TFS_LOCK_RANGE, range, waited, since);
+}
+
+static void inode_range_release(inode_t const* inode,
+                                range_lock_entry_t* range) {
+    lock_stats_released(TFS_LOCK_RANGE, range);
+    range_lock_release(inode->ranges, range);
+    lock_rank_release(RANK_RANGE);
+}
+
+/**
+ * Pin an inode in the inode cache, so it is never evicted (loading it if
+ * needed).
+ *
+ * Input:
+ *   - inumber: inode's number
+ */
+void inode_pin(int inumber) {
+    fs_state_t* fs = fs_state();
+    ALWAYS_ASSERT(valid_inumber(inumber), "inode_pin: invalid inumber");
+    if (fs->icache == NULL) {
+        return;
+    }
+
+    profiled_mutex_lock(&fs->icache_lock, TFS_LOCK_INODE_CACHE);
+    fs->icache[inumber].pins++;
+    profiled_mutex_unlock(&fs->icache_lock, TFS_LOCK_INODE_CACHE);
+
+    inode_load(inumber);
+}
+
+/**
+ * Release a pin taken with inode_pin.
+ *
+ * Input:
+ *   - inumber: inode's number
+ */
+void inode_unpin(int inumber) {
+    fs_state_t* fs = fs_state();
+    ALWAYS_ASSERT(valid_inumber(inumber), "inode_unpin: invalid inumber");
+    if (fs->icache == NULL) {
+        return;
+    }
+
+    profiled_mutex_lock(&fs->icache_lock, TFS_LOCK_INODE_CACHE);
+    ALWAYS_ASSERT(fs->icache[inumber].pins > 0,
+                  "inode_unpin: inode not pinned");
+    fs->icache[inumber].pins--;
+    profiled_mutex_unlock(&fs->icache_lock, TFS_LOCK_INODE_CACHE);
+}
+
+/**
+ * Collect the inode cache's counters.
+ *
+ * Inodes are written through, so there are never write-backs.
+ *
+ * Input:
+ *   - stats: destination
+ */
+void inode_cache_stats(tfs_cache_stats_t* stats) {
+    fs_state_t* fs = fs_state();
+    profiled_mutex_lock(&fs->icache_lock, TFS_LOCK_INODE_CACHE);
+    stats->hits = fs->icache_hits;
+    stats->misses = fs->icache_misses;
+    stats->evictions = fs->icache_evictions;
+    profiled_mutex_unlock(&fs->icache_lock, TFS_LOCK_INODE_CACHE);
+    stats->writebacks = 0;
+    stats->flushed = 0;
+    stats->prefetched = 0;
+
+    size_t accesses = stats->hits + stats->misses;
+    stats->hit_ratio =
+        accesses > 0 ? (double)stats->hits / (double)accesses : 0.0;
+}
+
 /**
  * (Try to) Allocate a new inode in the inode table, without initializing its
  * data.
@@ -198,25 +699,33 @@ int state_destroy(void) {
  *   - No free slots in inode table.
  */
 static int inode_alloc(void) {
-    for (size_t inumber = 0; inumber < INODE_TABLE_SIZE; inumber++) {
-        if ((inumber * sizeof(allocation_state_t) % BLOCK_SIZE) == 0) {
-            insert_delay(); // simulate storage access delay (to freeinode_ts)
-        }
-
-        pthread_rwlock_wrlock(&alloc_table_rwlock);
-        // Finds first free entry in inode table
-        if (freeinode_ts[inumber] == FREE) {
+    fs_state_t* fs = fs_state();
+    int found = -1;
+    size_t inumber = 0;
+
+    lock_rank_acquire(RANK_ALLOC_TABLE);
+    profiled_wrlock(&fs->alloc_table_rwlock, TFS_LOCK_ALLOC_TABLE);
+    // Finds first free entry in inode table
+    for (; inumber < INODE_TABLE_SIZE; inumber++) {
+        if (fs->freeinode_ts[inumber] == FREE) {
             //  Found a free entry, so takes it for the new inode
-            freeinode_ts[inumber] = TAKEN;
-
-            pthread_rwlock_unlock(&alloc_table_rwlock);
-            return (int)inumber;
+            fs->freeinode_ts[inumber] = TAKEN;
+            found = (int)inumber;
+            break;
         }
     }
+    profiled_rwlock_unlock(&fs->alloc_table_rwlock, TFS_LOCK_ALLOC_TABLE);
+    lock_rank_release(RANK_ALLOC_TABLE);
+
+    // simulate storage access delay to the blocks of freeinode_ts scanned,
+    // outside of the lock so that allocations do not queue behind it
+    size_t scanned = inumber < INODE_TABLE_SIZE ? inumber + 1 : inumber;
+    size_t per_block = BLOCK_SIZE / sizeof(allocation_state_t);
+    for (size_t b = 0; b < (scanned + per_block - 1) / per_block; b++) {
+        insert_delay();
+    }
 
-    pthread_rwlock_unlock(&alloc_table_rwlock);
-    // no free inodes
-    return -1;
+    return found; // -1 if there are no free inodes
 }
 
 /**
@@ -227,6 +736,9 @@ static int inode_alloc(void) {
  * set to BLOCK_SIZE. Regular files will not have their data block allocated
  * (i_size will be set to 0, i_data_block to -1).
  *
+ * A file holds a data block if and only if i_data_block != -1, which may be
+ * the case while i_size is still 0 (see inode_reserve_block).
+ *
  * Input:
  *   - i_type: the type of the node (file or directory)
  *
@@ -237,13 +749,14 @@ static int inode_alloc(void) {
  *   - (if creating a directory) No free data blocks.
  */
 int inode_create(inode_type i_type) {
+    fs_state_t* fs = fs_state();
     int inumber = inode_alloc();
     if (inumber == -1) {
         return -1; // no free slots in inode table
     }
 
-    inode_t* inode = &inode_table[inumber];
-    insert_delay(); // simulate storage access delay (to inode)
+    inode_t* inode = &fs->inode_table[inumber];
+    inode_load(inumber);
 
     inode->i_node_type = i_type;
     switch (i_type) {
@@ -255,31 +768,32 @@ int inode_create(inode_type i_type) {
             // ensure fields are initialized
             inode->i_size = 0;
             inode->i_data_block = -1;
-            inode->hard_link_counter = 1;
+            atomic_store(&inode->hard_link_counter, 1);
 
             // run regular deletion process
             inode_delete(inumber);
             return -1;
         }
 
-        inode_table[inumber].i_size = BLOCK_SIZE;
-        inode_table[inumber].i_data_block = b;
-        inode_table[inumber].hard_link_counter = 1;
+        fs->inode_table[inumber].i_size = BLOCK_SIZE;
+        fs->inode_table[inumber].i_data_block = b;
+        atomic_store(&fs->inode_table[inumber].hard_link_counter, 1);
 
         dir_entry_t* dir_entry = (dir_entry_t*)data_block_get(b);
         ALWAYS_ASSERT(dir_entry != NULL,
                       "inode_create: data block freed while in use");
 
         for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-            dir_entry[i].d_inumber = -1;
+            atomic_init(&dir_entry[i].d_inumber, -1);
         }
+        data_block_mark_dirty(b);
     } break;
     case T_FILE:
     case T_SYM_LINK:
         // In case of a new file, simply sets its size to 0
-        inode_table[inumber].i_size = 0;
-        inode_table[inumber].i_data_block = -1;
-        inode_table[inumber].hard_link_counter = 1;
+        fs->inode_table[inumber].i_size = 0;
+        fs->inode_table[inumber].i_data_block = -1;
+        atomic_store(&fs->inode_table[inumber].hard_link_counter, 1);
         break;
     default:
         PANIC("inode_create: unknown file type");
@@ -292,203 +806,695 @@ int inode_create(inode_type i_type) {
  * Delete an inode if and only if there are no more hard-links pointing to it.
  * Otherwise, only decreases its hard-link counter.
  *
+ * Only the caller that drops the counter to 0 takes any lock, and it never
+ * holds the inode's lock and alloc_table_rwlock at the same time. Once the
+ * counter is 0, no directory entry names the inode, so nobody else can reach
+ * it anymore (except through handles that were already open).
+ *
  * Input:
  *   - inumber: inode's number
  */
 void inode_delete(int inumber) {
-    // simulate storage access delay (to inode and freeinode_ts)
-    insert_delay();
-    insert_delay();
-
+    fs_state_t* fs = fs_state();
     ALWAYS_ASSERT(valid_inumber(inumber), "inode_delete: invalid inumber");
 
-    // TODO: Probably this needs to be made with try-locks, so there is no
-    //       chance on interlock.
+    inode_t* inode = &fs->inode_table[inumber];
+    inode_load(inumber);
 
-    inode_lock(&inode_table[inumber], READ_WRITE);
-    pthread_rwlock_wrlock(&alloc_table_rwlock);
-    inode_table[inumber].hard_link_counter--;
-    // only deletes the inode if there are no more hard-links to it
-    if (inode_table[inumber].hard_link_counter == 0) {
-        ALWAYS_ASSERT(freeinode_ts[inumber] == TAKEN,
-                      "inode_delete: inode already freed");
+    int links = atomic_fetch_sub(&inode->hard_link_counter, 1);
+    ALWAYS_ASSERT(links > 0, "inode_delete: inode already deleted");
+    if (links > 1) {
+        return; // other hard-links remain
+    }
 
-        freeinode_ts[inumber] = FREE;
-        if (inode_table[inumber].i_size > 0) {
-            data_block_free(inode_table[inumber].i_data_block);
-        }
+    // the data block is released before the inode can be reused
+    inode_lock(inode, READ_WRITE);
+    if (inode->i_node_type != T_SYM_LINK) {
+        inode_release_block(inode);
     }
-    inode_unlock(&inode_table[inumber]);
-    pthread_rwlock_unlock(&alloc_table_rwlock);
+    inode_unlock(inode);
+
+    insert_delay(); // simulate storage access delay to freeinode_ts
+    icache_drop(inumber);
+
+    lock_rank_acquire(RANK_ALLOC_TABLE);
+    profiled_wrlock(&fs->alloc_table_rwlock, TFS_LOCK_ALLOC_TABLE);
+    ALWAYS_ASSERT(fs->freeinode_ts[inumber] == TAKEN,
+                  "inode_delete: inode already freed");
+    fs->freeinode_ts[inumber] = FREE;
+    profiled_rwlock_unlock(&fs->alloc_table_rwlock, TFS_LOCK_ALLOC_TABLE);
+    lock_rank_release(RANK_ALLOC_TABLE);
 }
 
 /**
- * Obtain a pointer to an inode from its inumber.
+ * Add a hard-link to an inode, unless it is being deleted.
  *
  * Input:
  *   - inumber: inode's number
  *
- * Returns pointer to inode.
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - The inode has no hard-links left (its last one was just removed).
  */
-inode_t* inode_get(int inumber) {
-    ALWAYS_ASSERT(valid_inumber(inumber), "inode_get: invalid inumber");
+int inode_add_link(int inumber) {
+    fs_state_t* fs = fs_state();
+    ALWAYS_ASSERT(valid_inumber(inumber), "inode_add_link: invalid inumber");
+
+    atomic_int* counter = &fs->inode_table[inumber].hard_link_counter;
+    int links = atomic_load(counter);
+    do {
+        if (links == 0) {
+            return -1; // being deleted: it must not come back
+        }
+    } while (!atomic_compare_exchange_weak(counter, &links, links + 1));
 
-    insert_delay(); // simulate storage access delay to inode
-    return &inode_table[inumber];
+    return 0;
 }
 
 /**
- * Clear the directory entry associated with a sub file.
+ * Obtain a pointer to an inode from its inumber.
  *
  * Input:
- *   - inode: directory inode
- *   - sub_name: sub file name
- *
- * Returns 0 if successful, -1 otherwise.
+ *   - inumber: inode's number
  *
- * Possible errors:
- *   - inode is not a directory inode.
- *   - Directory does not contain an entry for sub_name.
+ * Returns pointer to inode.
  */
-int clear_dir_entry(inode_t* inode, char const* sub_name) {
-    insert_delay();
-    if (inode->i_node_type != T_DIRECTORY) {
-        return -1; // not a directory
-    }
+inode_t* inode_get(int inumber) {
+    fs_state_t* fs = fs_state();
+    ALWAYS_ASSERT(valid_inumber(inumber), "inode_get: invalid inumber");
 
-    inode_lock(inode, READ_WRITE);
-    // Locates the block containing the entries of the directory
-    dir_entry_t* dir_entry = (dir_entry_t*)data_block_get(inode->i_data_block);
-    ALWAYS_ASSERT(dir_entry != NULL,
-                  "clear_dir_entry: directory must have a data block");
+    inode_load(inumber);
+    return &fs->inode_table[inumber];
+}
 
-    for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-        if (!strcmp(dir_entry[i].d_name, sub_name)) {
-            dir_entry[i].d_inumber = -1;
-            memset(dir_entry[i].d_name, 0, MAX_FILE_NAME);
-            inode_unlock(inode);
-            return 0;
-        }
-    }
-    inode_unlock(inode);
-    return -1; // sub_name not found
+typedef struct {
+    int inumber;
+    size_t index;
+} inode_ref_t;
+
+static int inode_ref_cmp(void const* a, void const* b) {
+    inode_ref_t const* ra = a;
+    inode_ref_t const* rb = b;
+    return (ra->inumber > rb->inumber) - (ra->inumber < rb->inumber);
 }
 
 /**
- * Store the inumber for a sub file in a directory.
+ * Obtain pointers to several inodes at once.
+ *
+ * The inodes are fetched in inumber order, so inodes stored in the same
+ * block of the inode table cost a single storage access.
  *
  * Input:
- *   - inode: directory inode
- *   - sub_name: sub file name
- *   - sub_inumber: inumber of the sub inode
+ *   - inumbers: inode numbers
+ *   - count: length of inumbers
+ *   - inodes: destination array, filled in the same order as inumbers
  *
  * Returns 0 if successful, -1 otherwise.
  *
  * Possible errors:
- *   - inode is not a directory inode.
- *   - sub_name is not a valid file name (length 0 or > MAX_FILE_NAME - 1).
- *   - Directory is already full of entries.
+ *   - malloc failure.
  */
-int add_dir_entry(inode_t* inode, char const* sub_name, int sub_inumber) {
-    if (strlen(sub_name) == 0 || strlen(sub_name) > MAX_FILE_NAME - 1) {
-        return -1; // invalid sub_name
+int inode_get_batch(int const* inumbers, size_t count, inode_t** inodes) {
+    fs_state_t* fs = fs_state();
+    inode_ref_t* refs = malloc(count * sizeof(inode_ref_t));
+    if (refs == NULL && count > 0) {
+        return -1;
     }
 
-    insert_delay(); // simulate storage access delay to inode with inumber
-    if (inode->i_node_type != T_DIRECTORY) {
-        return -1; // not a directory
+    for (size_t i = 0; i < count; i++) {
+        ALWAYS_ASSERT(valid_inumber(inumbers[i]),
+                      "inode_get_batch: invalid inumber");
+        refs[i].inumber = inumbers[i];
+        refs[i].index = i;
     }
+    qsort(refs, count, sizeof(inode_ref_t), inode_ref_cmp);
 
-    inode_lock(inode, READ_WRITE);
-    // Locates the block containing the entries of the directory
-    dir_entry_t* dir_entry = (dir_entry_t*)data_block_get(inode->i_data_block);
-    ALWAYS_ASSERT(dir_entry != NULL,
-                  "add_dir_entry: directory must have a data block");
-
-    // Finds and fills the first empty entry
-    for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-        if (dir_entry[i].d_inumber == -1) {
-            dir_entry[i].d_inumber = sub_inumber;
-            strncpy(dir_entry[i].d_name, sub_name, MAX_FILE_NAME - 1);
-            dir_entry[i].d_name[MAX_FILE_NAME - 1] = '\0';
+    size_t inodes_per_block = BLOCK_SIZE / sizeof(inode_t);
+    if (inodes_per_block == 0) {
+        inodes_per_block = 1;
+    }
 
-            inode_unlock(inode);
-            return 0;
+    // only blocks holding uncached inodes are read from storage
+    for (size_t i = 0; i < count;) {
+        size_t block = (size_t)refs[i].inumber / inodes_per_block;
+        bool miss = false;
+        for (; i < count &&
+               (size_t)refs[i].inumber / inodes_per_block == block;
+             i++) {
+            miss |= !icache_access(refs[i].inumber);
+            inodes[refs[i].index] = &fs->inode_table[refs[i].inumber];
+        }
+        if (miss) {
+            insert_delay(); // simulate storage access delay to inode block
         }
     }
 
-    inode_unlock(inode);
-    return -1; // no space for entry
+    free(refs);
+    return 0;
 }
 
-/**
- * Obtain the inumber for a sub file inside a directory.
- *
- * Input:
- *   - inode: directory inode
- *   - sub_name: sub file name
- *
- * Returns inumber linked to the target name, -1 if errors occur.
- *
- * Possible errors:
- *   - inode is not a directory inode.
- *   - Directory does not contain a file named sub_name.
- */
-int find_in_dir(inode_t const* inode, char const* sub_name) {
-    ALWAYS_ASSERT(inode != NULL, "find_in_dir: inode must be non-NULL");
-    ALWAYS_ASSERT(sub_name != NULL, "find_in_dir: sub_name must be non-NULL");
+static size_t dir_bucket_count(void) {
+    fs_state_t* fs = fs_state();
+    return MAX_DIR_ENTRIES < DIR_BUCKETS ? MAX_DIR_ENTRIES : DIR_BUCKETS;
+}
 
-    insert_delay(); // simulate storage access delay to inode with inumber
-    if (inode->i_node_type != T_DIRECTORY) {
-        return -1; // not a directory
+// First slot of a bucket (bucket dir_bucket_count() is the end of the last)
+static size_t dir_bucket_first(size_t bucket) {
+    fs_state_t* fs = fs_state();
+    return bucket * MAX_DIR_ENTRIES / dir_bucket_count();
+}
+
+// Home bucket of a name (FNV-1a hash)
+static size_t dir_bucket_of(char const* name) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < MAX_FILE_NAME - 1 && name[i] != '\0'; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
     }
+    return hash % dir_bucket_count();
+}
 
-    inode_lock(inode, READ_ONLY);
-    // Locates the block containing the entries of the directory
-    dir_entry_t* dir_entry = (dir_entry_t*)data_block_get(inode->i_data_block);
-    ALWAYS_ASSERT(dir_entry != NULL,
-                  "find_in_dir: directory inode must have a data block");
+static void dir_bucket_lock(size_t bucket, open_permission_t access) {
+    fs_state_t* fs = fs_state();
+    lock_rank_acquire(RANK_DIR_BUCKET);
+    if (access == READ_ONLY) {
+        profiled_rdlock(&fs->dir_buckets[bucket].lock, TFS_LOCK_DIR_BUCKET);
+        return;
+    }
+    profiled_wrlock(&fs->dir_buckets[bucket].lock, TFS_LOCK_DIR_BUCKET);
+}
 
-    // Iterates over the directory entries looking for one that has the
-    // target name
-    for (int i = 0; i < MAX_DIR_ENTRIES; i++)
-        if ((dir_entry[i].d_inumber != -1) &&
-            (strncmp(dir_entry[i].d_name, sub_name, MAX_FILE_NAME) == 0)) {
+static void dir_bucket_unlock(size_t bucket) {
+    fs_state_t* fs = fs_state();
+    profiled_rwlock_unlock(&fs->dir_buckets[bucket].lock, TFS_LOCK_DIR_BUCKET);
+    lock_rank_release(RANK_DIR_BUCKET);
+}
 
-            int sub_inumber = dir_entry[i].d_inumber;
-            inode_unlock(inode);
-            return sub_inumber;
-        }
+static void dir_names_lock(size_t home) {
+    fs_state_t* fs = fs_state();
+    lock_rank_acquire(RANK_DIR_NAMES);
+    profiled_mutex_lock(&fs->dir_buckets[home].names, TFS_LOCK_DIR_NAMES);
+}
 
-    inode_unlock(inode);
-    return -1; // entry not found
+static void dir_names_unlock(size_t home) {
+    fs_state_t* fs = fs_state();
+    profiled_mutex_unlock(&fs->dir_buckets[home].names, TFS_LOCK_DIR_NAMES);
+    lock_rank_release(RANK_DIR_NAMES);
 }
 
 /**
- * Allocate a new data block.
+ * Look for a name in a bucket of a directory.
  *
- * Returns block number/index if successful, -1 otherwise.
+ * The caller must hold the bucket's lock, or be in an RCU read-side critical
+ * section.
+ *
+ * Input:
+ *   - entries: the directory's entries
+ *   - bucket: bucket to look in
+ *   - sub_name: sub file name
+ *   - sub_inumber: where to store the inumber of the entry, if found
+ *
+ * Returns the slot holding sub_name, -1 if the bucket has no such entry.
+ */
+static ssize_t dir_bucket_find(dir_entry_t const* entries, size_t bucket,
+                               char const* sub_name, int* sub_inumber) {
+    for (size_t i = dir_bucket_first(bucket); i < dir_bucket_first(bucket + 1);
+         i++) {
+        // the name is complete once its entry is published
+        int inumber =
+            atomic_load_explicit(&entries[i].d_inumber, memory_order_acquire);
+        if (inumber >= 0 &&
+            strncmp(entries[i].d_name, sub_name, MAX_FILE_NAME) == 0) {
+            *sub_inumber = inumber;
+            return (ssize_t)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Look for a name in a bucket of a directory, and for a free slot in it, in
+ * a single pass.
+ *
+ * The caller must hold the bucket's lock for writing.
+ *
+ * Input:
+ *   - entries: the directory's entries
+ *   - bucket: bucket to look in
+ *   - sub_name: sub file name
+ *   - sub_inumber: where to store the inumber of the entry, if found
+ *   - free_slot: where to store the first free slot (-1 if there is none),
+ *     if sub_name is not found
+ *
+ * Returns the slot holding sub_name, -1 if the bucket has no such entry.
+ */
+static ssize_t dir_bucket_scan(dir_entry_t const* entries, size_t bucket,
+                               char const* sub_name, int* sub_inumber,
+                               ssize_t* free_slot) {
+    *free_slot = -1;
+    for (size_t i = dir_bucket_first(bucket); i < dir_bucket_first(bucket + 1);
+         i++) {
+        int inumber =
+            atomic_load_explicit(&entries[i].d_inumber, memory_order_relaxed);
+        if (inumber == -1 && *free_slot == -1) {
+            *free_slot = (ssize_t)i;
+        } else if (inumber >= 0 &&
+                   strncmp(entries[i].d_name, sub_name, MAX_FILE_NAME) == 0) {
+            *sub_inumber = inumber;
+            return (ssize_t)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find a free slot in a bucket of a directory. If there is none, the slots
+ * of removed entries are reclaimed, after waiting for a grace period.
+ *
+ * The caller must hold the bucket's lock for writing.
+ *
+ * Input:
+ *   - entries: the directory's entries
+ *   - bucket: bucket to look in
+ *
+ * Returns a free slot, -1 if the bucket is full.
+ */
+static ssize_t dir_bucket_claim(dir_entry_t* entries, size_t bucket) {
+    size_t first = dir_bucket_first(bucket);
+    size_t end = dir_bucket_first(bucket + 1);
+
+    bool retired = false;
+    for (size_t i = first; i < end; i++) {
+        int inumber =
+            atomic_load_explicit(&entries[i].d_inumber, memory_order_relaxed);
+        if (inumber == -1) {
+            return (ssize_t)i;
+        }
+        retired |= inumber == DIR_ENTRY_RETIRED;
+    }
+    if (!retired) {
+        return -1;
+    }
+
+    // lookups that may still be reading the removed entries finish first
+    rcu_synchronize();
+    ssize_t slot = -1;
+    for (size_t i = first; i < end; i++) {
+        if (atomic_load_explicit(&entries[i].d_inumber,
+                                 memory_order_relaxed) == DIR_ENTRY_RETIRED) {
+            atomic_store_explicit(&entries[i].d_inumber, -1,
+                                  memory_order_relaxed);
+            slot = slot == -1 ? (ssize_t)i : slot;
+        }
+    }
+    return slot;
+}
+
+/**
+ * Look for a name in a directory, locking its buckets for writing, one at a
+ * time.
+ *
+ * If the name is found, the bucket holding it is left locked, and the caller
+ * must unlock it with dir_bucket_unlock.
+ *
+ * Input:
+ *   - entries: the directory's entries
+ *   - sub_name: sub file name
+ *   - bucket: where to store the bucket holding sub_name
+ *
+ * Returns the slot holding sub_name, -1 if the directory has no such entry.
+ */
+static ssize_t dir_find(dir_entry_t const* entries, char const* sub_name,
+                        size_t* bucket) {
+    fs_state_t* fs = fs_state();
+    size_t home = dir_bucket_of(sub_name);
+    size_t n_buckets = dir_bucket_count();
+
+    for (size_t k = 0; k < n_buckets; k++) {
+        // other buckets only matter if the home one overflowed
+        if (k == 1 && atomic_load(&fs->dir_buckets[home].overflow) == 0) {
+            break;
+        }
+
+        size_t b = (home + k) % n_buckets;
+        int sub_inumber;
+        dir_bucket_lock(b, READ_WRITE);
+        ssize_t slot = dir_bucket_find(entries, b, sub_name, &sub_inumber);
+        if (slot != -1) {
+            *bucket = b;
+            return slot;
+        }
+        dir_bucket_unlock(b);
+    }
+    return -1;
+}
+
+/**
+ * Clear the directory entry associated with a sub file.
+ *
+ * Input:
+ *   - inode: directory inode
+ *   - sub_name: sub file name
+ *
+ * Returns 0 if successful, -1 otherwise.
  *
  * Possible errors:
- *   - No free data blocks.
+ *   - inode is not a directory inode.
+ *   - Directory does not contain an entry for sub_name.
  */
-int data_block_alloc(void) {
+int clear_dir_entry(inode_t* inode, char const* sub_name) {
+    fs_state_t* fs = fs_state();
+    inode_load(inode_number(inode));
+    if (inode->i_node_type != T_DIRECTORY) {
+        return -1; // not a directory
+    }
 
-    pthread_rwlock_wrlock(&block_table_rwlock);
+    // Locates the block containing the entries of the directory
+    dir_entry_t* dir_entry = (dir_entry_t*)data_block_get(inode->i_data_block);
+    ALWAYS_ASSERT(dir_entry != NULL,
+                  "clear_dir_entry: directory must have a data block");
 
-    for (size_t i = 0; i < DATA_BLOCKS; i++) {
-        if (i * sizeof(allocation_state_t) % BLOCK_SIZE == 0) {
-            insert_delay(); // simulate storage access delay to free_blocks
+    size_t bucket;
+    ssize_t slot = dir_find(dir_entry, sub_name, &bucket);
+    if (slot == -1) {
+        return -1; // sub_name not found
+    }
+
+    // the name stays until the slot is reused, for lookups still reading it
+    atomic_store_explicit(&dir_entry[slot].d_inumber, DIR_ENTRY_RETIRED,
+                          memory_order_relaxed);
+    data_block_mark_dirty(inode->i_data_block);
+    dir_bucket_unlock(bucket);
+
+    size_t home = dir_bucket_of(sub_name);
+    if (bucket != home) {
+        atomic_fetch_sub(&fs->dir_buckets[home].overflow, 1);
+    }
+    return 0;
+}
+
+// The caller must hold the lock of the slot's bucket for writing
+static void dir_entry_publish(inode_t const* inode, dir_entry_t* entries,
+                              ssize_t slot, char const* sub_name,
+                              int sub_inumber) {
+    strncpy(entries[slot].d_name, sub_name, MAX_FILE_NAME - 1);
+    entries[slot].d_name[MAX_FILE_NAME - 1] = '\0';
+    // publish the entry once its name is complete
+    atomic_store_explicit(&entries[slot].d_inumber, sub_inumber,
+                          memory_order_release);
+    data_block_mark_dirty(inode->i_data_block);
+}
+
+/**
+ * Store the inumber for a sub file in a directory, in the bucket after the
+ * name's home with a free slot.
+ *
+ * The caller must hold the names lock of the home bucket, and have checked
+ * that the directory has no entry for sub_name, and that the home bucket is
+ * full.
+ *
+ * Returns 0 if successful, -1 if the directory is full.
+ */
+static int dir_insert_overflow(inode_t const* inode, dir_entry_t* entries,
+                               size_t home, char const* sub_name,
+                               int sub_inumber) {
+    fs_state_t* fs = fs_state();
+    size_t n_buckets = dir_bucket_count();
+    if (n_buckets == 1) {
+        return -1; // no other bucket
+    }
+
+    // announce the overflow before the entry can be found elsewhere
+    atomic_fetch_add(&fs->dir_buckets[home].overflow, 1);
+    for (size_t k = 1; k < n_buckets; k++) {
+        size_t b = (home + k) % n_buckets;
+        dir_bucket_lock(b, READ_WRITE);
+        ssize_t slot = dir_bucket_claim(entries, b);
+        if (slot != -1) {
+            dir_entry_publish(inode, entries, slot, sub_name, sub_inumber);
+            dir_bucket_unlock(b);
+            return 0;
+        }
+        dir_bucket_unlock(b);
+    }
+
+    atomic_fetch_sub(&fs->dir_buckets[home].overflow, 1);
+    return -1; // no space for entry
+}
+
+/**
+ * Obtain the inumber for a sub file inside a directory, storing the given
+ * one if there is no such entry yet.
+ *
+ * The lookup and the insertion are atomic: when several threads add the
+ * same name, exactly one of them inserts it, and the others find its entry.
+ * The name's home bucket is scanned once, both for the name and for a free
+ * slot.
+ *
+ * Input:
+ *   - inode: directory inode
+ *   - sub_name: sub file name
+ *   - sub_inumber: inumber of the sub inode to insert
+ *   - inserted: where to store whether sub_inumber was inserted
+ *
+ * Returns the inumber sub_name is linked to (sub_inumber if it was inserted),
+ * -1 if errors occur.
+ *
+ * Possible errors:
+ *   - inode is not a directory inode.
+ *   - sub_name is not a valid file name (length 0 or > MAX_FILE_NAME - 1).
+ *   - Directory is already full of entries.
+ */
+int dir_find_or_insert(inode_t* inode, char const* sub_name, int sub_inumber,
+                       bool* inserted) {
+    fs_state_t* fs = fs_state();
+    *inserted = false;
+    if (strlen(sub_name) == 0 || strlen(sub_name) > MAX_FILE_NAME - 1) {
+        return -1; // invalid sub_name
+    }
+
+    inode_load(inode_number(inode));
+    if (inode->i_node_type != T_DIRECTORY) {
+        return -1; // not a directory
+    }
+
+    // Locates the block containing the entries of the directory
+    dir_entry_t* dir_entry = (dir_entry_t*)data_block_get(inode->i_data_block);
+    ALWAYS_ASSERT(dir_entry != NULL,
+                  "dir_find_or_insert: directory must have a data block");
+
+    size_t home = dir_bucket_of(sub_name);
+    size_t n_buckets = dir_bucket_count();
+    int found = -1;
+    dir_names_lock(home);
+
+    dir_bucket_lock(home, READ_WRITE);
+    ssize_t slot;
+    bool in_home = dir_bucket_scan(dir_entry, home, sub_name, &found,
+                                   &slot) != -1;
+
+    // no other thread adds this name to other buckets meanwhile
+    if (!in_home && atomic_load(&fs->dir_buckets[home].overflow) > 0) {
+        unsigned epoch = rcu_read_lock();
+        for (size_t k = 1; k < n_buckets; k++) {
+            if (dir_bucket_find(dir_entry, (home + k) % n_buckets, sub_name,
+                                &found) != -1) {
+                break;
+            }
+        }
+        rcu_read_unlock(epoch);
+    }
+
+    if (found == -1) {
+        if (slot == -1) {
+            slot = dir_bucket_claim(dir_entry, home); // removed entries
+        }
+        if (slot != -1) {
+            dir_entry_publish(inode, dir_entry, slot, sub_name, sub_inumber);
+            found = sub_inumber;
+            *inserted = true;
+        }
+    }
+    dir_bucket_unlock(home);
+
+    if (found == -1 &&
+        dir_insert_overflow(inode, dir_entry, home, sub_name, sub_inumber) !=
+            -1) {
+        found = sub_inumber;
+        *inserted = true;
+    }
+
+    dir_names_unlock(home);
+    return found;
+}
+
+/**
+ * Store the inumber for a sub file in a directory.
+ *
+ * Input:
+ *   - inode: directory inode
+ *   - sub_name: sub file name
+ *   - sub_inumber: inumber of the sub inode
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - inode is not a directory inode.
+ *   - sub_name is not a valid file name (length 0 or > MAX_FILE_NAME - 1).
+ *   - Directory already has an entry for sub_name.
+ *   - Directory is already full of entries.
+ */
+int add_dir_entry(inode_t* inode, char const* sub_name, int sub_inumber) {
+    bool inserted;
+    dir_find_or_insert(inode, sub_name, sub_inumber, &inserted);
+    return inserted ? 0 : -1;
+}
+
+/**
+ * Obtain the inumber for a sub file inside a directory.
+ *
+ * Takes no lock: directories are pinned in the inode cache and their blocks
+ * are never freed (only the root one exists), so the entries are read in
+ * place, without going through the inode and block caches.
+ *
+ * Input:
+ *   - inode: directory inode
+ *   - sub_name: sub file name
+ *
+ * Returns inumber linked to the target name, -1 if errors occur.
+ *
+ * Possible errors:
+ *   - inode is not a directory inode.
+ *   - Directory does not contain a file named sub_name.
+ */
+int find_in_dir(inode_t const* inode, char const* sub_name) {
+    fs_state_t* fs = fs_state();
+    ALWAYS_ASSERT(inode != NULL, "find_in_dir: inode must be non-NULL");
+    ALWAYS_ASSERT(sub_name != NULL, "find_in_dir: sub_name must be non-NULL");
+
+    if (inode->i_node_type != T_DIRECTORY) {
+        return -1; // not a directory
+    }
+
+    ALWAYS_ASSERT(valid_block_number(inode->i_data_block),
+                  "find_in_dir: directory inode must have a data block");
+    size_t block_offset = (size_t)inode->i_data_block * BLOCK_SIZE;
+    dir_entry_t const* dir_entry =
+        (dir_entry_t const*)&fs->fs_data[block_offset];
+
+    size_t home = dir_bucket_of(sub_name);
+    size_t n_buckets = dir_bucket_count();
+    int sub_inumber = -1; // entry not found
+
+    unsigned epoch = rcu_read_lock();
+    for (size_t k = 0; k < n_buckets; k++) {
+        // other buckets only matter if the home one overflowed
+        if (k == 1 && atomic_load(&fs->dir_buckets[home].overflow) == 0) {
+            break;
+        }
+        if (dir_bucket_find(dir_entry, (home + k) % n_buckets, sub_name,
+                            &sub_inumber) != -1) {
+            break;
+        }
+    }
+    rcu_read_unlock(epoch);
+
+    return sub_inumber;
+}
+
+/**
+ * Copy the directory entries in use, starting at a given entry slot.
+ *
+ * Slots never move, so a cursor stays valid while entries are added and
+ * removed; entries are listed at most once per pass over the directory.
+ *
+ * Input:
+ *   - inode: directory inode
+ *   - cursor: slot where the listing starts; updated to where the next one
+ *     should resume
+ *   - entries: destination array
+ *   - max: length of entries
+ *
+ * Returns the number of entries copied, or -1 if inode is not a directory.
+ */
+ssize_t dir_list(inode_t const* inode, size_t* cursor, dir_entry_t* entries,
+                 size_t max) {
+    inode_load(inode_number(inode));
+    if (inode->i_node_type != T_DIRECTORY) {
+        return -1; // not a directory
+    }
+
+    dir_entry_t* dir_entry = (dir_entry_t*)data_block_get(inode->i_data_block);
+    ALWAYS_ASSERT(dir_entry != NULL,
+                  "dir_list: directory inode must have a data block");
+
+    size_t count = 0;
+    size_t i = *cursor;
+    for (size_t b = 0; b < dir_bucket_count() && count < max; b++) {
+        size_t end = dir_bucket_first(b + 1);
+        if (i >= end) {
+            continue; // bucket before the cursor
         }
 
-        if (free_blocks[i] == FREE) {
-            free_blocks[i] = TAKEN;
+        dir_bucket_lock(b, READ_ONLY);
+        for (; i < end && count < max; i++) {
+            int inumber = atomic_load_explicit(&dir_entry[i].d_inumber,
+                                               memory_order_relaxed);
+            if (inumber >= 0) {
+                memcpy(entries[count].d_name, dir_entry[i].d_name,
+                       MAX_FILE_NAME);
+                atomic_init(&entries[count++].d_inumber, inumber);
+            }
+        }
+        dir_bucket_unlock(b);
+    }
+    *cursor = i;
+
+    return (ssize_t)count;
+}
 
-            pthread_rwlock_unlock(&block_table_rwlock);
-            return (int)i;
+/**
+ * Allocate a new data block.
+ *
+ * Returns block number/index if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - No free data blocks.
+ */
+int data_block_alloc(void) {
+    fs_state_t* fs = fs_state();
+    for (int attempt = 0; attempt < 2; attempt++) {
+        lock_rank_acquire(RANK_BLOCK_TABLE);
+        profiled_wrlock(&fs->block_table_rwlock, TFS_LOCK_BLOCK_TABLE);
+
+        for (size_t i = 0; i < DATA_BLOCKS; i++) {
+            if (i * sizeof(allocation_state_t) % BLOCK_SIZE == 0) {
+                insert_delay(); // simulate storage access delay to free_blocks
+            }
+
+            if (fs->free_blocks[i] == FREE) {
+                fs->free_blocks[i] = TAKEN;
+                profiled_rwlock_unlock(&fs->block_table_rwlock,
+                                       TFS_LOCK_BLOCK_TABLE);
+                lock_rank_release(RANK_BLOCK_TABLE);
+
+                // a new block is not read from storage, just cached
+                block_cache_insert((int)i);
+                return (int)i;
+            }
         }
+        profiled_rwlock_unlock(&fs->block_table_rwlock, TFS_LOCK_BLOCK_TABLE);
+        lock_rank_release(RANK_BLOCK_TABLE);
+
+        // out of free blocks: do not wait for the reclaimer. Even if nothing
+        // is left to reclaim, the reclaimer may have freed blocks since the
+        // scan, so the table is scanned again either way.
+        lock_rank_acquire(RANK_DEFERRED);
+        profiled_mutex_lock(&fs->deferred_lock, TFS_LOCK_DEFERRED);
+        reclaim_deferred_blocks();
+        profiled_mutex_unlock(&fs->deferred_lock, TFS_LOCK_DEFERRED);
+        lock_rank_release(RANK_DEFERRED);
     }
-    pthread_rwlock_unlock(&block_table_rwlock);
     return -1;
 }
 
@@ -499,14 +1505,44 @@ int data_block_alloc(void) {
  *   - block_number: the block number/index
  */
 void data_block_free(int block_number) {
+    fs_state_t* fs = fs_state();
     ALWAYS_ASSERT(valid_block_number(block_number),
                   "data_block_free: invalid block number");
 
     insert_delay(); // simulate storage access delay to free_blocks
 
-    pthread_rwlock_wrlock(&block_table_rwlock);
-    free_blocks[block_number] = FREE;
-    pthread_rwlock_unlock(&block_table_rwlock);
+    block_cache_invalidate(block_number);
+    lock_rank_acquire(RANK_BLOCK_TABLE);
+    profiled_wrlock(&fs->block_table_rwlock, TFS_LOCK_BLOCK_TABLE);
+    fs->free_blocks[block_number] = FREE;
+    profiled_rwlock_unlock(&fs->block_table_rwlock, TFS_LOCK_BLOCK_TABLE);
+    lock_rank_release(RANK_BLOCK_TABLE);
+}
+
+/**
+ * Free a data block later, in a batch, on the background reclaimer thread.
+ *
+ * The block is not reused before it is reclaimed, so callers do not pay for
+ * the access to free_blocks.
+ *
+ * Input:
+ *   - block_number: the block number/index
+ */
+void data_block_free_deferred(int block_number) {
+    fs_state_t* fs = fs_state();
+    ALWAYS_ASSERT(valid_block_number(block_number),
+                  "data_block_free_deferred: invalid block number");
+
+    lock_rank_acquire(RANK_DEFERRED);
+    profiled_mutex_lock(&fs->deferred_lock, TFS_LOCK_DEFERRED);
+    ALWAYS_ASSERT(fs->deferred_count < DATA_BLOCKS,
+                  "data_block_free_deferred: block freed twice");
+    fs->deferred_blocks[fs->deferred_count++] = block_number;
+    if (fs->deferred_count >= RECLAIM_BATCH) {
+        pthread_cond_signal(&fs->deferred_cond);
+    }
+    profiled_mutex_unlock(&fs->deferred_lock, TFS_LOCK_DEFERRED);
+    lock_rank_release(RANK_DEFERRED);
 }
 
 /**
@@ -518,39 +1554,687 @@ void data_block_free(int block_number) {
  * Returns a pointer to the first byte of the block.
  */
 void* data_block_get(int block_number) {
+    fs_state_t* fs = fs_state();
     ALWAYS_ASSERT(valid_block_number(block_number),
                   "data_block_get: invalid block number");
 
-    insert_delay(); // simulate storage access delay to block
-    return &fs_data[(size_t)block_number * BLOCK_SIZE];
+    block_cache_get(block_number, BLOCK_SIZE);
+    return &fs->fs_data[(size_t)block_number * BLOCK_SIZE];
+}
+
+/**
+ * Obtain a pointer to the contents of a given block, to read its first bytes
+ * (only those are read from storage, if not cached).
+ *
+ * Input:
+ *   - block_number: the block number/index
+ *   - end: number of bytes to read, from the start of the block
+ *
+ * Returns a pointer to the first byte of the block.
+ */
+void const* data_block_read(int block_number, size_t end) {
+    fs_state_t* fs = fs_state();
+    ALWAYS_ASSERT(valid_block_number(block_number),
+                  "data_block_read: invalid block number");
+
+    block_cache_get(block_number, end);
+    return &fs->fs_data[(size_t)block_number * BLOCK_SIZE];
+}
+
+/**
+ * Read the first bytes of a block into the block cache, ahead of their use.
+ *
+ * Input:
+ *   - block_number: the block number/index
+ *   - end: number of bytes to read ahead, from the start of the block
+ */
+void data_block_prefetch(int block_number, size_t end) {
+    fs_state_t* fs = fs_state();
+    ALWAYS_ASSERT(valid_block_number(block_number),
+                  "data_block_prefetch: invalid block number");
+
+    block_cache_prefetch(block_number, end <= BLOCK_SIZE ? end : BLOCK_SIZE);
+}
+
+/**
+ * Mark a block as modified, after writing to the contents obtained from
+ * data_block_get.
+ *
+ * Input:
+ *   - block_number: the block number/index
+ */
+void data_block_mark_dirty(int block_number) {
+    ALWAYS_ASSERT(valid_block_number(block_number),
+                  "data_block_mark_dirty: invalid block number");
+
+    block_cache_mark_dirty(block_number);
+}
+
+/**
+ * Write the data of a file inode back to storage, if it is dirty.
+ *
+ * The caller must hold the inode's lock (at least for reading).
+ *
+ * Input:
+ *   - inode: file inode
+ */
+void inode_sync(inode_t const* inode) {
+    if (inode->i_data_block != -1) {
+        block_cache_flush(inode->i_data_block);
+    }
+}
+
+/**
+ * Make sure a file inode holds its data block, allocating it if needed.
+ *
+ * The caller must hold the inode's lock for writing.
+ *
+ * Input:
+ *   - inode: file inode
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - No free data blocks.
+ */
+int inode_reserve_block(inode_t* inode) {
+    if (inode->i_data_block != -1) {
+        return 0;
+    }
+
+    int bnum = data_block_alloc();
+    if (bnum == -1) {
+        return -1; // no space
+    }
+    inode->i_data_block = bnum;
+    return 0;
+}
+
+/**
+ * Free the data block held by a file inode (if any), emptying it.
+ *
+ * The block is handed to the background reclaimer, so this takes constant
+ * time.
+ *
+ * The caller must hold the inode's lock for writing.
+ *
+ * Input:
+ *   - inode: file inode
+ */
+void inode_release_block(inode_t* inode) {
+    if (inode->i_data_block != -1) {
+        data_block_free_deferred(inode->i_data_block);
+        inode->i_data_block = -1;
+    }
+    inode->i_size = 0;
+}
+
+/**
+ * Set the size of a file inode, either cutting its contents short or
+ * extending them with zeros.
+ *
+ * The caller must hold the inode's lock for writing.
+ *
+ * Input:
+ *   - inode: file inode
+ *   - len: new size of the file
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - len is larger than the maximum file size.
+ *   - No free data blocks.
+ */
+int inode_truncate(inode_t* inode, size_t len) {
+    fs_state_t* fs = fs_state();
+    if (len > BLOCK_SIZE) {
+        return -1;
+    }
+
+    if (len == 0) {
+        inode_release_block(inode);
+        return 0;
+    }
+
+    if (len > inode->i_size) {
+        if (inode_reserve_block(inode) == -1) {
+            return -1; // no space
+        }
+        char* block = data_block_get(inode->i_data_block);
+        ALWAYS_ASSERT(block != NULL, "inode_truncate: data block deleted");
+        memset(block + inode->i_size, 0, len - inode->i_size);
+        data_block_mark_dirty(inode->i_data_block);
+    }
+
+    inode->i_size = len;
+    return 0;
+}
+
+/**
+ * Read from the data of a file inode, starting at a given offset.
+ *
+ * The caller must hold the inode's lock (at least for reading).
+ *
+ * Input:
+ *   - inode: file inode
+ *   - offset: position in the file where the read starts
+ *   - buffer: destination buffer
+ *   - len: length of the buffer
+ *
+ * Returns the number of bytes that were copied to the buffer (0 if the offset
+ * is at or past the end of the file).
+ */
+size_t inode_read_at(inode_t const* inode, size_t offset, void* buffer,
+                     size_t len) {
+    if (offset >= inode->i_size) {
+        return 0;
+    }
+
+    size_t to_read = inode->i_size - offset;
+    if (to_read > len) {
+        to_read = len;
+    }
+
+    if (to_read > 0) {
+        char const* block =
+            data_block_read(inode->i_data_block, offset + to_read);
+        ALWAYS_ASSERT(block != NULL, "inode_read_at: data block deleted");
+
+        range_lock_entry_t range;
+        inode_range_acquire(inode, &range, offset, to_read, false);
+        memcpy(buffer, block + offset, to_read);
+        inode_range_release(inode, &range);
+    }
+
+    return to_read;
+}
+
+/*
+ * Optimistic readers load fields and data that a writer may be changing (and
+ * then discard what they read). ThreadSanitizer is told to ignore those
+ * loads, and must not see the copy through its memcpy interceptor.
+ */
+#if defined(__SANITIZE_THREAD__)
+#define SEQ_READER __attribute__((no_sanitize("thread")))
+
+SEQ_READER static void seq_copy(void* dst, void const* src, size_t len) {
+    char* to = dst;
+    char const volatile* from = src;
+    for (size_t i = 0; i < len; i++) {
+        to[i] = from[i];
+    }
+}
+#else
+#define SEQ_READER
+#define seq_copy memcpy
+#endif
+
+SEQ_READER static inode_extent_t seq_extent(inode_t const* inode) {
+    return (inode_extent_t){.size = inode->i_size,
+                            .data_block = inode->i_data_block};
+}
+
+/**
+ * Read from the data of a file inode without taking its lock, starting at a
+ * given offset.
+ *
+ * The read only succeeds if no writer held the inode's lock while it ran;
+ * otherwise, the caller may retry, or take the lock and call inode_read_at.
+ *
+ * Input:
+ *   - inode: file inode
+ *   - offset: position in the file where the read starts
+ *   - buffer: destination buffer (its contents are undefined on failure)
+ *   - len: length of the buffer
+ *   - read: where to store the number of bytes copied to the buffer
+ *   - extent: where to store the file's size and block, as seen by the read
+ *
+ * Returns true if successful, false if a writer interfered.
+ */
+bool inode_read_optimistic(inode_t const* inode, size_t offset, void* buffer,
+                           size_t len, size_t* read, inode_extent_t* extent) {
+    unsigned seq = atomic_load_explicit(inode_seq(inode), memory_order_acquire);
+    if ((seq & 1) || atomic_load(&inode->i_overwriters) > 0) {
+        return false; // a writer is changing the file
+    }
+
+    *extent = seq_extent(inode);
+    size_t to_read = 0;
+    if (offset < extent->size) {
+        to_read = extent->size - offset;
+        if (to_read > len) {
+            to_read = len;
+        }
+    }
+
+    if (to_read > 0) {
+        if (!valid_block_number(extent->data_block)) {
+            return false; // torn by a writer
+        }
+        char const* block =
+            data_block_read(extent->data_block, offset + to_read);
+        seq_copy(buffer, block + offset, to_read);
+    }
+
+    // the loads above must not be delayed past the check
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(inode_seq(inode), memory_order_relaxed) != seq) {
+        return false;
+    }
+
+    *read = to_read;
+    return true;
+}
+
+/**
+ * Write to the data of a file inode, starting at a given offset.
+ *
+ * The caller must hold the inode's lock for writing.
+ *
+ * Input:
+ *   - inode: file inode
+ *   - offset: position in the file where the write starts
+ *   - buffer: buffer containing the contents to write
+ *   - len: length of the buffer contents (in bytes)
+ *
+ * Returns the number of bytes that were written (can be lower than 'len' if
+ * the maximum file size is exceeded), or -1 in case of error.
+ *
+ * Possible errors:
+ *   - No free data blocks.
+ */
+ssize_t inode_write_at(inode_t* inode, size_t offset, void const* buffer,
+                       size_t len) {
+    fs_state_t* fs = fs_state();
+    // Determine how many bytes to write
+    if (offset >= BLOCK_SIZE) {
+        return 0;
+    }
+    if (len > BLOCK_SIZE - offset) {
+        len = BLOCK_SIZE - offset;
+    }
+
+    if (len > 0) {
+        // If the file has no block yet, allocate one
+        if (inode_reserve_block(inode) == -1) {
+            return -1; // no space
+        }
+
+        char* block = data_block_get(inode->i_data_block);
+        ALWAYS_ASSERT(block != NULL, "inode_write_at: data block deleted");
+
+        memcpy(block + offset, buffer, len);
+        data_block_mark_dirty(inode->i_data_block);
+        if (offset + len > inode->i_size) {
+            inode->i_size = offset + len;
+        }
+    }
+
+    return (ssize_t)len;
+}
+
+/**
+ * Overwrite data of a file inode in place, starting at a given offset, as
+ * long as that neither extends the file nor needs a new data block.
+ *
+ * Only the byte range written is locked, so overwrites of disjoint ranges of
+ * a file run in parallel. The caller must hold the inode's lock for reading
+ * (so that its size and block do not change).
+ *
+ * Input:
+ *   - inode: file inode
+ *   - offset: position in the file where the write starts
+ *   - buffer: buffer containing the contents to write
+ *   - len: length of the buffer contents (in bytes)
+ *
+ * Returns true if all the data was written, false if nothing was (the write
+ * must then be done by inode_write_at, under the inode's lock for writing).
+ */
+bool inode_overwrite(inode_t* inode, size_t offset, void const* buffer,
+                     size_t len) {
+    if (inode->i_data_block == -1 || offset > inode->i_size ||
+        len > inode->i_size - offset) {
+        return false;
+    }
+
+    range_lock_entry_t range;
+    inode_range_acquire(inode, &range, offset, len, true);
+    // optimistic reads fail from here until the data is written
+    atomic_fetch_add(&inode->i_overwriters, 1);
+    atomic_fetch_add(inode_seq(inode), 2);
+
+    char* block = data_block_get(inode->i_data_block);
+    ALWAYS_ASSERT(block != NULL, "inode_overwrite: data block deleted");
+    memcpy(block + offset, buffer, len);
+    data_block_mark_dirty(inode->i_data_block);
+
+    atomic_fetch_sub(&inode->i_overwriters, 1);
+    inode_range_release(inode, &range);
+    return true;
+}
+
+/**
+ * Copy a range of data between file inodes (or within one), block to block.
+ *
+ * The caller must hold the source inode's lock (at least for reading) and
+ * the destination inode's lock for writing.
+ *
+ * Input:
+ *   - src: source file inode
+ *   - off_in: position of the range in src
+ *   - dst: destination file inode (may be src itself)
+ *   - off_out: position in dst where the range is copied to
+ *   - len: length of the range
+ *
+ * Returns the number of bytes copied (can be lower than 'len' if the end of
+ * src or the maximum file size is reached), or -1 in case of error.
+ *
+ * Possible errors:
+ *   - No free data blocks.
+ */
+ssize_t inode_copy_range(inode_t const* src, size_t off_in, inode_t* dst,
+                         size_t off_out, size_t len) {
+    fs_state_t* fs = fs_state();
+    if (off_in >= src->i_size || off_out >= BLOCK_SIZE) {
+        return 0;
+    }
+    if (len > src->i_size - off_in) {
+        len = src->i_size - off_in;
+    }
+    if (len > BLOCK_SIZE - off_out) {
+        len = BLOCK_SIZE - off_out;
+    }
+
+    if (inode_reserve_block(dst) == -1) {
+        return -1; // no space
+    }
+
+    char const* src_block = data_block_get(src->i_data_block);
+    char* dst_block = src == dst ? (char*)src_block
+                                 : data_block_get(dst->i_data_block);
+    ALWAYS_ASSERT(src_block != NULL && dst_block != NULL,
+                  "inode_copy_range: data block deleted");
+
+    // a range copied past the end of dst leaves a gap, which reads as zeros
+    // (it lies past the end of src, if dst is src)
+    if (off_out > dst->i_size) {
+        memset(dst_block + dst->i_size, 0, off_out - dst->i_size);
+    }
+
+    // ranges overlap when copying within the same file
+    range_lock_entry_t range;
+    inode_range_acquire(src, &range, off_in, len, false);
+    memmove(dst_block + off_out, src_block + off_in, len);
+    inode_range_release(src, &range);
+    data_block_mark_dirty(dst->i_data_block);
+    if (off_out + len > dst->i_size) {
+        dst->i_size = off_out + len;
+    }
+
+    return (ssize_t)len;
+}
+
+/**
+ * Fill a file inode with the contents read from a host file descriptor,
+ * reading straight into its data block.
+ *
+ * Reads until the end of the source. The caller must hold the inode's lock
+ * for writing, and the inode must be empty (e.g., just truncated); it is left
+ * empty on error.
+ *
+ * Input:
+ *   - inode: file inode
+ *   - fd: host file descriptor, open for reading
+ *
+ * Returns the number of bytes copied, or -1 in case of error.
+ *
+ * Possible errors:
+ *   - No free data blocks.
+ *   - The source is larger than the maximum file size.
+ *   - read failure on fd.
+ */
+ssize_t inode_fill_from_fd(inode_t* inode, int fd) {
+    fs_state_t* fs = fs_state();
+    ALWAYS_ASSERT(inode->i_size == 0,
+                  "inode_fill_from_fd: inode must be empty");
+
+    bool reserved = inode->i_data_block != -1;
+    if (inode_reserve_block(inode) == -1) {
+        return -1; // no space
+    }
+    char* block = data_block_get(inode->i_data_block);
+    ALWAYS_ASSERT(block != NULL, "inode_fill_from_fd: data block deleted");
+
+    size_t copied = 0;
+    char extra;
+    for (;;) {
+        // once the block is full, probe for a byte that would not fit
+        ssize_t r = copied < BLOCK_SIZE
+                        ? read(fd, block + copied, BLOCK_SIZE - copied)
+                        : read(fd, &extra, 1);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+        if (r == 0) {
+            break; // end of file
+        }
+        if (r == -1 || copied == BLOCK_SIZE) {
+            // read failure, or the source does not fit in a file
+            if (!reserved) {
+                inode_release_block(inode);
+            }
+            return -1;
+        }
+        copied += (size_t)r;
+    }
+
+    if (copied == 0 && !reserved) {
+        // empty files only hold a data block if it was reserved up front
+        inode_release_block(inode);
+        return 0;
+    }
+
+    data_block_mark_dirty(inode->i_data_block);
+    inode->i_size = copied;
+    return (ssize_t)copied;
+}
+
+/**
+ * Write a range of a file inode's data to a host file descriptor, at the same
+ * offset, straight from its data block.
+ *
+ * The caller must hold the inode's lock (at least for reading).
+ *
+ * Input:
+ *   - inode: file inode
+ *   - fd: host file descriptor, open for writing
+ *   - offset: position of the range, both in the inode and in fd
+ *   - len: length of the range (capped at the end of the file)
+ *
+ * Returns the number of bytes written, or -1 in case of error.
+ *
+ * Possible errors:
+ *   - write failure on fd.
+ */
+ssize_t inode_write_to_fd(inode_t const* inode, int fd, size_t offset,
+                          size_t len) {
+    if (offset >= inode->i_size) {
+        return 0;
+    }
+    if (len > inode->i_size - offset) {
+        len = inode->i_size - offset;
+    }
+
+    char const* block = data_block_read(inode->i_data_block, offset + len);
+    ALWAYS_ASSERT(block != NULL, "inode_write_to_fd: data block deleted");
+
+    range_lock_entry_t range;
+    inode_range_acquire(inode, &range, offset, len, false);
+    size_t written = 0;
+    while (written < len) {
+        ssize_t w = pwrite(fd, block + offset + written, len - written,
+                           (off_t)(offset + written));
+        if (w == -1 && errno == EINTR) {
+            continue;
+        }
+        if (w == -1) {
+            break;
+        }
+        written += (size_t)w;
+    }
+    inode_range_release(inode, &range);
+
+    return written < len ? -1 : (ssize_t)written;
+}
+
+/**
+ * Give the calling thread a private open file table, in its instance.
+ *
+ * Input:
+ *   - size: max number of files open in the table
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - The thread already has a private table.
+ *   - malloc failure.
+ */
+int private_file_table_create(size_t size) {
+    fs_state_t* fs = fs_state();
+    if (private_files != NULL || size == 0 || size > PRIVATE_HANDLE_BASE) {
+        return -1;
+    }
+
+    private_file_table_t* table = malloc(sizeof(private_file_table_t));
+    if (table == NULL) {
+        return -1;
+    }
+    table->fs = fs;
+    table->size = size;
+    table->open = 0;
+    table->entries = malloc(size * sizeof(open_file_entry_t));
+    table->free_entries = calloc(size, sizeof(allocation_state_t)); // FREE
+    if (table->entries == NULL || table->free_entries == NULL) {
+        free(table->entries);
+        free(table->free_entries);
+        free(table);
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        ALWAYS_ASSERT(pthread_mutex_init(&table->entries[i].of_lock, NULL) == 0,
+                      "private_file_table_create: error initializing mutex");
+    }
+
+    private_files = table;
+    return 0;
+}
+
+/**
+ * Free the calling thread's private open file table.
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - The thread has no private table.
+ *   - Files are still open in the table.
+ */
+int private_file_table_destroy(void) {
+    private_file_table_t* table = private_files;
+    if (table == NULL || table->open > 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < table->size; i++) {
+        ALWAYS_ASSERT(pthread_mutex_destroy(&table->entries[i].of_lock) == 0,
+                      "private_file_table_destroy: error destroying mutex");
+    }
+    free(table->entries);
+    free(table->free_entries);
+    free(table);
+    private_files = NULL;
+    return 0;
+}
+
+/**
+ * Check whether a file handle belongs to a private open file table (and so
+ * may only be used by the thread that opened it).
+ */
+bool private_file_handle(int fhandle) {
+    return fhandle >= PRIVATE_HANDLE_BASE;
+}
+
+// The calling thread's private table, if it has one in its current instance
+static private_file_table_t* private_file_table(void) {
+    private_file_table_t* table = private_files;
+    if (table == NULL || table->fs != fs_state()) {
+        return NULL;
+    }
+    return table;
+}
+
+static void open_file_entry_init(open_file_entry_t* file, int inumber,
+                                 size_t offset, bool append) {
+    file->of_inumber = inumber;
+    file->of_offset = offset;
+    file->of_append = append;
+    file->of_ra_next = offset;
+    file->of_ra_window = 0;
+    file->of_ra_end = 0;
 }
 
 /**
- * Add a new entry to the open file table.
+ * Add a new entry to the open file table: the calling thread's private
+ * table if it has one, unless the entry is to be shared with other threads.
  *
  * Input:
  *   - inumber: inode number of the file to open
  *   - offset: initial offset
+ *   - append: whether every write goes to the end of the file
+ *   - shared: whether the entry goes to the instance's table
  *
  * Returns file handle if successful, -1 otherwise.
  *
  * Possible errors:
  *   - No space in open file table for a new open file.
  */
-int add_to_open_file_table(int inumber, size_t offset) {
-    pthread_rwlock_wrlock(&open_file_table_rwlock);
-    for (int i = 0; i < MAX_OPEN_FILES; i++) {
-        if (free_open_file_entries[i] == FREE) {
-            free_open_file_entries[i] = TAKEN;
-            open_file_table[i].of_inumber = inumber;
-            open_file_table[i].of_offset = offset;
+int add_to_open_file_table(int inumber, size_t offset, bool append,
+                           bool shared) {
+    fs_state_t* fs = fs_state();
+
+    private_file_table_t* table = shared ? NULL : private_file_table();
+    if (table != NULL) {
+        for (size_t i = 0; i < table->size; i++) {
+            if (table->free_entries[i] == FREE) {
+                table->free_entries[i] = TAKEN;
+                table->open++;
+                open_file_entry_init(&table->entries[i], inumber, offset,
+                                     append);
+                inode_pin(inumber);
+                return PRIVATE_HANDLE_BASE + (int)i;
+            }
+        }
+        return -1;
+    }
 
-            pthread_rwlock_unlock(&open_file_table_rwlock);
+    lock_rank_acquire(RANK_OPEN_FILE_TABLE);
+    profiled_wrlock(&fs->open_file_table_rwlock, TFS_LOCK_OPEN_FILE_TABLE);
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        if (fs->free_open_file_entries[i] == FREE) {
+            fs->free_open_file_entries[i] = TAKEN;
+            open_file_entry_init(&fs->open_file_table[i], inumber, offset,
+                                 append);
+
+            profiled_rwlock_unlock(&fs->open_file_table_rwlock,
+                                   TFS_LOCK_OPEN_FILE_TABLE);
+            lock_rank_release(RANK_OPEN_FILE_TABLE);
+            inode_pin(inumber);
             return i;
         }
     }
 
-    pthread_rwlock_unlock(&open_file_table_rwlock);
+    profiled_rwlock_unlock(&fs->open_file_table_rwlock,
+                           TFS_LOCK_OPEN_FILE_TABLE);
+    lock_rank_release(RANK_OPEN_FILE_TABLE);
     return -1;
 }
 
@@ -561,15 +2245,36 @@ int add_to_open_file_table(int inumber, size_t offset) {
  *   - fhandle: file handle to free/close
  */
 void remove_from_open_file_table(int fhandle) {
+    fs_state_t* fs = fs_state();
+
+    if (private_file_handle(fhandle)) {
+        private_file_table_t* table = private_file_table();
+        size_t i = (size_t)(fhandle - PRIVATE_HANDLE_BASE);
+        ALWAYS_ASSERT(table != NULL && i < table->size,
+                      "remove_from_open_file_table: file handle must be valid");
+        ALWAYS_ASSERT(table->free_entries[i] == TAKEN,
+                      "remove_from_open_file_table: file handle must be taken");
+
+        table->free_entries[i] = FREE;
+        table->open--;
+        inode_unpin(table->entries[i].of_inumber);
+        return;
+    }
+
     ALWAYS_ASSERT(valid_file_handle(fhandle),
                   "remove_from_open_file_table: file handle must be valid");
 
-    pthread_rwlock_wrlock(&open_file_table_rwlock);
-    ALWAYS_ASSERT(free_open_file_entries[fhandle] == TAKEN,
+    lock_rank_acquire(RANK_OPEN_FILE_TABLE);
+    profiled_wrlock(&fs->open_file_table_rwlock, TFS_LOCK_OPEN_FILE_TABLE);
+    ALWAYS_ASSERT(fs->free_open_file_entries[fhandle] == TAKEN,
                   "remove_from_open_file_table: file handle must be taken");
 
-    free_open_file_entries[fhandle] = FREE;
-    pthread_rwlock_unlock(&open_file_table_rwlock);
+    fs->free_open_file_entries[fhandle] = FREE;
+    int inumber = fs->open_file_table[fhandle].of_inumber;
+    profiled_rwlock_unlock(&fs->open_file_table_rwlock,
+                           TFS_LOCK_OPEN_FILE_TABLE);
+    lock_rank_release(RANK_OPEN_FILE_TABLE);
+    inode_unpin(inumber);
 }
 
 /**
@@ -579,29 +2284,135 @@ void remove_from_open_file_table(int fhandle) {
  *   - fhandle: file handle
  *
  * Returns pointer to the entry, or NULL if the fhandle is
- * invalid/closed/never opened.
+ * invalid/closed/never opened (or private to another thread).
  */
 
 open_file_entry_t* get_open_file_entry(int fhandle) {
+    fs_state_t* fs = fs_state();
+
+    if (private_file_handle(fhandle)) {
+        private_file_table_t* table = private_file_table();
+        size_t i = (size_t)(fhandle - PRIVATE_HANDLE_BASE);
+        if (table == NULL || i >= table->size ||
+            table->free_entries[i] != TAKEN) {
+            return NULL;
+        }
+        return &table->entries[i];
+    }
+
     if (!valid_file_handle(fhandle)) {
         return NULL;
     }
 
-    if (free_open_file_entries[fhandle] != TAKEN) {
+    if (fs->free_open_file_entries[fhandle] != TAKEN) {
         return NULL;
     }
 
-    return &open_file_table[fhandle];
+    return &fs->open_file_table[fhandle];
+}
+
+/**
+ * Lock the offset of an open file entry, for a call that uses or moves it.
+ */
+void open_file_lock(open_file_entry_t* file) {
+    lock_rank_acquire(RANK_OPEN_FILE);
+    profiled_mutex_lock(&file->of_lock, TFS_LOCK_OPEN_FILE);
+}
+
+void open_file_unlock(open_file_entry_t* file) {
+    profiled_mutex_unlock(&file->of_lock, TFS_LOCK_OPEN_FILE);
+    lock_rank_release(RANK_OPEN_FILE);
 }
 
 void inode_lock(const inode_t* inode, open_permission_t open_access) {
-    if (open_access == READ_ONLY) {
-        pthread_rwlock_rdlock(inode->rwlock);
-        return;
+    fs_state_t* fs = fs_state();
+    lock_rank_acquire(RANK_INODE);
+    bool contended = open_access == READ_ONLY
+                         ? profiled_rdlock(inode->rwlock, TFS_LOCK_INODE)
+                         : profiled_wrlock(inode->rwlock, TFS_LOCK_INODE);
+    if (contended) {
+        lock_stats_inode_contended((int)(inode - fs->inode_table));
+    }
+    if (open_access == READ_WRITE) {
+        // now odd: optimistic reads fail
+        atomic_fetch_add(inode_seq(inode), 1);
+    }
+}
+
+/**
+ * Lock a byte range of a file for an owner (see tfs_lock_range), waiting
+ * while other owners hold conflicting ranges.
+ *
+ * Input:
+ *   - inode: file inode
+ *   - owner: the owner of the range
+ *   - offset: position in the file where the range starts
+ *   - len: length of the range
+ *   - exclusive: whether the range may be shared with other (shared) ones
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - malloc failure.
+ */
+int inode_lock_range(inode_t const* inode, void const* owner, size_t offset,
+                     size_t len, bool exclusive) {
+    range_lock_entry_t* range = malloc(sizeof(range_lock_entry_t));
+    if (range == NULL) {
+        return -1;
+    }
+    range->owner = owner;
+    range_lock_acquire(inode->advisory, range, offset, len, exclusive);
+    return 0;
+}
+
+/**
+ * Release a byte range locked with inode_lock_range.
+ *
+ * Input:
+ *   - inode: file inode
+ *   - owner: the owner of the range
+ *   - offset: position in the file where the range starts
+ *   - len: length of the range
+ *
+ * Returns 0 if successful, -1 otherwise.
+ *
+ * Possible errors:
+ *   - The owner holds no such range.
+ */
+int inode_unlock_range(inode_t const* inode, void const* owner, size_t offset,
+                       size_t len) {
+    range_lock_entry_t* range =
+        range_lock_release_owner(inode->advisory, owner, offset, len);
+    if (range == NULL) {
+        return -1;
+    }
+    free(range);
+    return 0;
+}
+
+/**
+ * Release every byte range locked with inode_lock_range by an owner.
+ *
+ * Input:
+ *   - inode: file inode
+ *   - owner: the owner of the ranges
+ */
+void inode_unlock_ranges(inode_t const* inode, void const* owner) {
+    range_lock_entry_t* range = range_lock_release_all(inode->advisory, owner);
+    while (range != NULL) {
+        range_lock_entry_t* next = range->next;
+        free(range);
+        range = next;
     }
-    pthread_rwlock_wrlock(inode->rwlock);
 }
 
 void inode_unlock(const inode_t* inode) {
-    pthread_rwlock_unlock(inode->rwlock);
+    // the counter is only odd while a writer holds the lock (so not while
+    // readers do): then, the caller is that writer
+    if (atomic_load_explicit(inode_seq(inode), memory_order_relaxed) & 1) {
+        atomic_fetch_add(inode_seq(inode), 1);
+    }
+    profiled_rwlock_unlock(inode->rwlock, TFS_LOCK_INODE);
+    lock_rank_release(RANK_INODE);
 }
@@ -3,7 +3,9 @@
 
 #include "config.h"
 #include "operations.h"
+#include "range_lock.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,7 +16,7 @@
  */
 typedef struct {
     char d_name[MAX_FILE_NAME];
-    int d_inumber;
+    atomic_int d_inumber; // published last, so lookups need no lock
 } dir_entry_t;
 
 typedef enum { T_FILE, T_DIRECTORY, T_SYM_LINK } inode_type;
@@ -28,15 +30,35 @@ typedef struct {
         struct {
             size_t i_size;
             int i_data_block;
-            int hard_link_counter;
         };
-        char target[MAX_FILE_NAME];
+        char target[MAX_FILE_NAME]; // symbolic links
     };
+    // Directory entries naming the inode. Links and unlinks update it
+    // without locks; only the unlink that drops it to 0 frees the inode.
+    atomic_int hard_link_counter;
 
     pthread_rwlock_t* rwlock;
+    // Byte ranges of the data accessed under a read lock on rwlock (where
+    // overwrites happen), and ranges locked by tfs_lock_range
+    range_lock_t* ranges;
+    range_lock_t* advisory;
+    // Odd while a writer holds rwlock, and bumped again when it unlocks, so
+    // readers can copy the inode's data without the lock and then check that
+    // no writer came in meanwhile (seqlock). Overwrites, which only hold
+    // rwlock for reading, bump it by 2 and are counted in i_overwriters.
+    atomic_uint i_seq;
+    atomic_uint i_overwriters;
     // in a more complete FS, more fields could exist here
 } inode_t;
 
+/**
+ * Size and data block of a file, as seen by a read
+ */
+typedef struct {
+    size_t size;
+    int data_block;
+} inode_extent_t;
+
 typedef enum { FREE = 0, TAKEN = 1 } allocation_state_t;
 
 /**
@@ -45,6 +67,18 @@ typedef enum { FREE = 0, TAKEN = 1 } allocation_state_t;
 typedef struct {
     int of_inumber;
     size_t of_offset;
+    bool of_append; // writes go to the end of the file
+
+    // held by the calls that use or move the offset, so that calls through
+    // the same handle from several threads each get their own bytes
+    pthread_mutex_t of_lock;
+
+    // readahead state: where a sequential read would start, the current
+    // readahead window (0 while reads are not sequential) and how far the
+    // file was already read ahead
+    size_t of_ra_next;
+    size_t of_ra_window;
+    size_t of_ra_end;
 } open_file_entry_t;
 
 typedef enum {
@@ -59,20 +93,62 @@ size_t state_block_size(void);
 
 int inode_create(inode_type n_type);
 void inode_delete(int inumber);
+int inode_add_link(int inumber);
 inode_t* inode_get(int inumber);
+int inode_get_batch(int const* inumbers, size_t count, inode_t** inodes);
+void inode_pin(int inumber);
+void inode_unpin(int inumber);
+void inode_cache_stats(tfs_cache_stats_t* stats);
 
 int clear_dir_entry(inode_t* inode, char const* sub_name);
 int add_dir_entry(inode_t* inode, char const* sub_name, int sub_inumber);
+int dir_find_or_insert(inode_t* inode, char const* sub_name, int sub_inumber,
+                       bool* inserted);
 int find_in_dir(inode_t const* inode, char const* sub_name);
+ssize_t dir_list(inode_t const* inode, size_t* cursor, dir_entry_t* entries,
+                 size_t max);
 
 int data_block_alloc(void);
 void data_block_free(int block_number);
+void data_block_free_deferred(int block_number);
 void* data_block_get(int block_number);
-
-int add_to_open_file_table(int inumber, size_t offset);
+void const* data_block_read(int block_number, size_t end);
+void data_block_prefetch(int block_number, size_t end);
+void data_block_mark_dirty(int block_number);
+
+int inode_reserve_block(inode_t* inode);
+void inode_sync(inode_t const* inode);
+void inode_release_block(inode_t* inode);
+int inode_truncate(inode_t* inode, size_t len);
+size_t inode_read_at(inode_t const* inode, size_t offset, void* buffer,
+                     size_t len);
+bool inode_read_optimistic(inode_t const* inode, size_t offset, void* buffer,
+                           size_t len, size_t* read, inode_extent_t* extent);
+ssize_t inode_write_at(inode_t* inode, size_t offset, void const* buffer,
+                       size_t len);
+bool inode_overwrite(inode_t* inode, size_t offset, void const* buffer,
+                     size_t len);
+ssize_t inode_copy_range(inode_t const* src, size_t off_in, inode_t* dst,
+                         size_t off_out, size_t len);
+ssize_t inode_fill_from_fd(inode_t* inode, int fd);
+ssize_t inode_write_to_fd(inode_t const* inode, int fd, size_t offset,
+                          size_t len);
+
+int private_file_table_create(size_t size);
+int private_file_table_destroy(void);
+bool private_file_handle(int fhandle);
+int add_to_open_file_table(int inumber, size_t offset, bool append,
+                           bool shared);
 void remove_from_open_file_table(int fhandle);
 open_file_entry_t* get_open_file_entry(int fhandle);
+void open_file_lock(open_file_entry_t* file);
+void open_file_unlock(open_file_entry_t* file);
 void inode_lock(const inode_t* inode, open_permission_t permission);
+int inode_lock_range(inode_t const* inode, void const* owner, size_t offset,
+                     size_t len, bool exclusive);
+int inode_unlock_range(inode_t const* inode, void const* owner, size_t offset,
+                       size_t len);
+void inode_unlock_ranges(inode_t const* inode, void const* owner);
 void inode_unlock(const inode_t* inode);
 
 #endif // STATE_H
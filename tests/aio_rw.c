@@ -0,0 +1,86 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_FILES 8
+
+char const file_contents[] = "BBB!";
+
+atomic_size_t bytes_done;
+
+void on_complete(ssize_t result, void *arg) {
+    assert(result == strlen(file_contents));
+    assert(arg == &bytes_done);
+    atomic_fetch_add(&bytes_done, (size_t)result);
+}
+
+void wait_completions(uint64_t count) {
+    int efd = tfs_aio_eventfd();
+    assert(efd != -1);
+
+    uint64_t completed = 0;
+    while (completed < count) {
+        struct pollfd pfd = {.fd = efd, .events = POLLIN};
+        assert(poll(&pfd, 1, -1) == 1);
+
+        uint64_t n;
+        assert(read(efd, &n, sizeof(n)) == sizeof(n));
+        completed += n;
+    }
+    assert(completed == count);
+}
+
+int main() {
+    int fhandles[NUM_FILES];
+    char buffers[NUM_FILES][sizeof(file_contents)];
+
+    assert(tfs_init(NULL) != -1);
+
+    for (int i = 0; i < NUM_FILES; i++) {
+        char name[8];
+        sprintf(name, "/f%d", i);
+        fhandles[i] = tfs_open(name, TFS_O_CREAT);
+        assert(fhandles[i] != -1);
+    }
+
+    for (int i = 0; i < NUM_FILES; i++) {
+        assert(tfs_awrite(fhandles[i], file_contents, strlen(file_contents),
+                          on_complete, &bytes_done) == 0);
+    }
+    wait_completions(NUM_FILES);
+    assert(atomic_load(&bytes_done) == NUM_FILES * strlen(file_contents));
+
+    for (int i = 0; i < NUM_FILES; i++) {
+        assert(tfs_close(fhandles[i]) != -1);
+
+        char name[8];
+        sprintf(name, "/f%d", i);
+        fhandles[i] = tfs_open(name, 0);
+        assert(fhandles[i] != -1);
+
+        memset(buffers[i], 0, sizeof(buffers[i]));
+        assert(tfs_aread(fhandles[i], buffers[i], sizeof(buffers[i]),
+                         on_complete, &bytes_done) == 0);
+    }
+    wait_completions(NUM_FILES);
+    assert(atomic_load(&bytes_done) == 2 * NUM_FILES * strlen(file_contents));
+
+    for (int i = 0; i < NUM_FILES; i++) {
+        assert(strcmp(buffers[i], file_contents) == 0);
+        assert(tfs_close(fhandles[i]) != -1);
+    }
+
+    // invalid handles are rejected up front
+    assert(tfs_aread(fhandles[0], buffers[0], 1, NULL, NULL) == -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
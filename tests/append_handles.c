@@ -0,0 +1,42 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+int main() {
+    char buffer[8] = {0};
+
+    assert(tfs_init(NULL) != -1);
+
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_close(f) != -1);
+
+    // both handles open at the (empty) end, but each write goes to the end
+    // the file has when it is made, not where it was when opened
+    f = tfs_open("/f", TFS_O_APPEND);
+    int g = tfs_open("/f", TFS_O_APPEND);
+    assert(f != -1 && g != -1);
+    assert(tfs_write(f, "ab", 2) == 2);
+    assert(tfs_write(g, "cd", 2) == 2);
+    assert(tfs_write(f, "ef", 2) == 2);
+    assert(tfs_close(f) != -1);
+    assert(tfs_close(g) != -1);
+
+    // other handles still write where their offset is
+    f = tfs_open("/f", 0);
+    assert(f != -1);
+    assert(tfs_write(f, "AB", 2) == 2);
+    assert(tfs_close(f) != -1);
+
+    f = tfs_open("/f", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer) - 1) == 6);
+    assert(strcmp(buffer, "ABcdef") == 0);
+    assert(tfs_close(f) != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
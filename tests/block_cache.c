@@ -0,0 +1,82 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FILES (12)
+
+char const file_contents[] = "AAA!";
+
+int main() {
+    char buffer[16];
+    char name[16];
+    tfs_cache_stats_t stats;
+
+    // a single bucket, so files evict each other
+    tfs_params params = tfs_default_params();
+    params.block_cache_size = 8;
+    assert(tfs_init(&params) != -1);
+
+    int f = tfs_open("/f0", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, file_contents, strlen(file_contents)) ==
+           strlen(file_contents));
+    assert(tfs_close(f) != -1);
+
+    // repeated reads of the same block hit the cache
+    assert(tfs_block_cache_stats(&stats) == 0);
+    size_t hits = stats.hits;
+    for (int i = 0; i < 4; i++) {
+        f = tfs_open("/f0", 0);
+        assert(f != -1);
+        assert(tfs_read(f, buffer, sizeof(buffer)) == strlen(file_contents));
+        assert(memcmp(buffer, file_contents, strlen(file_contents)) == 0);
+        assert(tfs_close(f) != -1);
+    }
+    assert(tfs_block_cache_stats(&stats) == 0);
+    assert(stats.hits >= hits + 4);
+    assert(stats.hit_ratio > 0.0 && stats.hit_ratio <= 1.0);
+
+    // writing more blocks than fit evicts dirty ones, which are written back
+    // (unless the flusher got to them first)
+    for (int i = 1; i < FILES; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        f = tfs_open(name, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_write(f, file_contents, strlen(file_contents)) ==
+               strlen(file_contents));
+        assert(tfs_close(f) != -1);
+    }
+    assert(tfs_block_cache_stats(&stats) == 0);
+    assert(stats.evictions > 0);
+    assert(stats.writebacks + stats.flushed > 0);
+    assert(stats.writebacks <= stats.evictions);
+
+    // evicted blocks still hold their contents
+    for (int i = 0; i < FILES; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        f = tfs_open(name, 0);
+        assert(f != -1);
+        assert(tfs_read(f, buffer, sizeof(buffer)) == strlen(file_contents));
+        assert(memcmp(buffer, file_contents, strlen(file_contents)) == 0);
+        assert(tfs_close(f) != -1);
+    }
+
+    assert(tfs_destroy() != -1);
+
+    // without a cache, every access misses
+    params.block_cache_size = 0;
+    assert(tfs_init(&params) != -1);
+    f = tfs_open("/f0", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, file_contents, strlen(file_contents)) ==
+           strlen(file_contents));
+    assert(tfs_close(f) != -1);
+    assert(tfs_block_cache_stats(&stats) == 0);
+    assert(stats.hits == 0 && stats.misses == 0 && stats.evictions == 0);
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
@@ -49,9 +49,10 @@ int main() {
         sprintf(link_name, "/l%d", i);
         int lh = tfs_open(link_name, 0);
         assert(lh != -1);
-        char buffer[7];
-        assert(tfs_read(lh, buffer, sizeof(buffer)) == strlen(buffer));
-        assert(memcmp(buffer, file_contents, sizeof(buffer)) == 0);
+        char buffer[sizeof(file_contents)] = {0};
+        assert(tfs_read(lh, buffer, sizeof(buffer) - 1) ==
+               strlen(file_contents));
+        assert(strcmp(buffer, file_contents) == 0);
         assert(tfs_close(lh) != -1);
     }
 
@@ -0,0 +1,70 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+char const file_contents[] = "AAA!BBB!";
+
+void assert_contents(char const *path, char const *expected) {
+    char buffer[32] = {0};
+    int f = tfs_open(path, 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == strlen(expected));
+    assert(strcmp(buffer, expected) == 0);
+    assert(tfs_close(f) != -1);
+}
+
+int main() {
+    assert(tfs_init(NULL) != -1);
+
+    int src = tfs_open("/src", TFS_O_CREAT);
+    assert(src != -1);
+    assert(tfs_write(src, file_contents, strlen(file_contents)) ==
+           strlen(file_contents));
+
+    int dst = tfs_open("/dst", TFS_O_CREAT);
+    assert(dst != -1);
+
+    // whole file, into an empty one
+    assert(tfs_copy_file_range(src, 0, dst, 0, 100) == strlen(file_contents));
+    assert_contents("/dst", "AAA!BBB!");
+
+    // partial range, appended
+    assert(tfs_copy_file_range(src, 4, dst, 8, 4) == 4);
+    assert_contents("/dst", "AAA!BBB!BBB!");
+
+    // within the same file, overlapping ranges
+    assert(tfs_copy_file_range(src, 0, src, 2, 8) == 8);
+    assert_contents("/src", "AAAAA!BBB!");
+
+    // nothing to copy past the end of the source
+    assert(tfs_copy_file_range(src, 100, dst, 0, 4) == 0);
+
+    // past the end of the destination, the gap reads as zeros (not as the
+    // bytes its block held before)
+    assert(tfs_ftruncate(dst, 2) != -1);
+    assert(tfs_copy_file_range(src, 0, dst, 6, 2) == 2);
+    char buffer[16];
+    int f = tfs_open("/dst", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == 8);
+    assert(!memcmp(buffer, "AA\0\0\0\0AA", 8));
+    assert(tfs_close(f) != -1);
+
+    // directories are not files
+    int d = tfs_opendir("/");
+    assert(d != -1);
+    assert(tfs_copy_file_range(src, 0, d, 0, 4) == -1);
+    assert(tfs_copy_file_range(d, 0, dst, 0, 4) == -1);
+    assert(tfs_closedir(d) != -1);
+
+    assert(tfs_close(dst) != -1);
+    assert(tfs_copy_file_range(src, 0, dst, 0, 4) == -1);
+    assert(tfs_close(src) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE 1024
+
+int main() {
+    // binary contents (with NUL bytes), longer than the maximum file size
+    unsigned char contents[BLOCK_SIZE + 100];
+    for (size_t i = 0; i < sizeof(contents); i++) {
+        contents[i] = (unsigned char)(i % 7 == 0 ? 0 : i);
+    }
+
+    char path_src[] = "/tmp/tfs_copy_binary_XXXXXX";
+    int fd = mkstemp(path_src);
+    assert(fd != -1);
+    assert(write(fd, contents, sizeof(contents)) == sizeof(contents));
+    assert(close(fd) == 0);
+
+    tfs_params params = tfs_default_params();
+    params.block_size = BLOCK_SIZE;
+    assert(tfs_init(&params) != -1);
+
+    // a source that does not fit in a file is not copied
+    unsigned char buffer[sizeof(contents)];
+    assert(tfs_copy_from_external_fs(path_src, "/f1") == -1);
+    int f = tfs_open("/f1", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == 0);
+    assert(tfs_close(f) != -1);
+
+    // one that exactly fills the block is
+    assert(truncate(path_src, BLOCK_SIZE) == 0);
+    assert(tfs_copy_from_external_fs(path_src, "/f1") != -1);
+    f = tfs_open("/f1", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == BLOCK_SIZE);
+    assert(memcmp(buffer, contents, BLOCK_SIZE) == 0);
+    assert(tfs_close(f) != -1);
+
+    assert(unlink(path_src) == 0);
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LARGE_SIZE (8 << 20)
+#define BUSY_SIZE (5 << 20)
+#define BUSY_WRITES 16
+
+char const file_contents[] = "BBB!";
+
+void assert_host_file(char const *path, void const *contents, size_t len) {
+    char *buffer = malloc(len + 1);
+    assert(buffer != NULL);
+    FILE *f = fopen(path, "r");
+    assert(f != NULL);
+    assert(fread(buffer, 1, len + 1, f) == len);
+    assert(memcmp(buffer, contents, len) == 0);
+    assert(fclose(f) == 0);
+    free(buffer);
+}
+
+void wait_completions(uint64_t count) {
+    int efd = tfs_aio_eventfd();
+    assert(efd != -1);
+
+    uint64_t completed = 0;
+    while (completed < count) {
+        struct pollfd pfd = {.fd = efd, .events = POLLIN};
+        assert(poll(&pfd, 1, -1) == 1);
+
+        uint64_t n;
+        assert(read(efd, &n, sizeof(n)) == sizeof(n));
+        completed += n;
+    }
+}
+
+void write_tfs_file(char const *path, void const *contents, size_t len) {
+    int f = tfs_open(path, TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, contents, len) == len);
+    assert(tfs_close(f) != -1);
+}
+
+int main() {
+    char host_dir[] = "/tmp/tfs_export_XXXXXX";
+    char path[64];
+    assert(mkdtemp(host_dir) != NULL);
+
+    // large enough blocks for a file to be exported in parallel chunks
+    tfs_params params = tfs_default_params();
+    params.block_size = LARGE_SIZE;
+    params.max_block_count = 8;
+    // and slow data accesses, so that appends queue up behind each other
+    params.aio_worker_count = 2;
+    params.block_cache_size = 0;
+    params.latency.mode = TFS_LATENCY_SLEEP;
+    params.latency.data_ns = 1000000;
+    assert(tfs_init(&params) != -1);
+
+    char *large = malloc(LARGE_SIZE);
+    assert(large != NULL);
+    for (size_t i = 0; i < LARGE_SIZE; i++) {
+        large[i] = (char)(i % 251);
+    }
+
+    write_tfs_file("/f1", file_contents, strlen(file_contents));
+    write_tfs_file("/sub/f2", file_contents, strlen(file_contents));
+    write_tfs_file("/large", large, LARGE_SIZE);
+
+    // single file
+    sprintf(path, "%s/single", host_dir);
+    assert(tfs_copy_to_external_fs("/f1", path) != -1);
+    assert_host_file(path, file_contents, strlen(file_contents));
+    assert(unlink(path) == 0);
+
+    assert(tfs_copy_to_external_fs("/unexistent", path) == -1);
+
+    // whole tree
+    assert(tfs_export_tree("/", host_dir) != -1);
+    sprintf(path, "%s/f1", host_dir);
+    assert_host_file(path, file_contents, strlen(file_contents));
+    assert(unlink(path) == 0);
+    sprintf(path, "%s/sub/f2", host_dir);
+    assert_host_file(path, file_contents, strlen(file_contents));
+    assert(unlink(path) == 0);
+    sprintf(path, "%s/sub", host_dir);
+    assert(rmdir(path) == 0);
+    sprintf(path, "%s/large", host_dir);
+    assert_host_file(path, large, LARGE_SIZE);
+    assert(unlink(path) == 0);
+
+    // exporting a file while the aio workers wait to append to it
+    write_tfs_file("/busy", large, BUSY_SIZE);
+    int f = tfs_open("/busy", TFS_O_APPEND);
+    assert(f != -1);
+    for (int i = 0; i < BUSY_WRITES; i++) {
+        assert(tfs_awrite(f, file_contents, strlen(file_contents), NULL,
+                          NULL) == 0);
+    }
+    sprintf(path, "%s/busy", host_dir);
+    assert(tfs_copy_to_external_fs("/busy", path) != -1);
+    wait_completions(BUSY_WRITES);
+    assert(tfs_close(f) != -1);
+
+    // the export saw some of the appends, whole
+    struct stat st;
+    assert(stat(path, &st) == 0);
+    size_t appended = (size_t)st.st_size - BUSY_SIZE;
+    assert(appended <= BUSY_WRITES * strlen(file_contents));
+    assert(appended % strlen(file_contents) == 0);
+    for (size_t i = 0; i < appended; i += strlen(file_contents)) {
+        memcpy(large + BUSY_SIZE + i, file_contents, strlen(file_contents));
+    }
+    assert_host_file(path, large, (size_t)st.st_size);
+    assert(unlink(path) == 0);
+
+    // names that would lead outside the destination are not exported
+    write_tfs_file("/x/../escaped", file_contents, strlen(file_contents));
+    write_tfs_file("/x/ok", file_contents, strlen(file_contents));
+    sprintf(path, "%s/sub", host_dir);
+    assert(mkdir(path, 0700) == 0);
+    assert(tfs_export_tree("/x", path) == -1);
+    sprintf(path, "%s/escaped", host_dir);
+    assert(access(path, F_OK) == -1);
+    sprintf(path, "%s/sub/ok", host_dir);
+    assert_host_file(path, file_contents, strlen(file_contents));
+    assert(unlink(path) == 0);
+    sprintf(path, "%s/sub", host_dir);
+    assert(rmdir(path) == 0);
+    assert(rmdir(host_dir) == 0);
+
+    free(large);
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_THREADS 8
+#define ROUNDS 50
+
+static atomic_int created;
+
+static void *excl_fn(void *arg) {
+    char const *name = arg;
+    int f = tfs_open(name, TFS_O_CREAT | TFS_O_EXCL);
+    if (f != -1) {
+        atomic_fetch_add(&created, 1);
+        assert(tfs_close(f) != -1);
+    }
+    return NULL;
+}
+
+static void *creat_fn(void *arg) {
+    char const *name = arg;
+    int f = tfs_open(name, TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_close(f) != -1);
+    return NULL;
+}
+
+static void run(void *(*fn)(void *), char *name) {
+    pthread_t tid[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_create(&tid[i], NULL, fn, name) == 0);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+}
+
+// number of entries named name in the root directory
+static int count_entries(char const *name) {
+    tfs_dirent_t entries[8];
+    int count = 0;
+    int d = tfs_opendir("/");
+    assert(d != -1);
+    ssize_t r;
+    while ((r = tfs_getdents(d, entries, sizeof(entries))) > 0) {
+        for (size_t i = 0; i < (size_t)r / sizeof(tfs_dirent_t); i++) {
+            count += strcmp(entries[i].d_name, name + 1) == 0;
+        }
+    }
+    assert(r == 0);
+    assert(tfs_closedir(d) != -1);
+    return count;
+}
+
+int main() {
+    char excl_name[16];
+    char creat_name[16];
+
+    assert(tfs_init(NULL) != -1);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        sprintf(excl_name, "/x%d", round);
+        sprintf(creat_name, "/c%d", round);
+
+        // exactly one exclusive create succeeds
+        atomic_store(&created, 0);
+        run(excl_fn, excl_name);
+        assert(atomic_load(&created) == 1);
+        assert(count_entries(excl_name) == 1);
+
+        // concurrent creates of a name all open the same, single file
+        run(creat_fn, creat_name);
+        assert(count_entries(creat_name) == 1);
+
+        // an existing name is not linked again
+        assert(tfs_link(excl_name, creat_name) == -1);
+        assert(tfs_sym_link(excl_name, creat_name) == -1);
+
+        // a removed name can be created exclusively again
+        assert(tfs_open(excl_name, TFS_O_CREAT | TFS_O_EXCL) == -1);
+        assert(tfs_unlink(excl_name) != -1);
+        int f = tfs_open(excl_name, TFS_O_CREAT | TFS_O_EXCL);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+
+        assert(tfs_unlink(excl_name) != -1);
+        assert(tfs_unlink(creat_name) != -1);
+    }
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
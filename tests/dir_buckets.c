@@ -0,0 +1,94 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// max dir entries in a directory with block size 1024 (the root takes none)
+#define NUM_ENTRIES 23
+#define NUM_THREADS 4
+
+static void *create_fn(void *arg) {
+    int id = *(int *)arg;
+    char name[16];
+    for (int i = id; i < NUM_ENTRIES; i += NUM_THREADS) {
+        sprintf(name, "/f%d", i);
+        int f = tfs_open(name, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+    }
+    return NULL;
+}
+
+static void *unlink_fn(void *arg) {
+    int id = *(int *)arg;
+    char name[16];
+    for (int i = id; i < NUM_ENTRIES; i += NUM_THREADS) {
+        sprintf(name, "/f%d", i);
+        assert(tfs_unlink(name) != -1);
+        assert(tfs_open(name, 0) == -1);
+    }
+    return NULL;
+}
+
+static void run(void *(*fn)(void *)) {
+    pthread_t tid[NUM_THREADS];
+    int ids[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        ids[i] = i;
+        assert(pthread_create(&tid[i], NULL, fn, &ids[i]) == 0);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+}
+
+int main() {
+    char name[16];
+    tfs_dirent_t entries[8];
+
+    tfs_params params = tfs_default_params();
+    params.max_inode_count = NUM_ENTRIES + 2;
+    assert(tfs_init(&params) != -1);
+
+    for (int round = 0; round < 3; round++) {
+        // filling the directory overflows some buckets into others
+        run(create_fn);
+        assert(tfs_open("/full", TFS_O_CREAT) == -1);
+
+        // every entry is found, wherever it was stored
+        for (int i = 0; i < NUM_ENTRIES; i++) {
+            sprintf(name, "/f%d", i);
+            int f = tfs_open(name, 0);
+            assert(f != -1);
+            assert(tfs_close(f) != -1);
+        }
+
+        bool seen[NUM_ENTRIES] = {false};
+        int d = tfs_opendir("/");
+        assert(d != -1);
+        ssize_t r;
+        size_t listed = 0;
+        while ((r = tfs_getdents(d, entries, sizeof(entries))) > 0) {
+            size_t count = (size_t)r / sizeof(tfs_dirent_t);
+            for (size_t i = 0; i < count; i++) {
+                int index;
+                assert(sscanf(entries[i].d_name, "f%d", &index) == 1);
+                assert(index >= 0 && index < NUM_ENTRIES && !seen[index]);
+                seen[index] = true;
+                listed++;
+            }
+        }
+        assert(r == 0);
+        assert(listed == NUM_ENTRIES);
+        assert(tfs_closedir(d) != -1);
+
+        run(unlink_fn);
+    }
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+
+int main() {
+    assert(tfs_init(NULL) != -1);
+
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, "data", 4) == 4);
+
+    // calls that change the data or size of files reject directory handles
+    int d = tfs_opendir("/");
+    assert(d != -1);
+    assert(tfs_write(d, "data", 4) == -1);
+    assert(tfs_ftruncate(d, 0) == -1);
+    assert(tfs_fallocate(d, 0, 16) == -1);
+    assert(tfs_copy_file_range(f, 0, d, 0, 4) == -1);
+    assert(tfs_closedir(d) != -1);
+
+    // so the directory is intact
+    assert(tfs_close(f) != -1);
+    f = tfs_open("/f", 0);
+    assert(f != -1);
+    assert(tfs_close(f) != -1);
+    f = tfs_open("/g", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_close(f) != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
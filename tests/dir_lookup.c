@@ -0,0 +1,79 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// max dir entries in a directory with block size 1024 (the root takes none)
+#define NUM_ENTRIES 23
+#define NUM_STABLE 8
+#define NUM_READERS 4
+#define ROUNDS 200
+
+static atomic_bool stop;
+
+// Lookups never miss stable names, nor find removed ones, while the slots
+// of removed entries are reused
+static void *reader_fn(void *arg) {
+    (void)arg;
+    char name[16];
+    while (!atomic_load(&stop)) {
+        for (int i = 0; i < NUM_STABLE; i++) {
+            sprintf(name, "/s%d", i);
+            int f = tfs_open(name, 0);
+            assert(f != -1);
+            assert(tfs_close(f) != -1);
+        }
+        assert(tfs_open("/gone", 0) == -1);
+    }
+    return NULL;
+}
+
+int main() {
+    pthread_t tid[NUM_READERS];
+    char name[16];
+
+    tfs_params params = tfs_default_params();
+    params.max_inode_count = NUM_ENTRIES + 2;
+    assert(tfs_init(&params) != -1);
+
+    for (int i = 0; i < NUM_STABLE; i++) {
+        sprintf(name, "/s%d", i);
+        int f = tfs_open(name, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+    }
+    int f = tfs_open("/gone", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_close(f) != -1);
+    assert(tfs_unlink("/gone") != -1);
+
+    for (int i = 0; i < NUM_READERS; i++) {
+        assert(pthread_create(&tid[i], NULL, reader_fn, NULL) == 0);
+    }
+
+    // fill the directory and empty it again, so removed slots are reclaimed
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = NUM_STABLE; i < NUM_ENTRIES; i++) {
+            sprintf(name, "/c%d", i);
+            f = tfs_open(name, TFS_O_CREAT);
+            assert(f != -1);
+            assert(tfs_close(f) != -1);
+        }
+        for (int i = NUM_STABLE; i < NUM_ENTRIES; i++) {
+            sprintf(name, "/c%d", i);
+            assert(tfs_unlink(name) != -1);
+        }
+    }
+
+    atomic_store(&stop, true);
+    for (int i = 0; i < NUM_READERS; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+char const file_contents[] = "AAA!";
+
+int main() {
+    char buffer[8];
+
+    tfs_params params = tfs_default_params();
+    params.max_block_count = 2; // root directory + one file
+    assert(tfs_init(&params) != -1);
+
+    // reserve the only free block at open time
+    int f1 = tfs_open("/f1", TFS_O_CREAT | TFS_O_PREALLOC);
+    assert(f1 != -1);
+    assert(tfs_read(f1, buffer, sizeof(buffer)) == 0); // size is unchanged
+
+    int f2 = tfs_open("/f2", TFS_O_CREAT);
+    assert(f2 != -1);
+    assert(tfs_fallocate(f2, 0, 1) == -1); // no space left
+    assert(tfs_write(f2, file_contents, sizeof(file_contents)) == -1);
+
+    // writes to the reserved block need no allocation
+    assert(tfs_write(f1, file_contents, sizeof(file_contents)) ==
+           sizeof(file_contents));
+    assert(tfs_close(f1) != -1);
+    assert(tfs_unlink("/f1") != -1);
+
+    // the range must fit in a block
+    size_t block_size = params.block_size;
+    assert(tfs_fallocate(f2, 0, block_size + 1) == -1);
+    assert(tfs_fallocate(f2, block_size, 1) == -1);
+    assert(tfs_fallocate(f2, 0, 0) == -1);
+
+    assert(tfs_fallocate(f2, 0, block_size) == 0);
+    assert(tfs_fallocate(f2, 0, block_size) == 0); // already reserved
+    assert(tfs_write(f2, file_contents, sizeof(file_contents)) ==
+           sizeof(file_contents));
+    assert(tfs_close(f2) != -1);
+
+    // truncating releases the reservation
+    f2 = tfs_open("/f2", TFS_O_TRUNC);
+    assert(f2 != -1);
+    f1 = tfs_open("/f1", TFS_O_CREAT | TFS_O_PREALLOC);
+    assert(f1 != -1);
+    assert(tfs_close(f1) != -1);
+    assert(tfs_close(f2) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+char const file_contents[] = "AAA!BBB!";
+
+int main() {
+    char buffer[16];
+
+    tfs_params params = tfs_default_params();
+    params.max_block_count = 2; // root directory + one file
+    assert(tfs_init(&params) != -1);
+
+    int f = tfs_open("/f1", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, file_contents, strlen(file_contents)) ==
+           strlen(file_contents));
+
+    // shrink
+    assert(tfs_ftruncate(f, 4) == 0);
+    int r = tfs_open("/f1", 0);
+    assert(r != -1);
+    assert(tfs_read(r, buffer, sizeof(buffer)) == 4);
+    assert(memcmp(buffer, "AAA!", 4) == 0);
+    assert(tfs_close(r) != -1);
+
+    // grow, the new bytes read as zeros
+    assert(tfs_ftruncate(f, 6) == 0);
+    r = tfs_open("/f1", 0);
+    assert(r != -1);
+    assert(tfs_read(r, buffer, sizeof(buffer)) == 6);
+    assert(memcmp(buffer, "AAA!\0\0", 6) == 0);
+    assert(tfs_close(r) != -1);
+
+    assert(tfs_ftruncate(f, params.block_size + 1) == -1);
+
+    // the block released by an empty file is reusable right away
+    assert(tfs_ftruncate(f, 0) == 0);
+    int g = tfs_open("/f2", TFS_O_CREAT);
+    assert(g != -1);
+    assert(tfs_write(g, file_contents, strlen(file_contents)) ==
+           strlen(file_contents));
+
+    // the file handle's offset (8) is now past the end of the file
+    assert(tfs_read(f, buffer, sizeof(buffer)) == 0);
+
+    assert(tfs_close(g) != -1);
+    assert(tfs_close(f) != -1);
+    assert(tfs_ftruncate(f, 0) == -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
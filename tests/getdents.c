@@ -0,0 +1,73 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_FILES 10
+
+int main() {
+    char name[16];
+    bool seen[NUM_FILES + 1] = {false};
+    tfs_dirent_t entries[3];
+
+    assert(tfs_init(NULL) != -1);
+
+    for (int i = 0; i < NUM_FILES; i++) {
+        sprintf(name, "/f%d", i);
+        int f = tfs_open(name, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+    }
+    assert(tfs_sym_link("/f0", "/l") != -1);
+
+    assert(tfs_opendir("/f0") == -1);
+    int d = tfs_opendir("/");
+    assert(d != -1);
+
+    assert(tfs_getdents(d, entries, sizeof(tfs_dirent_t) - 1) == -1);
+    char byte;
+    assert(tfs_read(d, &byte, 1) == -1);
+
+    size_t listed = 0;
+    ssize_t r;
+    while ((r = tfs_getdents(d, entries, sizeof(entries))) > 0) {
+        assert((size_t)r % sizeof(tfs_dirent_t) == 0);
+        size_t count = (size_t)r / sizeof(tfs_dirent_t);
+        assert(count <= 3);
+
+        for (size_t i = 0; i < count; i++) {
+            int index;
+            if (!strcmp(entries[i].d_name, "l")) {
+                index = NUM_FILES;
+                assert(entries[i].d_type == TFS_DT_SYMLINK);
+            } else {
+                assert(sscanf(entries[i].d_name, "f%d", &index) == 1);
+                assert(index >= 0 && index < NUM_FILES);
+                assert(entries[i].d_type == TFS_DT_FILE);
+            }
+            assert(!seen[index]); // listed only once
+            seen[index] = true;
+            listed++;
+        }
+
+        // entries added behind the cursor are not listed again
+        if (listed == 3) {
+            assert(tfs_unlink("/f1") != -1);
+            int f = tfs_open("/f1", TFS_O_CREAT);
+            assert(f != -1);
+            assert(tfs_close(f) != -1);
+        }
+    }
+    assert(r == 0);
+    assert(listed == NUM_FILES + 1);
+
+    assert(tfs_closedir(d) != -1);
+    assert(tfs_getdents(d, entries, sizeof(entries)) == -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
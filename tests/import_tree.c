@@ -0,0 +1,91 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+char const file_contents[] = "BBB!";
+
+void write_host_file(char const *path) {
+    FILE *f = fopen(path, "w");
+    assert(f != NULL);
+    assert(fwrite(file_contents, 1, strlen(file_contents), f) ==
+           strlen(file_contents));
+    assert(fclose(f) == 0);
+}
+
+void assert_contents_ok(char const *path) {
+    char buffer[sizeof(file_contents)] = {0};
+    int f = tfs_open(path, 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == strlen(file_contents));
+    assert(strcmp(buffer, file_contents) == 0);
+    assert(tfs_close(f) != -1);
+}
+
+int main() {
+    char host_dir[] = "/tmp/tfs_import_XXXXXX";
+    char path[64];
+    assert(mkdtemp(host_dir) != NULL);
+
+    // <host_dir>/{f0..f19, sub/g}
+    for (int i = 0; i < 20; i++) {
+        sprintf(path, "%s/f%d", host_dir, i);
+        write_host_file(path);
+    }
+    sprintf(path, "%s/sub", host_dir);
+    assert(mkdir(path, 0700) == 0);
+    sprintf(path, "%s/sub/g", host_dir);
+    write_host_file(path);
+
+    // links are followed only to regular files: <host_dir>/loop leads back
+    // to <host_dir> itself
+    char const *links[][2] = {
+        {"f0", "file_link"}, {".", "loop"}, {"sub", "sub_link"},
+        {"missing", "dangling"}};
+    for (size_t i = 0; i < sizeof(links) / sizeof(links[0]); i++) {
+        sprintf(path, "%s/%s", host_dir, links[i][1]);
+        assert(symlink(links[i][0], path) == 0);
+    }
+
+    assert(tfs_init(NULL) != -1);
+
+    tfs_import_stats_t stats;
+    assert(tfs_import_tree(host_dir, "/", &stats) == 0);
+    assert(stats.files == 22);
+    assert(stats.failed == 0);
+    assert(stats.bytes == 22 * strlen(file_contents));
+
+    for (int i = 0; i < 20; i++) {
+        sprintf(path, "/f%d", i);
+        assert_contents_ok(path);
+    }
+    assert_contents_ok("/sub/g");
+    assert_contents_ok("/file_link");
+    assert(tfs_open("/sub_link/g", 0) == -1);
+
+    // missing source directory
+    assert(tfs_import_tree("/tmp/tfs_import_unexistent", "/", NULL) == -1);
+
+    assert(tfs_destroy() != -1);
+
+    for (int i = 0; i < 20; i++) {
+        sprintf(path, "%s/f%d", host_dir, i);
+        assert(unlink(path) == 0);
+    }
+    for (size_t i = 0; i < sizeof(links) / sizeof(links[0]); i++) {
+        sprintf(path, "%s/%s", host_dir, links[i][1]);
+        assert(unlink(path) == 0);
+    }
+    sprintf(path, "%s/sub/g", host_dir);
+    assert(unlink(path) == 0);
+    sprintf(path, "%s/sub", host_dir);
+    assert(rmdir(path) == 0);
+    assert(rmdir(host_dir) == 0);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FILES (8)
+
+int main() {
+    char buffer[32];
+    char name[16];
+    tfs_cache_stats_t before;
+    tfs_cache_stats_t after;
+
+    tfs_params params = tfs_default_params();
+    params.inode_cache_size = 4;
+    assert(tfs_init(&params) != -1);
+
+    int f = tfs_open("/f0", TFS_O_CREAT);
+    assert(f != -1);
+
+    // the inodes of the root directory and of open files are pinned, so
+    // they never miss
+    assert(tfs_inode_cache_stats(&before) == 0);
+    for (int i = 0; i < 16; i++) {
+        assert(tfs_write(f, "x", 1) == 1);
+    }
+    assert(tfs_inode_cache_stats(&after) == 0);
+    assert(after.misses == before.misses);
+    assert(after.hits >= before.hits + 16);
+
+    // creating more files than fit evicts unpinned inodes
+    for (int i = 1; i < FILES; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        int g = tfs_open(name, TFS_O_CREAT);
+        assert(g != -1);
+        assert(tfs_close(g) != -1);
+    }
+    assert(tfs_inode_cache_stats(&after) == 0);
+    assert(after.evictions > 0);
+    assert(after.writebacks == 0);
+
+    // ...but not pinned ones
+    assert(tfs_inode_cache_stats(&before) == 0);
+    assert(tfs_write(f, "x", 1) == 1);
+    assert(tfs_inode_cache_stats(&after) == 0);
+    assert(after.misses == before.misses);
+    assert(tfs_close(f) != -1);
+
+    f = tfs_open("/f0", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == 17);
+    assert(tfs_close(f) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    // without a cache, nothing is counted
+    params.inode_cache_size = 0;
+    assert(tfs_init(&params) != -1);
+    f = tfs_open("/f0", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, "x", 1) == 1);
+    assert(tfs_close(f) != -1);
+    assert(tfs_inode_cache_stats(&after) == 0);
+    assert(after.hits == 0 && after.misses == 0);
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
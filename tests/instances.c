@@ -0,0 +1,86 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_INSTANCES 4
+#define ROUNDS 20
+
+static tfs_instance_t *instances[NUM_INSTANCES];
+
+static void *tenant_fn(void *arg) {
+    int id = *(int *)arg;
+    char content[16];
+    char buffer[16];
+
+    // every instance has its own /f, with its own contents
+    assert(tfs_instance_use(instances[id]) == NULL);
+    sprintf(content, "tenant %d", id);
+    for (int i = 0; i < ROUNDS; i++) {
+        int f = tfs_open("/f", TFS_O_CREAT | TFS_O_TRUNC);
+        assert(f != -1);
+        assert(tfs_write(f, content, sizeof(content)) == sizeof(content));
+        assert(tfs_close(f) != -1);
+
+        f = tfs_open("/f", 0);
+        assert(f != -1);
+        assert(tfs_read(f, buffer, sizeof(buffer)) == sizeof(buffer));
+        assert(!memcmp(buffer, content, sizeof(content)));
+        assert(tfs_close(f) != -1);
+    }
+    assert(tfs_instance_use(NULL) == instances[id]);
+    return NULL;
+}
+
+int main() {
+    pthread_t tid[NUM_INSTANCES];
+    int ids[NUM_INSTANCES];
+    char buffer[16];
+
+    // the default instance keeps working alongside the others
+    assert(tfs_init(NULL) != -1);
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, "default", 8) == 8);
+    assert(tfs_close(f) != -1);
+
+    tfs_params params = tfs_default_params();
+    params.max_inode_count = 4;
+    for (int i = 0; i < NUM_INSTANCES; i++) {
+        instances[i] = tfs_instance_create(&params);
+        assert(instances[i] != NULL);
+    }
+
+    for (int i = 0; i < NUM_INSTANCES; i++) {
+        ids[i] = i;
+        assert(pthread_create(&tid[i], NULL, tenant_fn, &ids[i]) == 0);
+    }
+    for (int i = 0; i < NUM_INSTANCES; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+
+    // instances have their own limits: 3 files besides the root directory
+    assert(tfs_instance_use(instances[0]) == NULL);
+    assert(tfs_open("/a", TFS_O_CREAT) != -1);
+    assert(tfs_open("/b", TFS_O_CREAT) != -1);
+    assert(tfs_open("/c", TFS_O_CREAT) == -1);
+    tfs_instance_use(NULL);
+    assert(tfs_open("/c", TFS_O_CREAT) != -1);
+
+    f = tfs_open("/f", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == 8);
+    assert(!strcmp(buffer, "default"));
+    assert(tfs_close(f) != -1);
+
+    for (int i = 0; i < NUM_INSTANCES; i++) {
+        assert(tfs_instance_destroy(instances[i]) != -1);
+    }
+    assert(tfs_instance_destroy(NULL) == -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// create, write and read back a file; returns the time it took
+static double run_ops(tfs_params const *params) {
+    char buffer[4];
+
+    assert(tfs_init(params) != -1);
+    double start = now();
+
+    int f = tfs_open("/f1", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, "AAA!", 4) == 4);
+    assert(tfs_close(f) != -1);
+
+    f = tfs_open("/f1", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == 4);
+    assert(tfs_close(f) != -1);
+
+    double elapsed = now() - start;
+    assert(tfs_destroy() != -1);
+    return elapsed;
+}
+
+int main() {
+    tfs_params params = tfs_default_params();
+    params.block_cache_size = 0; // every data block access hits storage
+    params.inode_cache_size = 0;
+
+    // invalid models are rejected
+    params.latency.mode = (tfs_latency_mode_t)42;
+    assert(tfs_init(&params) == -1);
+
+    params.latency.mode = TFS_LATENCY_NONE;
+    run_ops(&params);
+
+    // at least the write and the read access the data device
+    params.latency.mode = TFS_LATENCY_SLEEP;
+    params.latency.data_ns = 5000000; // 5 ms
+    assert(run_ops(&params) >= 0.010);
+
+    params.latency.mode = TFS_LATENCY_SPIN;
+    params.latency.distribution = TFS_LATENCY_UNIFORM;
+    params.latency.metadata_ns = 1000;
+    run_ops(&params);
+
+    // bandwidth: a 1 KiB block at 64 KiB/s takes over 15 ms to transfer
+    params.latency.mode = TFS_LATENCY_SLEEP;
+    params.latency.distribution = TFS_LATENCY_FIXED;
+    params.latency.data_ns = 0;
+    params.latency.bandwidth = 64 * 1024;
+    params.latency.queue_depth = 1;
+    assert(run_ops(&params) >= 0.030);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_THREADS 8
+#define ROUNDS 200
+
+static char const content[] = "still here";
+
+void* link_unlink_fn(void* arg) {
+    char name[16];
+    sprintf(name, "/l%d", *(int*)arg);
+    for (int i = 0; i < ROUNDS; i++) {
+        assert(tfs_link("/target", name) != -1);
+        assert(tfs_unlink(name) != -1);
+    }
+    return NULL;
+}
+
+void* racing_link_fn(void* arg) {
+    (void)arg;
+    // either fails, or links a file that is still alive
+    if (tfs_link("/victim", "/survivor") != -1) {
+        int f = tfs_open("/survivor", 0);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+    }
+    return NULL;
+}
+
+void* racing_unlink_fn(void* arg) {
+    (void)arg;
+    assert(tfs_unlink("/victim") != -1);
+    return NULL;
+}
+
+int main() {
+    pthread_t tid[NUM_THREADS];
+    int ids[NUM_THREADS];
+    char buffer[sizeof(content)];
+    char name[16];
+
+    tfs_params params = tfs_default_params();
+    params.max_inode_count = 4;
+    assert(tfs_init(&params) != -1);
+
+    int f = tfs_open("/target", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, content, sizeof(content)) == sizeof(content));
+    assert(tfs_close(f) != -1);
+
+    // concurrent links and unlinks never drop the count to 0
+    for (int i = 0; i < NUM_THREADS; i++) {
+        ids[i] = i;
+        assert(pthread_create(&tid[i], NULL, link_unlink_fn, &ids[i]) == 0);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+
+    f = tfs_open("/target", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == sizeof(buffer));
+    assert(!memcmp(buffer, content, sizeof(content)));
+    assert(tfs_close(f) != -1);
+
+    // unlinking symbolic links frees their inodes (only 2 of 4 are left)
+    for (int i = 0; i < 10; i++) {
+        assert(tfs_sym_link("/target", "/soft") != -1);
+        assert(tfs_unlink("/soft") != -1);
+        assert(tfs_unlink("/soft") == -1);
+    }
+
+    // a target too long for the inode is refused
+    char long_target[64];
+    memset(long_target, 'x', sizeof(long_target) - 1);
+    long_target[0] = '/';
+    long_target[sizeof(long_target) - 1] = '\0';
+    assert(tfs_sym_link(long_target, "/long") == -1);
+
+    // linking a file while it is unlinked
+    for (int i = 0; i < 20; i++) {
+        f = tfs_open("/victim", TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+
+        assert(pthread_create(&tid[0], NULL, racing_link_fn, NULL) == 0);
+        assert(pthread_create(&tid[1], NULL, racing_unlink_fn, NULL) == 0);
+        assert(pthread_join(tid[0], NULL) == 0);
+        assert(pthread_join(tid[1], NULL) == 0);
+        tfs_unlink("/survivor");
+    }
+
+    // no inode leaked: all but the root one can be taken
+    assert(tfs_unlink("/target") != -1);
+    for (int i = 0; i < 3; i++) {
+        sprintf(name, "/n%d", i);
+        f = tfs_open(name, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+    }
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
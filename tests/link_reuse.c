@@ -0,0 +1,69 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define ROUNDS 500
+
+static atomic_bool done;
+
+// keeps unlinking the link target, freeing its inumber for reuse
+static void *target_fn(void *arg) {
+    (void)arg;
+    while (!atomic_load(&done)) {
+        int f = tfs_open("/t", TFS_O_CREAT);
+        if (f != -1) {
+            assert(tfs_close(f) != -1);
+        }
+        tfs_unlink("/t");
+    }
+    return NULL;
+}
+
+// keeps reusing freed inumbers for symlinks, which cannot be hard-linked
+static void *sym_link_fn(void *arg) {
+    (void)arg;
+    while (!atomic_load(&done)) {
+        if (tfs_sym_link("/missing", "/s") != -1) {
+            assert(tfs_unlink("/s") != -1);
+        }
+    }
+    return NULL;
+}
+
+int main() {
+    pthread_t target, sym_link;
+
+    // few inodes, so that freed inumbers are soon reused, and uncached
+    // inode accesses that sleep, so that threads interleave within calls
+    tfs_params params = tfs_default_params();
+    params.max_inode_count = 4;
+    params.inode_cache_size = 0;
+    params.latency.mode = TFS_LATENCY_SLEEP;
+    params.latency.metadata_ns = 10000;
+    assert(tfs_init(&params) != -1);
+
+    assert(pthread_create(&target, NULL, target_fn, NULL) == 0);
+    assert(pthread_create(&sym_link, NULL, sym_link_fn, NULL) == 0);
+
+    // a link that is made refers to a file (a link to the symlink, whose
+    // target does not exist, could not be opened)
+    for (int i = 0; i < ROUNDS; i++) {
+        if (tfs_link("/t", "/l") != -1) {
+            int f = tfs_open("/l", 0);
+            assert(f != -1);
+            assert(tfs_close(f) != -1);
+            assert(tfs_unlink("/l") != -1);
+        }
+    }
+
+    atomic_store(&done, true);
+    assert(pthread_join(target, NULL) == 0);
+    assert(pthread_join(sym_link, NULL) == 0);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
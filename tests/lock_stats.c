@@ -0,0 +1,92 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_THREADS 4
+#define ROUNDS 20
+
+static void *writer_fn(void *arg) {
+    (void)arg;
+    char buffer[8] = {0}; // every write fits in the file's block
+    for (int i = 0; i < ROUNDS; i++) {
+        int f = tfs_open("/f", TFS_O_APPEND);
+        assert(f != -1);
+        assert(tfs_write(f, buffer, sizeof(buffer)) == sizeof(buffer));
+        assert(tfs_close(f) != -1);
+    }
+    return NULL;
+}
+
+static size_t hist_sum(size_t const *hist) {
+    size_t sum = 0;
+    for (size_t b = 0; b < TFS_LOCK_HIST_BUCKETS; b++) {
+        sum += hist[b];
+    }
+    return sum;
+}
+
+int main() {
+    pthread_t tid[NUM_THREADS];
+    tfs_lock_stats_t stats;
+    char report[4096];
+
+    // profiling is disabled by default
+    assert(tfs_init(NULL) != -1);
+    assert(tfs_lock_stats(&stats) == -1);
+    assert(tfs_destroy() != -1);
+
+    // writers sleep while holding the file's inode lock
+    tfs_params params = tfs_default_params();
+    params.lock_stats = true;
+    params.block_cache_size = 0;
+    params.latency.mode = TFS_LATENCY_SLEEP;
+    params.latency.data_ns = 100000;
+    assert(tfs_init(&params) != -1);
+
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_close(f) != -1);
+
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_create(&tid[i], NULL, writer_fn, NULL) == 0);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+
+    assert(tfs_lock_stats(&stats) != -1);
+    for (int c = 0; c < TFS_LOCK_CLASS_COUNT; c++) {
+        tfs_lock_class_stats_t const *lock = &stats.classes[c];
+        assert(lock->contended <= lock->acquisitions);
+        assert(hist_sum(lock->wait_hist) == lock->contended);
+        assert(hist_sum(lock->hold_hist) <= lock->acquisitions);
+    }
+    tfs_lock_class_stats_t const *inodes = &stats.classes[TFS_LOCK_INODE];
+    assert(inodes->acquisitions >= NUM_THREADS * ROUNDS);
+    assert(inodes->contended > 0);
+    assert(stats.classes[TFS_LOCK_OPEN_FILE_TABLE].acquisitions >=
+           2 * NUM_THREADS * ROUNDS);
+
+    // the contended inode is /f's (the root's lock is only read)
+    assert(stats.top_inodes[0].inumber > 0);
+    assert(stats.top_inodes[0].contended > 0);
+    for (int i = 1; i < TFS_LOCK_TOP_INODES; i++) {
+        assert(stats.top_inodes[i].contended <=
+               stats.top_inodes[i - 1].contended);
+    }
+
+    FILE *out = fmemopen(report, sizeof(report), "w");
+    assert(out != NULL);
+    assert(tfs_lock_stats_dump(out) != -1);
+    assert(fclose(out) == 0);
+    assert(strstr(report, "open_file_table") != NULL);
+    assert(strstr(report, "inode hold:") != NULL);
+    assert(strstr(report, "most contended inodes:") != NULL);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
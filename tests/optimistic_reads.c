@@ -0,0 +1,64 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FILE_SIZE 64
+#define NUM_READERS 4
+#define ROUNDS 2000
+
+static atomic_bool stop;
+
+// Reads never see a mix of two writes
+static void *reader_fn(void *arg) {
+    (void)arg;
+    char buffer[FILE_SIZE];
+    while (!atomic_load(&stop)) {
+        int f = tfs_open("/f", 0);
+        assert(f != -1);
+        assert(tfs_read(f, buffer, sizeof(buffer)) == FILE_SIZE);
+        for (size_t i = 1; i < FILE_SIZE; i++) {
+            assert(buffer[i] == buffer[0]);
+        }
+        assert(tfs_close(f) != -1);
+    }
+    return NULL;
+}
+
+int main() {
+    pthread_t tid[NUM_READERS];
+    char contents[FILE_SIZE];
+
+    assert(tfs_init(NULL) != -1);
+
+    memset(contents, 'a', sizeof(contents));
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, contents, sizeof(contents)) == FILE_SIZE);
+    assert(tfs_close(f) != -1);
+
+    for (int i = 0; i < NUM_READERS; i++) {
+        assert(pthread_create(&tid[i], NULL, reader_fn, NULL) == 0);
+    }
+
+    for (int round = 0; round < ROUNDS; round++) {
+        memset(contents, 'a' + round % 26, sizeof(contents));
+        f = tfs_open("/f", 0);
+        assert(f != -1);
+        assert(tfs_write(f, contents, sizeof(contents)) == FILE_SIZE);
+        assert(tfs_close(f) != -1);
+    }
+
+    atomic_store(&stop, true);
+    for (int i = 0; i < NUM_READERS; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_THREADS 4
+#define MAX_PRIVATE 8
+#define ROUNDS 50
+
+static void *owner_fn(void *arg) {
+    int id = *(int *)arg;
+    int handles[MAX_PRIVATE];
+    char name[16];
+    char buffer[16];
+
+    assert(tfs_private_files(MAX_PRIVATE) != -1);
+    assert(tfs_private_files(MAX_PRIVATE) == -1); // already has one
+
+    sprintf(name, "/t%d", id);
+    for (int round = 0; round < ROUNDS; round++) {
+        // more files open than the instance's table holds
+        for (int i = 0; i < MAX_PRIVATE; i++) {
+            handles[i] = tfs_open(name, TFS_O_CREAT);
+            assert(handles[i] != -1);
+        }
+        assert(tfs_open(name, 0) == -1); // the private table is full
+
+        assert(tfs_write(handles[0], name, sizeof(name)) == sizeof(name));
+        assert(tfs_read(handles[1], buffer, sizeof(buffer)) == sizeof(name));
+        assert(!strcmp(buffer, name));
+
+        // advisory locks belong to the handle that took them
+        assert(tfs_lock_range(handles[0], 0, 4, TFS_LOCK_SHARED) != -1);
+        assert(tfs_unlock_range(handles[1], 0, 4) == -1);
+        assert(tfs_unlock_range(handles[0], 0, 4) != -1);
+
+        // a table with open files cannot be freed
+        assert(tfs_private_files(0) == -1);
+        for (int i = 0; i < MAX_PRIVATE; i++) {
+            assert(tfs_close(handles[i]) != -1);
+        }
+    }
+
+    assert(tfs_private_files(0) != -1);
+    assert(tfs_private_files(0) == -1);
+    return NULL;
+}
+
+typedef struct {
+    int handle;
+    int result;
+} peek_t;
+
+static void *peek_fn(void *arg) {
+    peek_t *peek = arg;
+    char buffer[4];
+    peek->result = (int)tfs_read(peek->handle, buffer, sizeof(buffer));
+    return NULL;
+}
+
+int main() {
+    pthread_t tid[NUM_THREADS];
+    int ids[NUM_THREADS];
+
+    tfs_params params = tfs_default_params();
+    params.max_open_files_count = 2;
+    params.aio_worker_count = 1;
+    assert(tfs_init(&params) != -1);
+
+    // the instance's table is kept full meanwhile
+    int shared[2];
+    shared[0] = tfs_open("/shared", TFS_O_CREAT);
+    shared[1] = tfs_opendir("/");
+    assert(shared[0] != -1 && shared[1] != -1);
+
+    for (int i = 0; i < NUM_THREADS; i++) {
+        ids[i] = i;
+        assert(pthread_create(&tid[i], NULL, owner_fn, &ids[i]) == 0);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+
+    // private handles are invalid in other threads; shared ones are not
+    assert(tfs_close(shared[0]) != -1);
+    assert(tfs_private_files(MAX_PRIVATE) != -1);
+    int f = tfs_open("/t0", 0);
+    assert(f != -1);
+    int g = tfs_open("/t0", TFS_O_SHARED);
+    assert(g != -1);
+    assert(tfs_open("/t0", TFS_O_SHARED) == -1); // the instance's is full
+
+    peek_t peek = {.handle = f, .result = 0};
+    pthread_t peeker;
+    assert(pthread_create(&peeker, NULL, peek_fn, &peek) == 0);
+    assert(pthread_join(peeker, NULL) == 0);
+    assert(peek.result == -1);
+
+    peek.handle = g;
+    assert(pthread_create(&peeker, NULL, peek_fn, &peek) == 0);
+    assert(pthread_join(peeker, NULL) == 0);
+    assert(peek.result == 4);
+
+    // nor can they be handed to the aio workers
+    char buffer[4];
+    assert(tfs_aread(f, buffer, sizeof(buffer), NULL, NULL) == -1);
+
+    assert(tfs_close(f) != -1);
+    assert(tfs_close(f) == -1);
+    assert(tfs_close(g) != -1);
+    assert(tfs_closedir(shared[1]) != -1);
+    assert(tfs_private_files(0) != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
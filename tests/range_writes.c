@@ -0,0 +1,124 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_THREADS 8
+#define CHUNK 96
+#define ROUNDS 100
+
+static atomic_int in_exclusive;
+
+// opens the file, positioned at the start of a thread's chunk
+static int open_at_chunk(int id) {
+    char skip[CHUNK];
+    int f = tfs_open("/f", 0);
+    assert(f != -1);
+    for (int i = 0; i < id; i++) {
+        assert(tfs_read(f, skip, CHUNK) == CHUNK);
+    }
+    return f;
+}
+
+static void *writer_fn(void *arg) {
+    int id = *(int *)arg;
+    char chunk[CHUNK];
+    char check[CHUNK];
+    for (int round = 0; round < ROUNDS; round++) {
+        memset(chunk, 'a' + (id + round) % 26, CHUNK);
+
+        int f = open_at_chunk(id);
+        assert(tfs_write(f, chunk, CHUNK) == CHUNK);
+        assert(tfs_close(f) != -1);
+
+        // no other writer touched this chunk
+        f = open_at_chunk(id);
+        assert(tfs_read(f, check, CHUNK) == CHUNK);
+        assert(!memcmp(check, chunk, CHUNK));
+        assert(tfs_close(f) != -1);
+    }
+    return NULL;
+}
+
+static void *locker_fn(void *arg) {
+    int id = *(int *)arg;
+    int f = tfs_open("/f", 0);
+    assert(f != -1);
+    for (int round = 0; round < ROUNDS; round++) {
+        // every thread locks a range overlapping the shared middle one
+        assert(tfs_lock_range(f, (size_t)id * CHUNK, 2 * CHUNK * NUM_THREADS,
+                              TFS_LOCK_EXCLUSIVE) != -1);
+        assert(atomic_fetch_add(&in_exclusive, 1) == 0);
+        atomic_fetch_sub(&in_exclusive, 1);
+        assert(tfs_unlock_range(f, (size_t)id * CHUNK,
+                                2 * CHUNK * NUM_THREADS) != -1);
+
+        assert(tfs_lock_range(f, 0, CHUNK, TFS_LOCK_SHARED) != -1);
+        assert(tfs_unlock_range(f, 0, CHUNK) != -1);
+    }
+    // ranges left locked are released by tfs_close
+    assert(tfs_lock_range(f, 0, CHUNK, TFS_LOCK_EXCLUSIVE) != -1);
+    assert(tfs_close(f) != -1);
+    return NULL;
+}
+
+static void run(void *(*fn)(void *)) {
+    pthread_t tid[NUM_THREADS];
+    int ids[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        ids[i] = i;
+        assert(pthread_create(&tid[i], NULL, fn, &ids[i]) == 0);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+}
+
+int main() {
+    char buffer[CHUNK * NUM_THREADS];
+
+    assert(tfs_init(NULL) != -1);
+
+    int f = tfs_open("/f", TFS_O_CREAT);
+    assert(f != -1);
+    memset(buffer, '-', sizeof(buffer));
+    assert(tfs_write(f, buffer, sizeof(buffer)) == sizeof(buffer));
+    assert(tfs_close(f) != -1);
+
+    // writers of disjoint chunks of the file
+    run(writer_fn);
+
+    f = tfs_open("/f", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == sizeof(buffer));
+    for (int id = 0; id < NUM_THREADS; id++) {
+        char expected = (char)('a' + (id + ROUNDS - 1) % 26);
+        for (size_t i = 0; i < CHUNK; i++) {
+            assert(buffer[(size_t)id * CHUNK + i] == expected);
+        }
+    }
+
+    // overwrites keep the size; writes past the end still extend the file
+    assert(tfs_write(f, "tail", 4) == 4);
+    assert(tfs_close(f) != -1);
+    f = tfs_open("/f", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == sizeof(buffer));
+    assert(tfs_read(f, buffer, sizeof(buffer)) == 4);
+    assert(!memcmp(buffer, "tail", 4));
+
+    // unlocking a range that is not held fails
+    assert(tfs_unlock_range(f, 0, CHUNK) == -1);
+    assert(tfs_lock_range(f, 0, 0, TFS_LOCK_SHARED) == -1);
+    assert(tfs_close(f) != -1);
+
+    // advisory locks
+    run(locker_fn);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define FILE_SIZE (64 * 1024)
+#define CHUNK (1024)
+#define CACHE_SIZE (8)
+
+static char contents[FILE_SIZE];
+
+// write a file, and then enough others to evict it from the block cache
+static void write_evicted(char const *name) {
+    char other[16];
+
+    int f = tfs_open(name, TFS_O_CREAT | TFS_O_TRUNC);
+    assert(f != -1);
+    assert(tfs_write(f, contents, FILE_SIZE) == FILE_SIZE);
+    assert(tfs_close(f) != -1);
+
+    for (int i = 0; i < CACHE_SIZE; i++) {
+        snprintf(other, sizeof(other), "/other%d", i);
+        f = tfs_open(other, TFS_O_CREAT | TFS_O_TRUNC);
+        assert(f != -1);
+        assert(tfs_write(f, "x", 1) == 1);
+        assert(tfs_close(f) != -1);
+    }
+    assert(tfs_sync() == 0);
+}
+
+int main() {
+    char buffer[CHUNK];
+    tfs_cache_stats_t before;
+    tfs_cache_stats_t after;
+
+    for (size_t i = 0; i < FILE_SIZE; i++) {
+        contents[i] = (char)('A' + i % 26);
+    }
+
+    tfs_params params = tfs_default_params();
+    params.block_size = FILE_SIZE;
+    params.max_block_count = 2 * CACHE_SIZE;
+    params.block_cache_size = CACHE_SIZE; // a single bucket
+    params.latency.mode = TFS_LATENCY_SLEEP;
+    params.latency.data_ns = 1000000; // 1 ms
+    assert(tfs_init(&params) != -1);
+
+    // sequential reads trigger readahead
+    write_evicted("/f1");
+    assert(tfs_block_cache_stats(&before) == 0);
+    int f = tfs_open("/f1", 0);
+    assert(f != -1);
+    for (size_t off = 0; off < FILE_SIZE; off += CHUNK) {
+        assert(tfs_read(f, buffer, CHUNK) == CHUNK);
+        assert(memcmp(buffer, contents + off, CHUNK) == 0);
+    }
+    assert(tfs_read(f, buffer, CHUNK) == 0);
+    assert(tfs_close(f) != -1);
+    assert(tfs_block_cache_stats(&after) == 0);
+    assert(after.prefetched > before.prefetched);
+    assert(after.hits > before.hits);
+
+    // reads after a write on the same handle are not sequential
+    write_evicted("/f1");
+    f = tfs_open("/f1", 0);
+    assert(f != -1);
+    assert(tfs_block_cache_stats(&before) == 0);
+    for (size_t off = 0; off < FILE_SIZE; off += 2 * CHUNK) {
+        assert(tfs_write(f, contents + off, CHUNK) == CHUNK);
+        assert(tfs_read(f, buffer, CHUNK) == CHUNK);
+        assert(memcmp(buffer, contents + off + CHUNK, CHUNK) == 0);
+    }
+    assert(tfs_block_cache_stats(&after) == 0);
+    assert(after.prefetched == before.prefetched);
+    assert(tfs_close(f) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_FILES 12
+
+int main() {
+    char name[16];
+    size_t listed = 0;
+    tfs_dirent_plus_t entries[5];
+
+    assert(tfs_init(NULL) != -1);
+
+    // file /f<i> has i bytes
+    for (int i = 0; i < NUM_FILES; i++) {
+        sprintf(name, "/f%d", i);
+        int f = tfs_open(name, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_write(f, "0123456789abcdef", (size_t)i) == i);
+        assert(tfs_close(f) != -1);
+    }
+    assert(tfs_link("/f3", "/hard") != -1);
+    assert(tfs_sym_link("/f4", "/soft") != -1);
+
+    int d = tfs_opendir("/");
+    assert(d != -1);
+
+    ssize_t r;
+    while ((r = tfs_readdir_plus(d, entries, sizeof(entries))) > 0) {
+        size_t count = (size_t)r / sizeof(tfs_dirent_plus_t);
+        for (size_t i = 0; i < count; i++) {
+            tfs_dirent_plus_t const *e = &entries[i];
+            int index;
+            if (!strcmp(e->d_entry.d_name, "hard")) {
+                assert(e->d_entry.d_type == TFS_DT_FILE);
+                assert(e->st_size == 3);
+                assert(e->st_nlink == 2);
+            } else if (!strcmp(e->d_entry.d_name, "soft")) {
+                assert(e->d_entry.d_type == TFS_DT_SYMLINK);
+                assert(e->st_size == strlen("/f4"));
+                assert(e->st_nlink == 1);
+            } else {
+                assert(sscanf(e->d_entry.d_name, "f%d", &index) == 1);
+                assert(e->d_entry.d_type == TFS_DT_FILE);
+                assert(e->st_size == index);
+                assert(e->st_nlink == (index == 3 ? 2 : 1));
+            }
+            listed++;
+        }
+    }
+    assert(r == 0);
+    assert(listed == NUM_FILES + 2);
+
+    assert(tfs_readdir_plus(d, entries, sizeof(entries[0]) - 1) == -1);
+    assert(tfs_closedir(d) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
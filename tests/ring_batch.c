@@ -0,0 +1,97 @@
+#include "fs/operations.h"
+#include "fs/ring.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_FILES 8
+
+char const file_contents[] = "BBB!";
+
+static void submit_and_reap(tfs_ring_t *ring, tfs_cqe_t *cqes, size_t count) {
+    assert(tfs_ring_submit(ring) == (int)count);
+    size_t reaped = 0;
+    while (reaped < count) {
+        reaped += tfs_ring_reap(ring, cqes + reaped, count - reaped, 1);
+    }
+}
+
+int main() {
+    char names[NUM_FILES][8];
+    int fhandles[NUM_FILES];
+    tfs_cqe_t cqes[3 * NUM_FILES];
+
+    assert(tfs_init(NULL) != -1);
+
+    tfs_ring_t *ring = tfs_ring_create(3 * NUM_FILES, 4);
+    assert(ring != NULL);
+
+    // batch of creates
+    for (int i = 0; i < NUM_FILES; i++) {
+        sprintf(names[i], "/f%d", i);
+        tfs_sqe_t *sqe = tfs_ring_get_sqe(ring);
+        assert(sqe != NULL);
+        sqe->opcode = TFS_OP_OPEN;
+        sqe->name = names[i];
+        sqe->mode = TFS_O_CREAT;
+        sqe->user_data = (uint64_t)i;
+    }
+    submit_and_reap(ring, cqes, NUM_FILES);
+    for (int i = 0; i < NUM_FILES; i++) {
+        assert(cqes[i].result != -1);
+        fhandles[cqes[i].user_data] = (int)cqes[i].result;
+    }
+
+    // batch of writes followed by closes, same handle requests stay ordered
+    for (int i = 0; i < NUM_FILES; i++) {
+        for (size_t j = 0; j < 2; j++) {
+            tfs_sqe_t *sqe = tfs_ring_get_sqe(ring);
+            assert(sqe != NULL);
+            sqe->opcode = TFS_OP_WRITE;
+            sqe->fhandle = fhandles[i];
+            sqe->buffer = (void *)file_contents;
+            sqe->len = strlen(file_contents);
+        }
+        tfs_sqe_t *sqe = tfs_ring_get_sqe(ring);
+        assert(sqe != NULL);
+        sqe->opcode = TFS_OP_CLOSE;
+        sqe->fhandle = fhandles[i];
+    }
+    // the ring is full until completions are reaped
+    assert(tfs_ring_get_sqe(ring) == NULL);
+    submit_and_reap(ring, cqes, 3 * NUM_FILES);
+    for (int i = 0; i < 3 * NUM_FILES; i++) {
+        assert(cqes[i].result != -1);
+    }
+
+    for (int i = 0; i < NUM_FILES; i++) {
+        char buffer[16];
+        int f = tfs_open(names[i], 0);
+        assert(f != -1);
+        assert(tfs_read(f, buffer, sizeof(buffer)) ==
+               2 * strlen(file_contents));
+        assert(memcmp(buffer, "BBB!BBB!", 2 * strlen(file_contents)) == 0);
+        assert(tfs_close(f) != -1);
+    }
+
+    // batch of unlinks, one of them failing
+    for (int i = 0; i <= NUM_FILES; i++) {
+        tfs_sqe_t *sqe = tfs_ring_get_sqe(ring);
+        assert(sqe != NULL);
+        sqe->opcode = TFS_OP_UNLINK;
+        sqe->name = i < NUM_FILES ? names[i] : "/missing";
+        sqe->user_data = (uint64_t)i;
+    }
+    submit_and_reap(ring, cqes, NUM_FILES + 1);
+    for (int i = 0; i <= NUM_FILES; i++) {
+        assert(cqes[i].result == (cqes[i].user_data < NUM_FILES ? 0 : -1));
+    }
+    assert(tfs_open(names[0], 0) == -1);
+
+    tfs_ring_destroy(ring);
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}
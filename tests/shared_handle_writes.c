@@ -0,0 +1,69 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_THREADS 4
+#define ROUNDS 128 // the records fill the block
+#define RECORD_SIZE 8
+
+static int fhandle;
+
+static void *writer_fn(void *arg) {
+    char record[RECORD_SIZE];
+    memset(record, 'a' + *(int *)arg, sizeof(record));
+    for (int i = 0; i < ROUNDS; i++) {
+        assert(tfs_write(fhandle, record, sizeof(record)) == sizeof(record));
+    }
+    return NULL;
+}
+
+int main() {
+    pthread_t tid[NUM_THREADS];
+    int ids[NUM_THREADS];
+    char contents[NUM_THREADS * ROUNDS * RECORD_SIZE + 1];
+
+    tfs_params params = tfs_default_params();
+    params.block_size = NUM_THREADS * ROUNDS * RECORD_SIZE;
+    assert(tfs_init(&params) != -1);
+
+    // the file already has its final size, so that writes are overwrites
+    fhandle = tfs_open("/f", TFS_O_CREAT);
+    assert(fhandle != -1);
+    assert(tfs_ftruncate(fhandle, sizeof(contents) - 1) != -1);
+
+    // every write through the shared handle gets bytes of its own
+    for (int i = 0; i < NUM_THREADS; i++) {
+        ids[i] = i;
+        assert(pthread_create(&tid[i], NULL, writer_fn, &ids[i]) == 0);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+    assert(tfs_write(fhandle, "x", 1) == 0); // the offset is at the end
+    assert(tfs_close(fhandle) != -1);
+
+    int f = tfs_open("/f", 0);
+    assert(f != -1);
+    assert(tfs_read(f, contents, sizeof(contents)) == sizeof(contents) - 1);
+    assert(tfs_close(f) != -1);
+
+    int records[NUM_THREADS] = {0};
+    for (size_t r = 0; r < sizeof(contents) - 1; r += RECORD_SIZE) {
+        int id = contents[r] - 'a';
+        assert(id >= 0 && id < NUM_THREADS);
+        for (size_t i = 1; i < RECORD_SIZE; i++) {
+            assert(contents[r + i] == contents[r]);
+        }
+        records[id]++;
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(records[i] == ROUNDS);
+    }
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    assert(tfs_destroy() != -1);
+    return 0;
+}
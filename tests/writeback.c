@@ -0,0 +1,76 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define DATA_LATENCY (0.1) // seconds
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main() {
+    char buffer[8];
+    tfs_cache_stats_t stats;
+
+    tfs_params params = tfs_default_params();
+    params.latency.mode = TFS_LATENCY_SLEEP;
+    params.latency.data_ns = (size_t)(DATA_LATENCY * 1e9);
+    assert(tfs_init(&params) != -1);
+
+    // writes only reach the cache
+    int f = tfs_open("/f1", TFS_O_CREAT);
+    assert(f != -1);
+    double start = now();
+    assert(tfs_write(f, "AAA!", 4) == 4);
+    assert(tfs_write(f, "BBB!", 4) == 4);
+    assert(now() - start < DATA_LATENCY);
+
+    // fsync waits for the write-back, once
+    assert(tfs_block_cache_stats(&stats) == 0);
+    size_t flushed = stats.flushed;
+    start = now();
+    assert(tfs_fsync(f) == 0);
+    assert(now() - start >= DATA_LATENCY);
+    assert(tfs_block_cache_stats(&stats) == 0);
+    assert(stats.flushed == flushed + 1);
+
+    start = now();
+    assert(tfs_fsync(f) == 0);
+    assert(now() - start < DATA_LATENCY);
+    assert(tfs_fsync(-1) == -1);
+
+    // the flusher writes dirty blocks back in the background
+    assert(tfs_write(f, "CCC!", 4) == 4);
+    flushed = stats.flushed;
+    for (int i = 0; i < 100 && stats.flushed == flushed; i++) {
+        nanosleep(&(struct timespec){.tv_nsec = 10000000}, NULL);
+        assert(tfs_block_cache_stats(&stats) == 0);
+    }
+    assert(stats.flushed == flushed + 1);
+    assert(tfs_close(f) != -1);
+
+    // sync writes everything back
+    int g = tfs_open("/f2", TFS_O_CREAT);
+    assert(g != -1);
+    assert(tfs_write(g, "DDD!", 4) == 4);
+    assert(tfs_close(g) != -1);
+    assert(tfs_sync() == 0);
+    assert(tfs_block_cache_stats(&stats) == 0);
+    assert(stats.flushed >= flushed + 2);
+
+    f = tfs_open("/f1", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == 8);
+    assert(memcmp(buffer, "AAA!BBB!", 8) == 0);
+    assert(tfs_close(f) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("\033[92m Successful test.\n\033[0m");
+
+    return 0;
+}